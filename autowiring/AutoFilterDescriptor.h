@@ -226,6 +226,40 @@ struct CallExtractor<Deferred (T::*)(Args...)>:
   }
 };
 
+#if AUTOWIRING_USE_COROUTINES
+/// <summary>
+/// Specialization for coroutine cases
+/// </summary>
+/// <remarks>
+/// The coroutine starts on the thread that satisfied it, and holds the packet until it finishes.  If the
+/// AutoFilter belongs to a dispatch queue, the coroutine may await delays on that queue right away.
+/// </remarks>
+template<class T, class... Args>
+struct CallExtractor<DispatchCoroutine (T::*)(Args...)>:
+  Decompose<void (T::*)(Args...)>
+{
+  static const bool deferred = false;
+  static const size_t N = sizeof...(Args);
+
+  template<DispatchCoroutine(T::*memFn)(Args...)>
+  static void Call(void* pObj, AutoPacket& autoPacket, const autowiring::DataFill& satisfaction) {
+    autowiring::DispatchCoroutineInit init;
+    if constexpr(std::is_base_of<DispatchQueue, T>::value)
+      init.queue = (T*) pObj;
+    else
+      init.queue = nullptr;
+    init.retained = autoPacket.shared_from_this();
+
+    // Picked up by the frame's promise before the body starts:
+    autowiring::t_pCoroutineInit = &init;
+    auto clear = MakeAtExit([] { autowiring::t_pCoroutineInit = nullptr; });
+    (((T*) pObj)->*memFn)(
+      sourced_checkout<Args>()(autoPacket, satisfaction)...
+    ).RethrowIfFailed();
+  }
+};
+#endif
+
 /// <summary>
 /// AutoFilter argument disposition
 /// </summary>
@@ -6,6 +6,7 @@
 #include "AutoCheckout.h"
 #include "DecorationDisposition.h"
 #include "demangle.h"
+#include "DispatchCoroutine.h"
 #include "is_shared_ptr.h"
 #include "ObjectPool.h"
 #include "is_any.h"
@@ -546,4 +547,81 @@ public:
 
   /// <returns>True if the indicated type has been requested for use by some consumer</returns>
   bool HasSubscribers(const std::type_info& data, const std::type_info& source = typeid(void)) const;
+
+#if AUTOWIRING_USE_COROUTINES
+  /// <summary>
+  /// Allows a coroutine to suspend with "co_await packet.Await<T>()" until this packet is decorated with T
+  /// </summary>
+  /// <remarks>
+  /// The result of the co_await is a reference to the decoration.  The coroutine resumes on the thread that
+  /// decorates the packet; await a dispatch queue afterwards to move elsewhere.  If the decoration is marked
+  /// unsatisfiable, or the packet is finalized without it, the co_await throws autowiring_error instead.
+  ///
+  /// A coroutine AutoFilter holds its packet until it finishes.  If such a coroutine awaits a decoration on
+  /// its own packet, that decoration must eventually be produced or marked unsatisfiable.
+  /// </remarks>
+  template<class T>
+  autowiring::DecorationAwaiter<T> Await(void) {
+    return autowiring::DecorationAwaiter<T>(*this);
+  }
+#endif
 };
+
+#if AUTOWIRING_USE_COROUTINES
+namespace autowiring {
+  /// <summary>
+  /// Awaiter returned by AutoPacket::Await
+  /// </summary>
+  template<class T>
+  class DecorationAwaiter {
+  public:
+    explicit DecorationAwaiter(AutoPacket& packet) :
+      m_packet(packet),
+      m_value(nullptr)
+    {}
+
+  private:
+    AutoPacket& m_packet;
+    const T* m_value;
+
+  public:
+    bool await_ready(void) {
+      return m_packet.Get(m_value);
+    }
+
+    template<class Promise>
+    void await_suspend(std::coroutine_handle<Promise> h) {
+      // Whichever of the two recipients below is called first resumes the coroutine
+      struct Waiter {
+        std::coroutine_handle<Promise> h;
+        const T** ppValue;
+        std::atomic<bool> fired;
+      };
+      auto waiter = std::make_shared<Waiter>();
+      waiter->h = h;
+      waiter->ppValue = &m_value;
+      waiter->fired = false;
+
+      // The coroutine, and this awaiter with it, may be gone as soon as the decoration recipient is added,
+      // so the final-call recipient goes first
+      AutoPacket& packet = m_packet;
+      packet.AddRecipient(std::function<void(const AutoPacket&)>([waiter] (const AutoPacket&) {
+        if(!waiter->fired.exchange(true))
+          ResumeCoroutine(waiter->h);
+      }));
+      packet.AddRecipient(std::function<void(const T&)>([waiter] (const T& value) {
+        if(!waiter->fired.exchange(true)) {
+          *waiter->ppValue = &value;
+          ResumeCoroutine(waiter->h);
+        }
+      }));
+    }
+
+    const T& await_resume(void) const {
+      if(!m_value)
+        throw autowiring_error("An awaited decoration will never be satisfied");
+      return *m_value;
+    }
+  };
+}
+#endif
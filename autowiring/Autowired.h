@@ -4,6 +4,8 @@
 #include "Decompose.h"
 #include "Deferred.h"
 #include "GlobalCoreContext.h"
+#include <iterator>
+#include <vector>
 #include MEMORY_HEADER
 #include ATOMIC_HEADER
 
@@ -319,6 +321,56 @@ public:
   bool IsAutowired(void) const { return std::shared_ptr<T>::get() != nullptr; }
 };
 
+/// <summary>
+/// An event firer whose events only reach listeners subscribed to a particular routing key
+/// </summary>
+/// <remarks>
+/// Obtained from AutoFired::ToKey.  Listeners subscribe to a key with AutoFired::Subscribe.
+/// </remarks>
+template<class T>
+class AutoFiredRoute
+{
+public:
+  AutoFiredRoute(const std::weak_ptr<JunctionBox<T>>& junctionBox, size_t key) :
+    m_junctionBox(junctionBox),
+    m_key(key)
+  {}
+
+private:
+  std::weak_ptr<JunctionBox<T>> m_junctionBox;
+  size_t m_key;
+
+public:
+  template<class MemFn>
+  InvokeRelay<MemFn> operator()(MemFn pfn) const {
+    static_assert(std::is_same<typename Decompose<MemFn>::type, T>::value, "Cannot invoke an event for an unrelated type");
+
+    auto box = m_junctionBox.lock();
+    if(!box)
+      // Context has been destroyed
+      return InvokeRelay<MemFn>();
+
+    if(EventFiredSampler::ShouldReport<T>())
+      AutoGlobalContext()->Invoke(&AutowiringEvents::EventFired)(*CoreContext::CurrentContext(), typeid(T));
+
+    return InvokeRelay<MemFn>(box, pfn, m_key);
+  }
+
+  template<class MemFn>
+  InvokeRelay<MemFn> Fire(MemFn pfn) const {
+    static_assert(!std::is_same<typename Decompose<MemFn>::retType, Deferred>::value, "Cannot Fire an event which is marked Deferred");
+
+    return operator()(pfn);
+  }
+
+  template<class MemFn>
+  InvokeRelay<MemFn> Defer(MemFn pfn) const {
+    static_assert(std::is_same<typename Decompose<MemFn>::retType, Deferred>::value, "Cannot Defer an event which does not return the Deferred type");
+
+    return operator()(pfn);
+  }
+};
+
 /// <summary>
 /// Convenience class to create an event firer. Also caches the associated JunctionBox
 /// </summary>
@@ -383,7 +435,8 @@ public:
       // Context has been destroyed
       return InvokeRelay<MemFn>();
 
-    AutoGlobalContext()->Invoke(&AutowiringEvents::EventFired)(*CoreContext::CurrentContext(),typeid(typename Decompose<MemFn>::type));
+    if(EventFiredSampler::ShouldReport<T>())
+      AutoGlobalContext()->Invoke(&AutowiringEvents::EventFired)(*CoreContext::CurrentContext(), typeid(T));
 
     return MakeInvokeRelay(box, pfn);
   }
@@ -395,12 +448,169 @@ public:
     return operator()(pfn);
   }
 
+  /// <summary>
+  /// Fires an event whose member function is named at compile time
+  /// </summary>
+  /// <remarks>
+  /// Use this for hot events, as in sender.FireStatic<decltype(&amp;T::Fn), &amp;T::Fn>()(args...).  Delivery
+  /// is otherwise identical to Fire, but listeners are called directly, without any type-erased wrapper
+  /// or run-time member function pointer.
+  /// </remarks>
+  template<class MemFn, MemFn pfn>
+  StaticInvokeRelay<MemFn, pfn> FireStatic(void) const {
+    static_assert(std::is_same<typename Decompose<MemFn>::type, T>::value, "Cannot invoke an event for an unrelated type");
+    static_assert(!std::is_same<typename Decompose<MemFn>::retType, Deferred>::value, "Cannot Fire an event which is marked Deferred");
+
+    auto box = m_junctionBox.lock();
+    if(!box)
+      // Context has been destroyed
+      return StaticInvokeRelay<MemFn, pfn>();
+
+    if(EventFiredSampler::ShouldReport<T>())
+      AutoGlobalContext()->Invoke(&AutowiringEvents::EventFired)(*CoreContext::CurrentContext(), typeid(T));
+
+    return StaticInvokeRelay<MemFn, pfn>(std::move(box));
+  }
+
+  /// <summary>
+  /// Fires an event whose listeners are called concurrently on the CoreThreadPool in the current context
+  /// </summary>
+  /// <remarks>
+  /// Meant for events with many independent listeners that each do a lot of work.  The call returns once
+  /// every listener has returned, and reports exceptions in the same way as Fire.  Listeners are called
+  /// on the firing thread, one after the other, if there is no CoreThreadPool in the current context or
+  /// any of its ancestors.
+  /// </remarks>
+  template<class MemFn>
+  ParallelInvokeRelay<MemFn> FireParallel(MemFn pfn) const {
+    std::shared_ptr<CoreThreadPool> pool;
+    CoreContext::CurrentContext()->FindByTypeRecursive(pool);
+    return FireParallel(pool, pfn);
+  }
+
+  /// <summary>
+  /// Fires an event whose listeners are called concurrently on the specified pool
+  /// </summary>
+  template<class MemFn>
+  ParallelInvokeRelay<MemFn> FireParallel(const std::shared_ptr<CoreThreadPool>& pool, MemFn pfn) const {
+    static_assert(std::is_same<typename Decompose<MemFn>::type, T>::value, "Cannot invoke an event for an unrelated type");
+    static_assert(!std::is_same<typename Decompose<MemFn>::retType, Deferred>::value, "Cannot Fire an event which is marked Deferred");
+
+    auto box = m_junctionBox.lock();
+    if(!box)
+      // Context has been destroyed
+      return ParallelInvokeRelay<MemFn>();
+
+    if(EventFiredSampler::ShouldReport<T>())
+      AutoGlobalContext()->Invoke(&AutowiringEvents::EventFired)(*CoreContext::CurrentContext(), typeid(T));
+
+    return ParallelInvokeRelay<MemFn>(box, pfn, pool);
+  }
+
+  /// <summary>
+  /// Fires a single-argument event once for each element of the passed range
+  /// </summary>
+  /// <returns>False if an exception was thrown by a recipient, true otherwise</returns>
+  /// <remarks>
+  /// Equivalent to firing the event for each element in turn, except that the costs paid on every fire,
+  /// such as resolving the junction box and reporting the fire, are paid once for the whole batch.  Each
+  /// listener receives the entire batch, in order, before the next listener receives any of it.
+  ///
+  /// Elements are passed to listeners exactly as the range yields them, so an event taking a non-const
+  /// reference must be fired with a mutable range.  Unlike firing each element in turn, a listener which
+  /// throws receives none of the elements after the one it threw on.
+  /// </remarks>
+  template<class Arg, class Range>
+  bool FireBatch(void (T::*pfn)(Arg), Range&& range) const {
+    static_assert(!std::is_rvalue_reference<Arg>::value, "Can't use rvalue references as event argument type");
+
+    typedef decltype(*std::begin(range)) t_element;
+    static_assert(std::is_convertible<t_element, Arg>::value, "Elements of this range cannot be passed to the event");
+
+    auto box = m_junctionBox.lock();
+    if(!box || !box->IsInitiated())
+      return true;
+
+    if(EventFiredSampler::ShouldReport<T>())
+      AutoGlobalContext()->Invoke(&AutowiringEvents::EventFired)(*CoreContext::CurrentContext(), typeid(T));
+
+    box->SerializeBatch(pfn, std::begin(range), std::end(range));
+    return box->FireCurriedBatch(
+      [pfn] (T& obj, t_element arg) { (obj.*pfn)(arg); },
+      std::begin(range),
+      std::end(range)
+    );
+  }
+
+  /// <summary>
+  /// Fires a batch of single-argument events through a batch-aware overload of the event
+  /// </summary>
+  /// <param name="pfn">The per-element event, used to describe each element to event serializers</param>
+  /// <param name="pfnBatch">The overload which is actually called, once per listener with the whole batch</param>
+  /// <remarks>
+  /// Intended for interfaces that pair an event with a virtual overload accepting a vector, whose default
+  /// implementation calls the per-element event for each element.  Listeners which can process a batch
+  /// more efficiently override the vector overload; the rest need not do anything.
+  /// </remarks>
+  template<class Arg>
+  bool FireBatch(void (T::*pfn)(Arg), void (T::*pfnBatch)(const std::vector<typename std::decay<Arg>::type>&), const std::vector<typename std::decay<Arg>::type>& batch) const {
+    static_assert(!std::is_rvalue_reference<Arg>::value, "Can't use rvalue references as event argument type");
+
+    auto box = m_junctionBox.lock();
+    if(!box || !box->IsInitiated())
+      return true;
+
+    if(EventFiredSampler::ShouldReport<T>())
+      AutoGlobalContext()->Invoke(&AutowiringEvents::EventFired)(*CoreContext::CurrentContext(), typeid(T));
+
+    box->SerializeBatch(pfn, batch.begin(), batch.end());
+    return box->FireCurried(
+      [pfnBatch] (T& obj, const std::vector<typename std::decay<Arg>::type>& batch) { (obj.*pfnBatch)(batch); },
+      batch
+    );
+  }
+
   template<class MemFn>
   InvokeRelay<MemFn> Defer(MemFn pfn) const {
     static_assert(std::is_same<typename Decompose<MemFn>::retType, Deferred>::value, "Cannot Defer an event which does not return the Deferred type");
 
     return operator()(pfn);
   }
+
+  /// <summary>
+  /// Returns a firer whose events only reach listeners subscribed to the specified key
+  /// </summary>
+  /// <remarks>
+  /// Use this to address a single shard, session, or symbol among many listeners on the same event, as in
+  /// sender.ToKey(key)(&amp;T::Fn)(args...).  Listeners which have not subscribed to the key are not called,
+  /// and the cost of the fire does not depend on how many of them there are.  Events fired without a key
+  /// still reach every listener.
+  /// </remarks>
+  AutoFiredRoute<T> ToKey(size_t key) const {
+    return AutoFiredRoute<T>(m_junctionBox, key);
+  }
+
+  /// <summary>
+  /// Subscribes a listener to events fired with the specified key
+  /// </summary>
+  /// <returns>False if the receiver is not yet listening to this event</returns>
+  /// <remarks>
+  /// A listener may subscribe to any number of keys.  Its subscriptions end when it is removed from the
+  /// event, such as when its context is torn down.
+  /// </remarks>
+  bool Subscribe(size_t key, const std::shared_ptr<T>& receiver) const {
+    auto box = m_junctionBox.lock();
+    return box && box->AddRoute(key, receiver);
+  }
+
+  /// <summary>
+  /// Ends a subscription made with Subscribe
+  /// </summary>
+  /// <returns>False if the receiver was not subscribed to the specified key</returns>
+  bool Unsubscribe(size_t key, const std::shared_ptr<T>& receiver) const {
+    auto box = m_junctionBox.lock();
+    return box && box->RemoveRoute(key, receiver);
+  }
 };
 
 // We will also pull in a few utility headers which are reliant upon the declarations in this file
@@ -5,6 +5,8 @@
 #include MEMORY_HEADER
 #include MUTEX_HEADER
 #include CHRONO_HEADER
+#include <cstdint>
+#include <vector>
 
 struct BasicThreadStateBlock;
 class BasicThread;
@@ -31,6 +33,80 @@ enum class ThreadPriority {
   Multimedia
 };
 
+/// <summary>
+/// Operating system scheduling policies which may be requested for a thread
+/// </summary>
+enum class ThreadSchedulingPolicy {
+  // The operating system's default time-sharing policy
+  Default,
+
+  // Real-time, first in first out.  The thread runs until it blocks or is preempted by a thread with a
+  // higher real-time priority.
+  Fifo,
+
+  // Real-time, similar to Fifo except that threads of equal priority are time-sliced
+  RoundRobin
+};
+
+/// <summary>
+/// Describes which processors a thread may run on, and how it is to be scheduled on them
+/// </summary>
+struct ThreadScheduling {
+  ThreadScheduling(void) :
+    numaNode(-1),
+    policy(ThreadSchedulingPolicy::Default),
+    realtimePriority(0)
+  {}
+
+  // Zero-based indices of the processors this thread may run on, or empty to allow any processor
+  std::vector<int> cpus;
+
+  // A NUMA node to which the thread is restricted, or -1 for no restriction.  If cpus is also specified,
+  // the thread may only run on those of the specified processors that belong to this node.
+  int numaNode;
+
+  // The scheduling policy, and the thread's priority under a real-time policy.  Real-time priorities on
+  // Linux range from 1 to 99, and usually require elevated privileges.
+  ThreadSchedulingPolicy policy;
+  int realtimePriority;
+
+  /// <returns>True if these settings leave the operating system's defaults in place</returns>
+  bool IsDefault(void) const {
+    return cpus.empty() && numaNode < 0 && policy == ThreadSchedulingPolicy::Default;
+  }
+};
+
+/// <summary>
+/// Resource usage of a single thread, as reported by the operating system
+/// </summary>
+/// <remarks>
+/// Counts which the platform does not report are left at zero
+/// </remarks>
+struct BasicThreadStatistics {
+  BasicThreadStatistics(void) :
+    startTime(std::chrono::steady_clock::time_point::min()),
+    kernelTime(0),
+    userTime(0),
+    runQueueWait(0),
+    voluntaryContextSwitches(0),
+    involuntaryContextSwitches(0)
+  {}
+
+  // The time at which the thread began to run
+  std::chrono::steady_clock::time_point startTime;
+
+  // Processor time spent by the thread in kernel mode and in user mode
+  std::chrono::nanoseconds kernelTime;
+  std::chrono::nanoseconds userTime;
+
+  // Time the thread spent ready to run but waiting for a processor
+  std::chrono::nanoseconds runQueueWait;
+
+  // Number of times the thread gave up its processor by blocking, and number of times it was preempted
+  uint64_t voluntaryContextSwitches;
+  uint64_t involuntaryContextSwitches;
+};
+
 /// <summary>
 /// This is an abstract class that has a single Run method for implementation by a
 /// derived class.  The object will remain in the context as long as the thread is
@@ -64,6 +140,14 @@ protected:
   // The current thread priority
   ThreadPriority m_priority;
 
+  // Scheduling settings explicitly assigned to this thread, or null if the context defaults apply.  Guarded
+  // by the state lock.
+  std::unique_ptr<ThreadScheduling> m_scheduling;
+
+  // True if the scheduling settings most recently applied to the running thread could not be applied in
+  // full.  Guarded by the state lock.
+  bool m_schedulingFailed;
+
   /// <summary>
   /// Assigns the name of the thread, for use in debugger windows
   /// </summary>
@@ -84,6 +168,32 @@ private:
   /// </remarks>
   void SetThreadPriority(ThreadPriority threadPriority);
 
+  /// <summary>
+  /// Applies the specified scheduling settings to the running thread
+  /// </summary>
+  /// <returns>False if any part of the settings could not be applied</returns>
+  /// <remarks>
+  /// The state lock must be held and the thread must be running.  Processor affinity is reset to that of
+  /// the process if no processors are specified.
+  /// </remarks>
+  bool ApplyThreadScheduling(const ThreadScheduling& scheduling);
+
+  /// <summary>
+  /// Reads the affinity and scheduling policy of the running thread from the operating system
+  /// </summary>
+  /// <remarks>
+  /// The state lock must be held and the thread must be running
+  /// </remarks>
+  void QueryThreadScheduling(ThreadScheduling& scheduling);
+
+  /// <summary>
+  /// Records the start time and the kernel's identity of the current thread
+  /// </summary>
+  /// <remarks>
+  /// The state lock must be held, and this method must be called from the thread itself before Run
+  /// </remarks>
+  void RecordThreadStart(void);
+
 protected:
   /// <summary>
   /// Recovers a general lock used to synchronize entities in this thread internally
@@ -253,6 +363,44 @@ public:
   /// Obtains running time information for this thread
   /// </summary>
   void GetThreadTimes(std::chrono::milliseconds& kernelTime, std::chrono::milliseconds& userTime);
+
+  /// <summary>
+  /// Obtains processor time, scheduling delay, and context switch counts for this thread
+  /// </summary>
+  /// <returns>False if the thread is not running, in which case the statistics are unchanged</returns>
+  bool GetThreadStatistics(BasicThreadStatistics& statistics);
+
+  /// <summary>
+  /// Assigns processor affinity and a scheduling policy to this thread
+  /// </summary>
+  /// <returns>
+  /// True if the thread is not yet running, or if the settings were successfully applied to the running thread
+  /// </returns>
+  /// <remarks>
+  /// Settings assigned before the thread starts are applied before Run is called.  A thread which has not
+  /// been assigned settings of its own uses those of its enclosing context, see CoreContext::SetThreadScheduling.
+  /// Settings are retained even if they cannot be applied.  Because settings assigned before the thread
+  /// starts are only applied later, a failure to apply them is reported by DidThreadSchedulingFail.
+  /// </remarks>
+  bool SetThreadScheduling(const ThreadScheduling& scheduling);
+
+  /// <summary>
+  /// True if the scheduling settings most recently applied to this thread could not be applied in full
+  /// </summary>
+  /// <remarks>
+  /// This covers settings applied when the thread started, which SetThreadScheduling cannot report.
+  /// </remarks>
+  bool DidThreadSchedulingFail(void) const;
+
+  /// <summary>
+  /// Obtains the scheduling settings in effect for this thread
+  /// </summary>
+  /// <returns>True if the settings were read from the running thread, false if the thread is not running</returns>
+  /// <remarks>
+  /// For a running thread, processor affinity and policy are reported as the operating system sees them.
+  /// Otherwise, the settings that will be applied when the thread starts are reported.
+  /// </remarks>
+  bool GetThreadScheduling(ThreadScheduling& scheduling);
 };
 
 /// <summary>
@@ -3,10 +3,13 @@
 #include MEMORY_HEADER
 #include THREAD_HEADER
 #include MUTEX_HEADER
+#include CHRONO_HEADER
+#include <cstdint>
 
 struct BasicThreadStateBlock:
   std::enable_shared_from_this<BasicThreadStateBlock>
 {
+  BasicThreadStateBlock(void);
   ~BasicThreadStateBlock();
 
   // General purpose thread lock and update condition for the lock
@@ -15,4 +18,14 @@ struct BasicThreadStateBlock:
 
   // The current thread, if running
   std::thread m_thisThread;
+
+  // The time at which the thread began to run, or time_point::min if it has not yet run
+  std::chrono::steady_clock::time_point m_startTime;
+
+  // The kernel's identifier for the thread, on platforms which need one to query thread statistics
+  int64_t m_kernelThreadId;
+
+  // The processor affinity mask last applied to the thread, on platforms which cannot read it back; zero
+  // if none has been applied
+  uint64_t m_affinityMask;
 };
@@ -12,6 +12,7 @@
 #include "ContextMember.h"
 #include "CreationRules.h"
 #include "CurrentContextPusher.h"
+#include "DispatchQueueStats.h"
 #include "fast_pointer_cast.h"
 #include "has_autoinit.h"
 #include "InvokeRelay.h"
@@ -21,6 +22,7 @@
 #include "EventInputStream.h"
 #include "ExceptionFilter.h"
 #include "TeardownNotifier.h"
+#include "EventFiredSampler.h"
 #include "EventRegistry.h"
 #include "TypeRegistry.h"
 #include "TypeUnifier.h"
@@ -42,6 +44,7 @@ class EventOutputStreamBase;
 class GlobalCoreContext;
 class JunctionBoxBase;
 class OutstandingCountTracker;
+struct ThreadScheduling;
 
 template<class T, class Fn>
 class AutowirableSlotFn;
@@ -160,6 +163,9 @@ protected:
   // Destructor does nothing; this is by design.
   std::weak_ptr<Object> m_outstanding;
 
+  // Default scheduling settings for threads in this context and its descendants, if any were assigned
+  std::shared_ptr<const ThreadScheduling> m_threadScheduling;
+
 protected:
   // Delayed creation routine
   typedef std::shared_ptr<CoreContext> (*t_pfnCreate)(
@@ -643,6 +649,47 @@ public:
   /// </remarks>
   std::vector<std::shared_ptr<BasicThread>> CopyBasicThreadList(void) const;
 
+  /// <returns>
+  /// A snapshot of the statistics of every dispatch queue among this context's CoreRunnables
+  /// </returns>
+  /// <remarks>
+  /// Each snapshot is taken separately under its queue's own lock.  Queues report latency histograms and
+  /// throughput only if they were instrumented with DispatchQueue::SetInstrumented.
+  /// </remarks>
+  std::vector<DispatchQueueStats> GetDispatchQueueStats(void) const;
+
+  /// <summary>
+  /// Enables or disables event instrumentation in this context and all of its descendants
+  /// </summary>
+  /// <remarks>
+  /// Contexts created after this call do not inherit the setting
+  /// </remarks>
+  void SetEventsInstrumented(bool instrumented);
+
+  /// <returns>
+  /// The instrumentation collected by every event in this context and all of its descendants, sorted by name
+  /// </returns>
+  /// <remarks>
+  /// Statistics for the same event type in different contexts are merged.  Listener timings identify the
+  /// listeners which make a synchronous fire slow.
+  /// </remarks>
+  std::vector<EventStats> GetEventStats(void);
+
+  /// <summary>
+  /// Assigns default processor affinity and scheduling settings for threads in this context
+  /// </summary>
+  /// <remarks>
+  /// The defaults are applied when a thread starts, and are inherited by child contexts which do not assign
+  /// defaults of their own.  Threads which have already started, or which have been assigned settings with
+  /// BasicThread::SetThreadScheduling, are unaffected.
+  /// </remarks>
+  void SetThreadScheduling(const ThreadScheduling& scheduling);
+
+  /// <returns>
+  /// The default scheduling settings for threads in this context, obtained from the nearest context that assigned any
+  /// </returns>
+  ThreadScheduling GetThreadScheduling(void) const;
+
   /// <returns>
   /// True if CoreRunnable instances in this context should begin teardown operations
   /// </returns>
@@ -702,7 +749,7 @@ public:
   InvokeRelay<MemFn> Invoke(MemFn memFn){
     typedef typename Decompose<MemFn>::type EventType;
 
-    if (!std::is_same<AutowiringEvents,EventType>::value)
+    if (!std::is_same<AutowiringEvents,EventType>::value && EventFiredSampler::ShouldReport<EventType>())
       GetGlobal()->Invoke(&AutowiringEvents::EventFired)(*this, typeid(EventType));
 
     return MakeInvokeRelay(GetJunctionBox<EventType>(), memFn);
@@ -1,9 +1,10 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #pragma once
+#include "Autowired.h"
 #include "ContextMember.h"
+#include "CoreJobExecutor.h"
 #include "DispatchQueue.h"
 #include "CoreRunnable.h"
-#include FUTURE_HEADER
 
 class Object;
 
@@ -26,17 +27,26 @@ private:
   // Flag, set to stop when we should stop running
   bool m_shouldStop;
 
-  // The current outstanding async in the thread pool, if one exists:
-  std::future<void> m_curEvent;
+  // An executor provided by our context, if there is one
+  Autowired<CoreJobExecutor> m_contextExecutor;
 
-  // Flag, indicating whether curEvent is in a teardown pathway.  This
-  // flag is highly stateful.
+  // The executor our bursts run on, assigned when we are started
+  std::shared_ptr<CoreJobExecutor> m_executor;
+
+  // Flag, false while a burst has been submitted to the executor and has not yet finished.  Once
+  // set, the burst no longer touches this object.
   bool m_curEventInTeardown;
 
   /// <summary>
-  /// Invokes DispatchAllEvents and safely nullifies the current event
+  /// Submits a burst to our executor, which will hold the passed outstanding pointer while it runs
+  /// </summary>
+  void SubmitBurst(std::shared_ptr<Object> outstanding);
+
+  /// <summary>
+  /// Dispatches a bounded number of events, and ends the burst if the queue is then empty
   /// </summary>
-  void DispatchAllAndClearCurrent(void);
+  /// <returns>True if events remain, in which case the burst is still in flight and must be resubmitted</returns>
+  bool DispatchBurst(void);
 
 protected:
   // DispatchQueue overrides
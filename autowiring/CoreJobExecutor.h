@@ -0,0 +1,62 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include FUNCTIONAL_HEADER
+#include MEMORY_HEADER
+
+/// <summary>
+/// A bounded pool of threads on which CoreJob instances run their bursts of work
+/// </summary>
+/// <remarks>
+/// Threads are created on demand, up to the configured maximum, and retire after they have been idle for a
+/// while.  When every thread is busy, submitted work waits in a FIFO queue.
+///
+/// By default all CoreJob instances share a single process-wide executor.  To give the jobs in a context a
+/// pool of their own, inject a CoreJobExecutor into that context (or one of its ancestors) before the context
+/// is initiated.
+///
+/// Work running on an executor should not block waiting for other work submitted to the same executor.  If
+/// every thread is blocked in this way, the executor will deadlock.
+/// </remarks>
+class CoreJobExecutor {
+public:
+  /// <param name="maxThreads">The maximum number of threads, or zero to use the default bound</param>
+  CoreJobExecutor(size_t maxThreads = 0);
+
+  /// <summary>
+  /// Releases the pool.  Work already submitted still runs, after which the threads exit.
+  /// </summary>
+  ~CoreJobExecutor(void);
+
+  /// <summary>
+  /// The default bound on the number of threads, twice the hardware concurrency, but at least eight
+  /// </summary>
+  static size_t DefaultMaxThreads(void);
+
+  /// <returns>The process-wide executor used by jobs whose context does not provide one</returns>
+  static std::shared_ptr<CoreJobExecutor> GetDefault(void);
+
+private:
+  // State shared with the pool's threads, which may outlive the executor itself
+  struct State;
+  std::shared_ptr<State> m_state;
+
+public:
+  /// <returns>The maximum number of threads this executor will create</returns>
+  size_t GetMaxThreads(void) const;
+
+  /// <summary>
+  /// Changes the maximum number of threads this executor will create
+  /// </summary>
+  /// <remarks>
+  /// Lowering the bound does not interrupt threads already running, surplus threads exit once idle
+  /// </remarks>
+  void SetMaxThreads(size_t maxThreads);
+
+  /// <returns>The number of threads currently alive in this executor</returns>
+  size_t GetThreadCount(void) const;
+
+  /// <summary>
+  /// Queues the passed function to be run on one of this executor's threads
+  /// </summary>
+  void Submit(std::function<void()>&& fn);
+};
@@ -1,12 +1,46 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #pragma once
 #include "BasicThread.h"
+#include "DispatchPoller.h"
 #include "DispatchQueue.h"
+#include FUNCTIONAL_HEADER
 #include MEMORY_HEADER
+#include STL_UNORDERED_MAP
 
 class CoreContext;
 class CoreThread;
 
+/// <summary>
+/// Describes how a CoreThread waits for work when its dispatch queue is empty
+/// </summary>
+/// <remarks>
+/// A waiting thread first busy-waits for up to spinFor, then repeatedly yields its time slice for up to
+/// yieldFor, and only then parks on its condition variable.  A thread which is spinning or yielding picks up
+/// new work without a kernel wakeup, which is much faster than a wakeup from the parked state, but consumes
+/// a core while it does so.
+///
+/// In adaptive mode, the thread keeps a running estimate of the interval between the arrival of new work
+/// and skips straight to parking while that estimate exceeds the spin and yield budget.
+/// </remarks>
+struct CoreThreadWaitStrategy {
+  CoreThreadWaitStrategy(
+    std::chrono::nanoseconds spinFor = std::chrono::nanoseconds::zero(),
+    std::chrono::nanoseconds yieldFor = std::chrono::nanoseconds::zero(),
+    bool adaptive = true
+  ) :
+    spinFor(spinFor),
+    yieldFor(yieldFor),
+    adaptive(adaptive)
+  {}
+
+  std::chrono::nanoseconds spinFor;
+  std::chrono::nanoseconds yieldFor;
+  bool adaptive;
+
+  /// <returns>True if this strategy parks immediately, which is the default</returns>
+  bool IsBlocking(void) const { return spinFor <= std::chrono::nanoseconds::zero() && yieldFor <= std::chrono::nanoseconds::zero(); }
+};
+
 /// <summary>
 /// This is an abstract class that has a single Run method for implementation by a
 /// derived class.  The object will remain in the context as long as the thread is
@@ -22,6 +56,63 @@ public:
 
   virtual ~CoreThread(void) {}
 
+private:
+  // How we wait for work, guarded by the dispatch lock
+  CoreThreadWaitStrategy m_waitStrategy;
+
+  // Running estimate of how long this thread waits for new work to arrive, used by adaptive strategies
+  std::chrono::nanoseconds m_arrivalInterval;
+
+  /// <summary>
+  /// Spins and then yields, as directed by the wait strategy, until work arrives or the budget is exhausted
+  /// </summary>
+  /// <param name="lk">A lock on the dispatch lock, which will be released while spinning</param>
+  /// <param name="wakeTime">The latest time the caller is interested in</param>
+  /// <remarks>
+  /// The caller must check the dispatch queue on return, work may or may not have arrived
+  /// </remarks>
+  void SpinUnsafe(std::unique_lock<std::mutex>& lk, std::chrono::steady_clock::time_point wakeTime);
+
+  /// <summary>
+  /// Updates the arrival interval estimate with the time the caller spent waiting for work
+  /// </summary>
+  void RecordArrivalUnsafe(std::chrono::steady_clock::time_point waitStart);
+
+  /// <summary>
+  /// A file descriptor registered with Watch
+  /// </summary>
+  struct DescriptorWatch {
+    DescriptorWatch(std::function<void(uint32_t)>&& callback) :
+      callback(std::move(callback)),
+      active(true),
+      queued(false)
+    {}
+
+    const std::function<void(uint32_t)> callback;
+
+    // Cleared by Unwatch, so that a callback which was already queued does not run
+    std::atomic<bool> active;
+
+    // Set while a call to the callback is in the dispatch queue, so level-triggered readiness is not
+    // queued more than once
+    std::atomic<bool> queued;
+  };
+
+  // The poller used in place of m_queueUpdated once a descriptor has been watched.  Created on first use
+  // and never destroyed before this thread, guarded by the dispatch lock.
+  std::unique_ptr<DispatchPoller> m_poller;
+
+  // Watched descriptors, guarded by the dispatch lock
+  std::unordered_map<int, std::shared_ptr<DescriptorWatch>> m_watches;
+
+  /// <summary>
+  /// Waits on the poller until the wake time, and queues callbacks for any descriptors that became ready
+  /// </summary>
+  /// <param name="lk">A lock on the dispatch lock, which will be released while waiting</param>
+  void PollUnsafe(std::unique_lock<std::mutex>& lk, std::chrono::steady_clock::time_point wakeTime);
+
+  void WakeExternalWaiters(void) override;
+
 protected:
   void DEPRECATED(Ready(void) const, "Do not call this method, the concept of thread readiness is now deprecated") {}
 
@@ -31,9 +122,49 @@ protected:
   virtual void DoRunLoopCleanup(std::shared_ptr<CoreContext>&& ctxt, std::shared_ptr<Object>&& refTracker) override;
 
 public:
+  /// <summary>
+  /// Changes how this thread waits for work when its dispatch queue is empty
+  /// </summary>
+  /// <remarks>
+  /// May be called at any time, and takes effect the next time the thread begins to wait
+  /// </remarks>
+  void SetWaitStrategy(const CoreThreadWaitStrategy& strategy);
+
+  /// <returns>The strategy this thread uses to wait for work</returns>
+  CoreThreadWaitStrategy GetWaitStrategy(void);
+
+  /// <summary>
+  /// Calls the specified callback on this thread's dispatch loop whenever the descriptor is ready
+  /// </summary>
+  /// <param name="events">A combination of DispatchPollEvents flags</param>
+  /// <param name="callback">Receives the DispatchPollEvents flags that were reported</param>
+  /// <returns>False if descriptor polling is not supported on this platform or the descriptor was refused</returns>
+  /// <remarks>
+  /// Once a descriptor is watched, this thread blocks in the platform's poller rather than on a condition
+  /// variable, and pended events wake it through the poller, so a single thread can service both I/O and
+  /// events without polling latency.  Readiness is level-triggered:  if the callback does not consume the
+  /// condition, it will be called again.  Watching a descriptor that is already watched replaces its
+  /// events and callback.  The caller remains responsible for the descriptor and must call Unwatch before
+  /// closing it.
+  /// </remarks>
+  bool Watch(int fd, uint32_t events, std::function<void(uint32_t)> callback);
+
+  /// <summary>
+  /// Stops watching the specified descriptor
+  /// </summary>
+  /// <returns>False if the descriptor was not being watched</returns>
+  /// <remarks>
+  /// The callback will not be called after this method returns, except by a call which is already running
+  /// </remarks>
+  bool Unwatch(int fd);
+
   /// <summary>
   /// Blocks until a new dispatch event is added, dispatches that single event, and then returns
   /// </summary>
+  /// <remarks>
+  /// If a dispatch batch size greater than one has been set with SetDispatchBatchSize, this method will
+  /// instead dispatch up to that many ready events before returning.
+  /// </remarks>
   void WaitForEvent(void);
 
   /// <summary>
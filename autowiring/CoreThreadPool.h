@@ -0,0 +1,193 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "ContextMember.h"
+#include "CoreRunnable.h"
+#include "DispatchThunk.h"
+#include "thread_specific_ptr.h"
+#include <deque>
+#include <vector>
+#include ATOMIC_HEADER
+#include CHRONO_HEADER
+#include MUTEX_HEADER
+#include MEMORY_HEADER
+
+class Object;
+
+/// <summary>
+/// A pool of worker threads which cooperatively drain pended lambdas
+/// </summary>
+/// <remarks>
+/// Lambdas pended with operator+= may be run by any worker.  Each worker has its own queue, and a worker
+/// which runs out of work will steal from the back of the others' queues.  Lambdas pended from one of the
+/// pool's own workers go to that worker's queue.
+///
+/// Lambdas pended with an affinity key are always run by the same worker, in the order they were pended,
+/// and are never stolen.  Use this to keep related work serialized without needing a lock.
+///
+/// The pool is started when its enclosing context is initiated.  A graceful stop runs every pended lambda,
+/// including lambdas pended during rundown, before the workers exit.
+/// </remarks>
+class CoreThreadPool:
+  public ContextMember,
+  public CoreRunnable
+{
+public:
+  /// <param name="nWorkers">The number of worker threads, or zero to use one per hardware thread</param>
+  CoreThreadPool(size_t nWorkers = 0, const char* name = nullptr);
+
+  /// <summary>
+  /// Releases every lambda which was never run
+  /// </summary>
+  virtual ~CoreThreadPool(void);
+
+private:
+  struct Worker {
+    Worker(CoreThreadPool* pPool, size_t index) :
+      pPool(pPool),
+      index(index),
+      parked(false)
+    {}
+
+    CoreThreadPool* const pPool;
+    const size_t index;
+
+    // Guards the two queues and the slab.  Held only briefly, never while a lambda runs.
+    std::mutex lock;
+
+    // Storage for small thunks pended to this worker
+    DispatchThunkSlab slab;
+
+    // Lambdas that may be run by any worker, and lambdas which must be run by this worker
+    std::deque<DispatchThunkBase*> shared;
+    std::deque<DispatchThunkBase*> pinned;
+
+    // True while this worker is parked, guarded by the pool's lock
+    bool parked;
+    std::condition_variable wake;
+  };
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+
+  // The worker, of any pool, that is running on the current thread
+  static autowiring::thread_specific_ptr<Worker> s_currentWorker;
+
+  // Hold on to this so CoreContext knows we still exist
+  std::shared_ptr<Object> m_outstanding;
+
+  // Guards the idle list and the run state below
+  std::mutex m_lock;
+  std::condition_variable m_stateCondition;
+
+  // Indexes of parked workers, and a count that producers can consult without taking the lock
+  std::vector<size_t> m_idle;
+  std::atomic<size_t> m_nIdle;
+
+  // Number of stealable lambdas queued, and number of lambdas either queued or running
+  std::atomic<size_t> m_nShared;
+  std::atomic<size_t> m_nPending;
+
+  // Round-robin counter used to place lambdas pended from outside of the pool
+  std::atomic<size_t> m_nextWorker;
+
+  // Number of lambdas run by a worker other than the one they were pended to
+  std::atomic<size_t> m_nSteals;
+
+  // Number of workers which have not yet exited
+  size_t m_nRunning;
+
+  bool m_running;
+  std::atomic<bool> m_shouldStop;
+  std::atomic<bool> m_aborted;
+
+  /// <returns>The worker that should receive a stealable lambda, or nullptr if the pool has been aborted</returns>
+  Worker* SelectWorker(void);
+
+  /// <returns>The worker that owns the specified affinity key, or nullptr if the pool has been aborted</returns>
+  Worker* SelectWorker(size_t affinityKey);
+
+  /// <summary>
+  /// Wakes up a parked worker to handle a lambda newly pended to the specified worker
+  /// </summary>
+  void OnPended(Worker& worker, bool pinned);
+
+  /// <summary>
+  /// Marks the specified worker as no longer parked and wakes it up
+  /// </summary>
+  /// <remarks>
+  /// m_lock must be held by the caller
+  /// </remarks>
+  void UnparkUnsafe(Worker& worker);
+
+  /// <summary>
+  /// Obtains the next lambda for the specified worker, stealing from other workers if necessary
+  /// </summary>
+  DispatchThunkBase* Take(Worker& worker);
+
+  /// <summary>
+  /// Parks the specified worker until more work arrives
+  /// </summary>
+  /// <returns>False if the worker should exit instead</returns>
+  bool Park(Worker& worker);
+
+  /// <summary>
+  /// Entry point for each worker thread
+  /// </summary>
+  void Run(Worker& worker);
+
+  template<class _Fx>
+  void Pend(Worker* pWorker, bool pinned, _Fx&& fx) {
+    if(!pWorker)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lk(pWorker->lock);
+      (pinned ? pWorker->pinned : pWorker->shared).push_back(
+        pWorker->slab.New<DispatchThunk<typename std::decay<_Fx>::type>>(std::forward<_Fx>(fx))
+      );
+      if(!pinned)
+        m_nShared++;
+      m_nPending++;
+    }
+    OnPended(*pWorker, pinned);
+  }
+
+public:
+  /// <returns>The number of worker threads in this pool</returns>
+  size_t GetWorkerCount(void) const { return m_workers.size(); }
+
+  /// <returns>The number of lambdas which are currently queued or running</returns>
+  size_t GetPendingCount(void) const { return m_nPending; }
+
+  /// <returns>The number of lambdas which were run by a worker that stole them from another worker</returns>
+  size_t GetStealCount(void) const { return m_nSteals; }
+
+  /// <summary>
+  /// Pends a lambda which may be run by any worker
+  /// </summary>
+  template<class _Fx>
+  void operator+=(_Fx&& fx) {
+    static_assert(!std::is_base_of<DispatchThunkBase, _Fx>::value, "Overload resolution malfunction, must not doubly wrap a dispatch thunk");
+    static_assert(!std::is_pointer<_Fx>::value, "Cannot pend a pointer to a function, we must have direct ownership");
+    Pend(SelectWorker(), false, std::forward<_Fx>(fx));
+  }
+
+  /// <summary>
+  /// Pends a lambda which will be run after all other lambdas pended with the same affinity key
+  /// </summary>
+  /// <remarks>
+  /// Lambdas sharing an affinity key are run one at a time, in the order they were pended.  Lambdas with
+  /// different keys may or may not share a worker.
+  /// </remarks>
+  template<class _Fx>
+  void Pend(size_t affinityKey, _Fx&& fx) {
+    Pend(SelectWorker(affinityKey), true, std::forward<_Fx>(fx));
+  }
+
+  // "CoreRunnable" overrides
+  bool Start(std::shared_ptr<Object> outstanding) override;
+  void Stop(bool graceful) override;
+  bool IsRunning(void) const override { return m_running; }
+  bool ShouldStop(void) const override { return m_shouldStop; }
+  void Wait(void) override;
+  bool WaitFor(std::chrono::nanoseconds duration);
+};
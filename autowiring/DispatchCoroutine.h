@@ -0,0 +1,274 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#pragma once
+
+// Coroutine support is only available when the compiler implements C++20 coroutines.  Everything in this
+// header, and the coroutine members of AutoPacket, compile to nothing otherwise.
+#ifndef AUTOWIRING_USE_COROUTINES
+  #if defined(__cpp_impl_coroutine) && defined(__has_include)
+    #if __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+      #define AUTOWIRING_USE_COROUTINES 1
+    #endif
+  #endif
+#endif
+#ifndef AUTOWIRING_USE_COROUTINES
+  #define AUTOWIRING_USE_COROUTINES 0
+#endif
+
+#if AUTOWIRING_USE_COROUTINES
+#include "autowiring_error.h"
+#include "DispatchQueue.h"
+#include CHRONO_HEADER
+#include MEMORY_HEADER
+#include TYPE_TRAITS_HEADER
+#include <coroutine>
+#include <exception>
+
+class DispatchCoroutine;
+
+namespace autowiring {
+  template<class T>
+  class DecorationAwaiter;
+
+  /// <summary>
+  /// State handed to the next DispatchCoroutine frame constructed on this thread
+  /// </summary>
+  /// <remarks>
+  /// Used by callers, such as the AutoFilter machinery, which need to attach state to a coroutine they are
+  /// about to start without changing its signature.
+  /// </remarks>
+  struct DispatchCoroutineInit {
+    DispatchQueue* queue;
+    std::shared_ptr<void> retained;
+  };
+
+  inline thread_local DispatchCoroutineInit* t_pCoroutineInit = nullptr;
+
+  // The exception which ended the DispatchCoroutine frame most recently destroyed on this thread, held
+  // until whoever started or resumed that frame rethrows it
+  inline thread_local std::exception_ptr t_coroutineException;
+
+  /// <summary>
+  /// Rethrows the exception left behind by a DispatchCoroutine frame which just finished on this thread
+  /// </summary>
+  inline void RethrowCoroutineException(void) {
+    if(!t_coroutineException)
+      return;
+    std::exception_ptr ex = std::move(t_coroutineException);
+    t_coroutineException = nullptr;
+    std::rethrow_exception(ex);
+  }
+}
+
+/// <summary>
+/// The return type of a fire-and-forget coroutine which runs on dispatch queues
+/// </summary>
+/// <remarks>
+/// The coroutine starts running as soon as it is called and its frame is destroyed when it finishes.  An
+/// exception which escapes the coroutine body propagates to whoever resumed it, which is usually a dispatch
+/// queue, where it is handled like an exception thrown by any other dispatched event.  If the body throws
+/// before it first suspends, the caller collects the exception with RethrowIfFailed.  Either way the frame
+/// is destroyed before the exception is rethrown, so the frame and anything it retains are never leaked.
+///
+/// A frame whose resumption is dropped, because its queue was aborted or was at its cap, is destroyed
+/// without being resumed.  Because this may happen while the queue's lock is held, destructors of objects
+/// local to the coroutine must not pend to the queue that dropped it.
+/// </remarks>
+class DispatchCoroutine {
+public:
+  class promise_type {
+  public:
+    promise_type(void) {
+      if(autowiring::DispatchCoroutineInit* pInit = autowiring::t_pCoroutineInit) {
+        autowiring::t_pCoroutineInit = nullptr;
+        queue = pInit->queue;
+        retained = std::move(pInit->retained);
+      }
+    }
+
+    // The queue this coroutine most recently resumed on, used to schedule delays
+    DispatchQueue* queue = nullptr;
+
+    // An arbitrary object which is kept alive until the coroutine finishes
+    std::shared_ptr<void> retained;
+
+    // The exception which escaped the body, if any
+    std::exception_ptr exception;
+
+    /// <summary>
+    /// Destroys the frame once the body is done, and hands any exception to the thread that ran it
+    /// </summary>
+    struct FinalAwaiter {
+      bool await_ready(void) const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<promise_type> h) const noexcept {
+        std::exception_ptr ex = std::move(h.promise().exception);
+        h.destroy();
+        if(ex)
+          autowiring::t_coroutineException = std::move(ex);
+      }
+      void await_resume(void) const noexcept {}
+    };
+
+    DispatchCoroutine get_return_object(void) noexcept { return DispatchCoroutine(); }
+    std::suspend_never initial_suspend(void) noexcept { return {}; }
+    FinalAwaiter final_suspend(void) noexcept { return {}; }
+    void return_void(void) noexcept {}
+    void unhandled_exception(void) noexcept { exception = std::current_exception(); }
+  };
+
+  DispatchCoroutine(DispatchCoroutine&& rhs) noexcept :
+    m_armed(rhs.m_armed)
+  {
+    rhs.m_armed = false;
+  }
+
+  ~DispatchCoroutine(void) {
+    if(m_armed)
+      // Not collected, and must not be mistaken for the failure of some later frame on this thread
+      autowiring::t_coroutineException = nullptr;
+  }
+
+  /// <summary>
+  /// Rethrows the exception from a body which failed before it first suspended
+  /// </summary>
+  /// <remarks>
+  /// Must be called on the returned object before anything else runs on the calling thread, as in
+  /// Fn(args).RethrowIfFailed().  A failure which is not collected this way is discarded.
+  /// </remarks>
+  void RethrowIfFailed(void) {
+    if(!m_armed)
+      return;
+    m_armed = false;
+    autowiring::RethrowCoroutineException();
+  }
+
+private:
+  DispatchCoroutine(void) :
+    m_armed(true)
+  {}
+
+  bool m_armed;
+};
+
+namespace autowiring {
+  /// <summary>
+  /// Resumes a suspended coroutine, and rethrows the exception if a DispatchCoroutine body threw
+  /// </summary>
+  template<class Promise>
+  void ResumeCoroutine(std::coroutine_handle<Promise> h) {
+    h.resume();
+    if constexpr(std::is_same<Promise, DispatchCoroutine::promise_type>::value)
+      // The frame has already destroyed itself
+      RethrowCoroutineException();
+  }
+
+  /// <summary>
+  /// A dispatch thunk which resumes a coroutine
+  /// </summary>
+  template<class Promise>
+  class CoroutineResumer {
+  public:
+    explicit CoroutineResumer(std::coroutine_handle<Promise> h) :
+      m_h(h)
+    {}
+
+    CoroutineResumer(CoroutineResumer&& rhs) :
+      m_h(rhs.m_h)
+    {
+      rhs.m_h = nullptr;
+    }
+
+    ~CoroutineResumer(void) {
+      // Dropped without being run, nobody else will ever resume a DispatchCoroutine frame
+      if constexpr(std::is_same<Promise, DispatchCoroutine::promise_type>::value)
+        if(m_h)
+          m_h.destroy();
+    }
+
+  private:
+    std::coroutine_handle<Promise> m_h;
+
+  public:
+    void operator()() {
+      auto h = m_h;
+      m_h = nullptr;
+      ResumeCoroutine(h);
+    }
+  };
+
+  /// <summary>
+  /// Awaiter which moves the awaiting coroutine onto a dispatch queue
+  /// </summary>
+  class QueueAwaiter {
+  public:
+    explicit QueueAwaiter(DispatchQueue& queue) :
+      m_queue(queue)
+    {}
+
+  private:
+    DispatchQueue& m_queue;
+
+  public:
+    bool await_ready(void) const noexcept { return false; }
+
+    template<class Promise>
+    void await_suspend(std::coroutine_handle<Promise> h) {
+      // Must be recorded before pending, the coroutine may be resumed before we return
+      if constexpr(std::is_same<Promise, DispatchCoroutine::promise_type>::value)
+        h.promise().queue = &m_queue;
+      m_queue += CoroutineResumer<Promise>(h);
+    }
+
+    void await_resume(void) const noexcept {}
+  };
+
+  /// <summary>
+  /// Awaiter which suspends a DispatchCoroutine on the delayed queue of the queue it is running on
+  /// </summary>
+  class DelayAwaiter {
+  public:
+    explicit DelayAwaiter(std::chrono::steady_clock::duration delay) :
+      m_delay(delay)
+    {}
+
+  private:
+    std::chrono::steady_clock::duration m_delay;
+
+  public:
+    bool await_ready(void) const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<DispatchCoroutine::promise_type> h) {
+      DispatchQueue* queue = h.promise().queue;
+      if(!queue)
+        throw autowiring_error("A coroutine must be running on a dispatch queue before it can await a delay");
+      queue->PendDelayed(
+        std::chrono::steady_clock::now() + m_delay,
+        CoroutineResumer<DispatchCoroutine::promise_type>(h)
+      );
+    }
+
+    void await_resume(void) const noexcept {}
+  };
+
+  /// <summary>
+  /// Suspends the awaiting DispatchCoroutine for the specified duration
+  /// </summary>
+  /// <remarks>
+  /// The coroutine resumes on the queue it was last moved to with co_await, or the queue of the object whose
+  /// coroutine AutoFilter it is.  Nothing is blocked in the meantime.
+  /// </remarks>
+  template<class Rep, class Period>
+  DelayAwaiter after(std::chrono::duration<Rep, Period> delay) {
+    return DelayAwaiter(std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay));
+  }
+}
+
+/// <summary>
+/// Allows a coroutine to continue on the specified dispatch queue with "co_await queue"
+/// </summary>
+/// <remarks>
+/// The resumption is pended like any other event and is subject to the queue's overflow policy
+/// </remarks>
+inline autowiring::QueueAwaiter operator co_await(DispatchQueue& queue) {
+  return autowiring::QueueAwaiter(queue);
+}
+#endif
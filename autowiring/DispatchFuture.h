@@ -0,0 +1,388 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "autowiring_error.h"
+#include CHRONO_HEADER
+#include FUNCTIONAL_HEADER
+#include MEMORY_HEADER
+#include MUTEX_HEADER
+#include TYPE_TRAITS_HEADER
+#include <new>
+#include <vector>
+
+template<class T>
+class DispatchFuture;
+
+namespace autowiring {
+  /// <summary>
+  /// The state shared between a DispatchFuture and the thunk which will complete it
+  /// </summary>
+  /// <remarks>
+  /// Continuations are run on whichever thread completes the state, or immediately on the thread that
+  /// registers them if the state is already complete.  They are expected to do nothing more than pend,
+  /// and must not throw.
+  /// </remarks>
+  class DispatchFutureStateBase {
+  public:
+    DispatchFutureStateBase(void) :
+      m_ready(false),
+      m_nWaiters(0)
+    {}
+
+  protected:
+    std::mutex m_lock;
+    std::condition_variable m_readyCond;
+    bool m_ready;
+    size_t m_nWaiters;
+    std::exception_ptr m_exception;
+    std::vector<std::function<void()>> m_continuations;
+
+    /// <summary>
+    /// Marks the state as ready and notifies waiters
+    /// </summary>
+    /// <param name="lk">A lock on m_lock, which will be released on return</param>
+    /// <remarks>
+    /// Continuations are left for the caller to run with RunContinuations, once it is safe for them to run
+    /// </remarks>
+    void CompleteUnsafe(std::unique_lock<std::mutex>& lk) {
+      m_ready = true;
+      if(m_nWaiters)
+        m_readyCond.notify_all();
+      lk.unlock();
+    }
+
+  public:
+    /// <summary>
+    /// Runs the continuations registered before the state was completed
+    /// </summary>
+    void RunContinuations(void) {
+      std::vector<std::function<void()>> continuations;
+      {
+        std::lock_guard<std::mutex> lk(m_lock);
+        continuations.swap(m_continuations);
+      }
+
+      for(auto& continuation : continuations)
+        continuation();
+    }
+
+    bool IsReady(void) {
+      std::lock_guard<std::mutex> lk(m_lock);
+      return m_ready;
+    }
+
+    /// <returns>The exception the state was completed with, or null if it completed normally</returns>
+    /// <remarks>
+    /// Only valid once the state is ready
+    /// </remarks>
+    const std::exception_ptr& GetException(void) const { return m_exception; }
+
+    /// <summary>
+    /// Completes the state with an exception without running continuations
+    /// </summary>
+    void StoreException(std::exception_ptr ex) {
+      std::unique_lock<std::mutex> lk(m_lock);
+      if(m_ready)
+        return;
+      m_exception = ex;
+      CompleteUnsafe(lk);
+    }
+
+    /// <summary>
+    /// Completes the state with an exception.  Has no effect if the state is already complete.
+    /// </summary>
+    void SetException(std::exception_ptr ex) {
+      StoreException(ex);
+      RunContinuations();
+    }
+
+    /// <summary>
+    /// Arranges for the passed function to be called once the state is complete
+    /// </summary>
+    void OnReady(std::function<void()>&& fn) {
+      std::unique_lock<std::mutex> lk(m_lock);
+      if(!m_ready) {
+        m_continuations.push_back(std::move(fn));
+        return;
+      }
+      lk.unlock();
+      fn();
+    }
+
+    /// <summary>
+    /// Blocks until the state is complete or the wake time arrives
+    /// </summary>
+    /// <returns>True if the state is complete</returns>
+    bool WaitUntil(std::chrono::steady_clock::time_point wakeTime) {
+      std::unique_lock<std::mutex> lk(m_lock);
+      m_nWaiters++;
+      bool ready = m_readyCond.wait_until(lk, wakeTime, [this] { return m_ready; });
+      m_nWaiters--;
+      return ready;
+    }
+
+    void Wait(void) {
+      std::unique_lock<std::mutex> lk(m_lock);
+      m_nWaiters++;
+      m_readyCond.wait(lk, [this] { return m_ready; });
+      m_nWaiters--;
+    }
+  };
+
+  template<class T>
+  class DispatchFutureState:
+    public DispatchFutureStateBase
+  {
+  public:
+    ~DispatchFutureState(void) {
+      if(m_ready && !m_exception)
+        reinterpret_cast<T*>(&m_value)->~T();
+    }
+
+  private:
+    // Constructed in place when the state completes normally, so that T need not be default-constructible
+    typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type m_value;
+
+  public:
+    /// <summary>
+    /// Completes the state with a value without running continuations
+    /// </summary>
+    template<class U>
+    void StoreValue(U&& value) {
+      std::unique_lock<std::mutex> lk(m_lock);
+      if(m_ready)
+        return;
+      new (&m_value) T(std::forward<U>(value));
+      CompleteUnsafe(lk);
+    }
+
+    /// <summary>
+    /// Completes the state with a value.  Has no effect if the state is already complete.
+    /// </summary>
+    template<class U>
+    void SetValue(U&& value) {
+      StoreValue(std::forward<U>(value));
+      RunContinuations();
+    }
+
+    /// <summary>
+    /// The value the state was completed with
+    /// </summary>
+    /// <remarks>
+    /// Only valid once the state is ready and GetException returns null
+    /// </remarks>
+    const T& GetValue(void) const { return *reinterpret_cast<const T*>(&m_value); }
+  };
+
+  template<>
+  class DispatchFutureState<void>:
+    public DispatchFutureStateBase
+  {
+  public:
+    void StoreValue(void) {
+      std::unique_lock<std::mutex> lk(m_lock);
+      if(m_ready)
+        return;
+      CompleteUnsafe(lk);
+    }
+
+    void SetValue(void) {
+      StoreValue();
+      RunContinuations();
+    }
+
+    void GetValue(void) const {}
+  };
+
+  /// <summary>
+  /// Calls a function with the value of a completed state, or with no arguments for a void state
+  /// </summary>
+  template<class T>
+  struct DispatchFutureApply {
+    template<class Fn>
+    static auto Call(Fn& fn, const DispatchFutureState<T>& state) -> decltype(fn(state.GetValue())) {
+      return fn(state.GetValue());
+    }
+  };
+
+  template<>
+  struct DispatchFutureApply<void> {
+    template<class Fn>
+    static auto Call(Fn& fn, const DispatchFutureState<void>&) -> decltype(fn()) {
+      return fn();
+    }
+  };
+
+  /// <summary>
+  /// Completes a state with the result of a call, or with the exception the call threw
+  /// </summary>
+  /// <remarks>
+  /// Continuations run outside of the try block, so that nothing they do is mistaken for a failure of
+  /// the call itself.
+  /// </remarks>
+  template<class R>
+  struct DispatchFutureComplete {
+    template<class Fn>
+    static void Call(DispatchFutureState<R>& state, Fn&& fn) {
+      try {
+        state.StoreValue(fn());
+      }
+      catch(...) {
+        state.StoreException(std::current_exception());
+      }
+      state.RunContinuations();
+    }
+  };
+
+  template<>
+  struct DispatchFutureComplete<void> {
+    template<class Fn>
+    static void Call(DispatchFutureState<void>& state, Fn&& fn) {
+      try {
+        fn();
+        state.StoreValue();
+      }
+      catch(...) {
+        state.StoreException(std::current_exception());
+      }
+      state.RunContinuations();
+    }
+  };
+
+  /// <summary>
+  /// The callable pended to a dispatch queue on behalf of a future
+  /// </summary>
+  /// <remarks>
+  /// If the task is destroyed without being run, which happens when its queue drops it or is aborted, the
+  /// future is completed with dispatch_aborted_exception so that nothing waits on it forever.
+  /// </remarks>
+  template<class R, class Fn>
+  class DispatchFutureTask {
+  public:
+    DispatchFutureTask(const std::shared_ptr<DispatchFutureState<R>>& state, Fn&& fn) :
+      m_state(state),
+      m_fn(std::move(fn))
+    {}
+
+    DispatchFutureTask(const std::shared_ptr<DispatchFutureState<R>>& state, const Fn& fn) :
+      m_state(state),
+      m_fn(fn)
+    {}
+
+    DispatchFutureTask(DispatchFutureTask&& rhs) :
+      m_state(std::move(rhs.m_state)),
+      m_fn(std::move(rhs.m_fn))
+    {}
+
+    ~DispatchFutureTask(void) {
+      if(m_state)
+        m_state->SetException(std::make_exception_ptr(dispatch_aborted_exception()));
+    }
+
+  private:
+    std::shared_ptr<DispatchFutureState<R>> m_state;
+    Fn m_fn;
+
+  public:
+    /// <summary>
+    /// Detaches this task from its future, which the caller must now complete some other way
+    /// </summary>
+    void Abandon(void) { m_state.reset(); }
+
+    void operator()() {
+      auto state = std::move(m_state);
+      DispatchFutureComplete<R>::Call(*state, m_fn);
+    }
+  };
+}
+
+/// <summary>
+/// A handle to a value that will be produced by a thunk running on some dispatch queue
+/// </summary>
+/// <remarks>
+/// Obtain one from DispatchQueue::Async.  Rather than blocking a thread on the result, attach a continuation
+/// with Then, which will be pended to a queue of your choosing once the value is ready; a request and its
+/// response between two threads then costs two pends.  Copies of a future refer to the same result.
+/// </remarks>
+template<class T>
+class DispatchFuture {
+public:
+  DispatchFuture(void) {}
+
+  explicit DispatchFuture(const std::shared_ptr<autowiring::DispatchFutureState<T>>& state) :
+    m_state(state)
+  {}
+
+private:
+  std::shared_ptr<autowiring::DispatchFutureState<T>> m_state;
+
+public:
+  /// <returns>True if this future refers to a result</returns>
+  bool IsValid(void) const { return !!m_state; }
+
+  /// <returns>True if the result, or the exception thrown in place of it, is available</returns>
+  bool IsReady(void) const { return m_state->IsReady(); }
+
+  /// <summary>
+  /// Pends the passed function to the specified queue once this future is ready
+  /// </summary>
+  /// <param name="queue">The dispatch queue where fn will run, which must outlive this future's completion</param>
+  /// <param name="fn">Called with a const reference to the value, or with no arguments for DispatchFuture&lt;void&gt;</param>
+  /// <returns>A future for the value returned by fn</returns>
+  /// <remarks>
+  /// If this future completes with an exception, fn is not called and the exception is passed along to the
+  /// returned future.  So is any exception thrown while pending fn.  The continuation is pended when this future completes, so no thread waits in between.
+  /// </remarks>
+  template<class Queue, class Fn>
+  DispatchFuture<typename std::decay<decltype(autowiring::DispatchFutureApply<T>::Call(std::declval<Fn&>(), std::declval<const autowiring::DispatchFutureState<T>&>()))>::type>
+  Then(Queue& queue, Fn&& fn) const {
+    typedef typename std::decay<decltype(autowiring::DispatchFutureApply<T>::Call(std::declval<Fn&>(), std::declval<const autowiring::DispatchFutureState<T>&>()))>::type R;
+    typedef typename std::decay<Fn>::type t_fn;
+
+    auto next = std::make_shared<autowiring::DispatchFutureState<R>>();
+    auto state = m_state;
+    t_fn continuation(std::forward<Fn>(fn));
+    Queue* pQueue = &queue;
+    m_state->OnReady([pQueue, state, next, continuation] {
+      if(state->GetException()) {
+        next->SetException(state->GetException());
+        return;
+      }
+
+      auto call = [state, continuation] () mutable {
+        return autowiring::DispatchFutureApply<T>::Call(continuation, *state);
+      };
+      autowiring::DispatchFutureTask<R, decltype(call)> task(next, std::move(call));
+      try {
+        *pQueue += std::move(task);
+      }
+      catch(...) {
+        // Could not pend, the continuation's own future takes the blame so the others still run
+        task.Abandon();
+        next->SetException(std::current_exception());
+      }
+    });
+    return DispatchFuture<R>(next);
+  }
+
+  /// <summary>
+  /// Blocks until the result is available, then returns it or rethrows the exception that replaced it
+  /// </summary>
+  /// <remarks>
+  /// Provided for interoperation with code that is not itself running on a dispatch queue.  Prefer Then.
+  /// </remarks>
+  typename std::add_lvalue_reference<const T>::type Get(void) const {
+    m_state->Wait();
+    if(m_state->GetException())
+      std::rethrow_exception(m_state->GetException());
+    return m_state->GetValue();
+  }
+
+  /// <summary>
+  /// Blocks until the result is available or the timeout elapses
+  /// </summary>
+  /// <returns>True if the result is available</returns>
+  template<class Rep, class Period>
+  bool WaitFor(std::chrono::duration<Rep, Period> timeout) const {
+    return m_state->WaitUntil(std::chrono::steady_clock::now() + timeout);
+  }
+};
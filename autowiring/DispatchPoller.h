@@ -0,0 +1,63 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include CHRONO_HEADER
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/// <summary>
+/// Readiness conditions which may be requested of, and reported by, a DispatchPoller
+/// </summary>
+/// <remarks>
+/// Error and hangup conditions are always reported, whether or not they were requested
+/// </remarks>
+enum DispatchPollEvents : uint32_t {
+  DispatchPollReadable = 1 << 0,
+  DispatchPollWritable = 1 << 1,
+  DispatchPollError = 1 << 2,
+  DispatchPollHangup = 1 << 3
+};
+
+/// <summary>
+/// Waits for a set of file descriptors to become ready, and may be woken up early from any thread
+/// </summary>
+/// <remarks>
+/// This is the blocking point used by a CoreThread which is watching file descriptors.  Descriptors are
+/// level-triggered:  a descriptor which is still ready is reported again by the next call to Wait.
+/// </remarks>
+class DispatchPoller {
+public:
+  virtual ~DispatchPoller(void) {}
+
+  /// <summary>
+  /// Creates a poller for the current platform
+  /// </summary>
+  /// <returns>The new poller, or nullptr if descriptor polling is not supported on this platform</returns>
+  static DispatchPoller* New(void);
+
+  /// <summary>
+  /// Starts watching the specified descriptor, or changes the conditions watched on it
+  /// </summary>
+  /// <param name="events">A combination of DispatchPollEvents flags</param>
+  /// <returns>False if the descriptor could not be watched</returns>
+  virtual bool Add(int fd, uint32_t events) = 0;
+
+  /// <summary>
+  /// Stops watching the specified descriptor
+  /// </summary>
+  virtual bool Remove(int fd) = 0;
+
+  /// <summary>
+  /// Blocks until a descriptor is ready, Wake is called, or the wake time arrives
+  /// </summary>
+  /// <param name="ready">Receives each ready descriptor along with its DispatchPollEvents flags</param>
+  /// <remarks>
+  /// A wake time in the past polls without blocking.  Spurious returns are permitted.
+  /// </remarks>
+  virtual void Wait(std::chrono::steady_clock::time_point wakeTime, std::vector<std::pair<int, uint32_t>>& ready) = 0;
+
+  /// <summary>
+  /// Causes a current or subsequent call to Wait to return immediately
+  /// </summary>
+  virtual void Wake(void) = 0;
+};
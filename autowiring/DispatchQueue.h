@@ -1,8 +1,14 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #pragma once
+#include "autowiring_error.h"
+#include "DispatchFuture.h"
+#include "DispatchQueueStats.h"
 #include "DispatchThunk.h"
-#include <list>
-#include <queue>
+#include "DispatchTimerWheel.h"
+#include <algorithm>
+#include <deque>
+#include STL_UNORDERED_MAP
+#include ATOMIC_HEADER
 #include MUTEX_HEADER
 #include RVALUE_HEADER
 #include MEMORY_HEADER
@@ -10,11 +16,79 @@
 class DispatchQueue;
 
 /// <summary>
-/// Thrown when a dispatch operation was aborted
+/// Determines what a dispatch queue does with a new event when its dispatcher cap has been reached
 /// </summary>
-class dispatch_aborted_exception:
-  public std::exception
-{};
+enum class DispatchOverflowPolicy {
+  // The new event is destroyed without being run, and counted as dropped
+  RejectNewest,
+
+  // The oldest ready event is destroyed without being run, counted as evicted, and the new event is pended
+  EvictOldest,
+
+  // The producer blocks until there is room in the queue, or until the configured timeout elapses, after
+  // which the new event is dropped
+  Block,
+
+  // Keyed events are always admitted, because their number is bounded by the number of distinct keys
+  // rather than by the event rate.  Events pended without a key are dropped as with RejectNewest.
+  Coalesce
+};
+
+/// <summary>
+/// A lightweight reference to a delayed dispatch thunk which has not yet become ready
+/// </summary>
+/// <remarks>
+/// Handles are cheap to copy and may be discarded freely; discarding a handle does not cancel its timer.
+/// A handle must not be used after the dispatch queue that issued it has been destroyed.
+/// </remarks>
+class DispatchTimerHandle {
+public:
+  DispatchTimerHandle(void) :
+    m_pQueue(nullptr)
+  {}
+
+  DispatchTimerHandle(DispatchQueue* pQueue, DispatchTimerId id) :
+    m_pQueue(pQueue),
+    m_id(id)
+  {}
+
+private:
+  DispatchQueue* m_pQueue;
+  DispatchTimerId m_id;
+
+public:
+  /// <returns>The timer's identifier in its queue's timing wheel</returns>
+  DispatchTimerId GetId(void) const { return m_id; }
+
+  /// <returns>True if the timer has not yet been promoted to the dispatch queue, or cancelled</returns>
+  bool IsPending(void) const;
+
+  /// <summary>
+  /// Cancels the timer, destroying its thunk without calling it
+  /// </summary>
+  /// <returns>True if the timer was cancelled, false if it had already become ready or been cancelled</returns>
+  /// <remarks>
+  /// Calls which were already promoted to the dispatch queue by a periodic timer will still be made
+  /// </remarks>
+  bool Cancel(void);
+
+  /// <summary>
+  /// Moves the timer's next deadline to the specified time
+  /// </summary>
+  /// <returns>True if the timer was rescheduled, false if it had already become ready or been cancelled</returns>
+  /// <remarks>
+  /// For a periodic timer, all subsequent deadlines are computed from the new deadline
+  /// </remarks>
+  bool Reschedule(std::chrono::steady_clock::time_point readyAt);
+
+  /// <summary>
+  /// Moves the timer's next deadline to the specified interval from now
+  /// </summary>
+  template<class Rep, class Period>
+  bool Reschedule(std::chrono::duration<Rep, Period> delay) {
+    return Reschedule(std::chrono::steady_clock::now() + delay);
+  }
+};
 
 /// <summary>
 /// This is an asynchronous queue of zero-argument functions
@@ -36,22 +110,269 @@ public:
   virtual ~DispatchQueue(void);
 
 protected:
-  // The maximum allowed number of pended dispatches before pended calls start getting dropped
+  // The maximum allowed number of pended dispatches before the overflow policy is applied
   size_t m_dispatchCap;
 
+  // What to do when the cap is reached, and how long a producer will wait under the Block policy
+  DispatchOverflowPolicy m_overflowPolicy;
+  std::chrono::nanoseconds m_overflowTimeout;
+
+  // Counts of events discarded because of the dispatcher cap
+  size_t m_nDropped;
+  size_t m_nEvicted;
+
+  // The number of keyed events which replaced an earlier event with the same key
+  size_t m_nCoalesced;
+
+  // The maximum number of ready events that a single wait will dispatch under one lock acquisition
+  size_t m_dispatchBatchSize;
+
+  // Storage for thunks small enough to be held without a heap allocation.  This must be declared before
+  // any of the collections that refer to it so that it is destroyed last.
+  DispatchThunkSlab m_slab;
+
   // The dispatch queue proper:
-  std::list<DispatchThunkBase*> m_dispatchQueue;
+  std::deque<DispatchThunkBase*> m_dispatchQueue;
 
-  // Priority queue of non-ready events:
-  std::priority_queue<DispatchThunkDelayed> m_delayedQueue;
+  // Non-ready events, keyed by the time they will become ready:
+  DispatchTimerWheel m_timers;
+
+  /// <summary>
+  /// Occupies a position in the dispatch queue on behalf of whichever thunk was most recently pended under a key
+  /// </summary>
+  /// <remarks>
+  /// The held thunk may be swapped out, under the dispatch lock, at any point until this thunk is run.  This is
+  /// true even after the thunk has been detached from the queue for dispatch, because the held thunk has still
+  /// not been executed at that point.
+  /// </remarks>
+  class KeyedThunk:
+    public DispatchThunkBase
+  {
+  public:
+    KeyedThunk(DispatchQueue& queue, size_t key, DispatchThunkBase* pThunk) :
+      m_queue(queue),
+      m_key(key),
+      m_pThunk(pThunk)
+    {}
+
+    ~KeyedThunk(void) {
+      if(m_pThunk)
+        m_pThunk->Release();
+    }
+
+    DispatchQueue& m_queue;
+    const size_t m_key;
+    DispatchThunkBase* m_pThunk;
+
+    void operator()(void) override;
+  };
+
+  // Keyed thunks which have not yet been run, by key
+  std::unordered_map<size_t, KeyedThunk*> m_keyed;
+
+  /// <summary>
+  /// Instrumentation accumulated while the queue is instrumented
+  /// </summary>
+  /// <remarks>
+  /// Counters other than the histograms and nDispatched are only updated under the dispatch lock
+  /// </remarks>
+  struct StatsBlock {
+    StatsBlock(void) :
+      nPended(0),
+      maxDepth(0),
+      nDispatched(0),
+      elapsed(0)
+    {}
+
+    uint64_t nPended;
+    size_t maxDepth;
+    std::atomic<uint64_t> nDispatched;
+
+    // Time instrumentation was last enabled, and the total time it was enabled before that
+    std::chrono::steady_clock::time_point enabledAt;
+    std::chrono::nanoseconds elapsed;
+
+    DispatchLatencyRecorder queueDelay;
+    DispatchLatencyRecorder execTime;
+  };
+
+  // Allocated the first time instrumentation is enabled and kept until the queue is destroyed, so that
+  // dispatchers which picked it up before instrumentation was disabled may continue to use it.
+  std::unique_ptr<StatsBlock> m_statsBlock;
+
+  // Equal to m_statsBlock while instrumentation is enabled, and null otherwise
+  StatsBlock* m_stats;
+
+  /// <summary>
+  /// Appends a thunk to the dispatch queue, recording its ready time if the queue is instrumented
+  /// </summary>
+  /// <remarks>
+  /// The dispatch lock must be held by the caller
+  /// </remarks>
+  void PushReadyUnsafe(DispatchThunkBase* thunk) {
+    m_dispatchQueue.push_back(thunk);
+    if(m_stats)
+      RecordReadyUnsafe(thunk, std::chrono::steady_clock::now());
+  }
+
+  /// <summary>
+  /// Records that the specified thunk, already in the dispatch queue, became ready at the specified time
+  /// </summary>
+  void RecordReadyUnsafe(DispatchThunkBase* thunk, std::chrono::steady_clock::time_point now) {
+    thunk->m_readyAt = now;
+    m_stats->nPended++;
+    m_stats->maxDepth = std::max(m_stats->maxDepth, m_dispatchQueue.size());
+  }
+
+  /// <summary>
+  /// Runs a thunk which has been detached from the dispatch queue, recording its latency if stats is non-null
+  /// </summary>
+  /// <param name="stats">The value of m_stats at the time the thunk was detached</param>
+  static void Invoke(DispatchThunkBase& thunk, StatsBlock* stats);
 
   // A lock held when the dispatch queue must be updated:
   std::mutex m_dispatchLock;
 
-  // Notice when the dispatch queue has been updated:
+  // Notice when work becomes available in the dispatch queue.  Only signalled if a consumer is parked.
   std::condition_variable m_queueUpdated;
 
-  bool m_aborted;
+  // Notice when the dispatch queue has been emptied or its owner has stopped.  Only signalled if someone
+  // is waiting for this to happen.
+  std::condition_variable m_queueDrained;
+
+  // Notice when room has been made in a queue that was at its cap.  Only signalled if a producer is blocked.
+  std::condition_variable m_spaceAvailable;
+
+  // The number of callers presently blocked on each of the above condition variables
+  size_t m_nWorkWaiters;
+  size_t m_nDrainWaiters;
+  size_t m_nSpaceWaiters;
+
+  // The number of consumers parked somewhere other than m_queueUpdated, such as in a descriptor poller.
+  // These are woken with WakeExternalWaiters.
+  size_t m_nExternalWaiters;
+
+  // The number of times a producer has had to signal a parked consumer.  Only written under the lock, but
+  // atomic so that GetWakeupCount can read it without one.
+  std::atomic<size_t> m_nWakeups;
+
+  // The number of consumers presently spinning for work without holding the lock, and the flag that
+  // producers raise to tell them that work has arrived.  Producers only touch the flag if someone is spinning.
+  size_t m_nSpinners;
+  std::atomic<bool> m_spinSignal;
+
+  // The earliest time at which any parked consumer plans to wake up on its own
+  std::chrono::steady_clock::time_point m_parkedUntil;
+
+  /// <summary>
+  /// RAII type which counts a caller as a waiter on one of the dispatch queue's condition variables
+  /// </summary>
+  /// <remarks>
+  /// Must only be constructed and destroyed while the dispatch lock is held.  Producers consult these
+  /// counts to decide whether a notification is needed at all.
+  /// </remarks>
+  struct WaiterCount {
+    WaiterCount(size_t& count) :
+      count(count)
+    {
+      count++;
+    }
+
+    ~WaiterCount(void) {
+      count--;
+    }
+
+    size_t& count;
+  };
+
+  /// <summary>
+  /// RAII type which counts a caller as a consumer parked waiting for work until at most the specified time
+  /// </summary>
+  /// <remarks>
+  /// Producers of delayed events use the recorded time to decide whether parked consumers must be woken
+  /// up to shorten their timeouts.  Must only be constructed and destroyed while the dispatch lock is held.
+  /// </remarks>
+  struct WorkWaiter:
+    WaiterCount
+  {
+    WorkWaiter(DispatchQueue& queue, std::chrono::steady_clock::time_point wakeTime, bool external = false) :
+      WaiterCount(external ? queue.m_nExternalWaiters : queue.m_nWorkWaiters),
+      queue(queue)
+    {
+      queue.m_parkedUntil = std::min(queue.m_parkedUntil, wakeTime);
+    }
+
+    ~WorkWaiter(void) {
+      if(queue.m_nWorkWaiters + queue.m_nExternalWaiters == 1)
+        // Last one out, nobody is parked any longer
+        queue.m_parkedUntil = std::chrono::steady_clock::time_point::max();
+    }
+
+    DispatchQueue& queue;
+  };
+
+  /// <summary>
+  /// Wakes up one consumer, if any consumer is parked waiting for work, and alerts any spinning consumers
+  /// </summary>
+  /// <remarks>
+  /// The dispatch lock must be held by the caller
+  /// </remarks>
+  void SignalWorkAvailableUnsafe(void) {
+    if(m_nSpinners)
+      m_spinSignal.store(true, std::memory_order_release);
+    if(m_nWorkWaiters) {
+      m_nWakeups.fetch_add(1, std::memory_order_relaxed);
+      m_queueUpdated.notify_one();
+    }
+    else if(m_nExternalWaiters) {
+      m_nWakeups.fetch_add(1, std::memory_order_relaxed);
+      WakeExternalWaiters();
+    }
+  }
+
+  /// <summary>
+  /// Wakes up all callers waiting for the queue to drain or stop
+  /// </summary>
+  /// <remarks>
+  /// The dispatch lock must be held by the caller
+  /// </remarks>
+  void SignalDrainedUnsafe(void) {
+    if(m_nDrainWaiters)
+      m_queueDrained.notify_all();
+  }
+
+  /// <summary>
+  /// Wakes up producers blocked by the Block overflow policy, if there are any
+  /// </summary>
+  /// <remarks>
+  /// The dispatch lock must be held by the caller
+  /// </remarks>
+  void SignalSpaceAvailableUnsafe(void) {
+    if(m_nSpaceWaiters)
+      m_spaceAvailable.notify_all();
+  }
+
+  /// <summary>
+  /// Applies the overflow policy, if necessary, to make room for a single new event
+  /// </summary>
+  /// <param name="lk">A lock on m_dispatchLock, which may be released and reacquired under the Block policy</param>
+  /// <param name="keyed">True if the new event is being pended under a key</param>
+  /// <returns>True if the new event may be pended, false if it must be dropped</returns>
+  /// <remarks>
+  /// A false return has already been counted as a drop, the caller need only dispose of the event
+  /// </remarks>
+  bool AdmitUnsafe(std::unique_lock<std::mutex>& lk, bool keyed = false);
+
+  /// <summary>
+  /// Destroys a thunk that was removed from the dispatch queue without being run
+  /// </summary>
+  /// <remarks>
+  /// The dispatch lock must be held by the caller
+  /// </remarks>
+  void ReleaseUnsafe(DispatchThunkBase* thunk);
+
+  // Set once Abort has been called.  Atomic because batches poll this flag without holding the lock.
+  std::atomic<bool> m_aborted;
 
   /// <summary>
   /// Recommends a point in time to wake up to check for events
@@ -61,8 +382,43 @@ protected:
   /// <summary>
   /// Moves all ready events from the delayed queue into the dispatch queue
   /// </summary>
+  /// <remarks>
+  /// Promoted events are not subject to the dispatch cap, they were admitted when they were pended
+  /// </remarks>
   void PromoteReadyEventsUnsafe(void);
 
+  /// <summary>
+  /// Cancels the specified timer, see DispatchTimerHandle::Cancel
+  /// </summary>
+  bool CancelTimer(DispatchTimerId id);
+
+  /// <summary>
+  /// Reschedules the specified timer, see DispatchTimerHandle::Reschedule
+  /// </summary>
+  bool RescheduleTimer(DispatchTimerId id, std::chrono::steady_clock::time_point readyAt);
+
+  /// <returns>True if the specified timer is still pending</returns>
+  bool IsTimerPending(DispatchTimerId id);
+
+  /// <summary>
+  /// Wakes up parked consumers if any of them would otherwise sleep past the specified ready time
+  /// </summary>
+  /// <remarks>
+  /// The dispatch lock must be held by the caller
+  /// </remarks>
+  void SignalTimerUpdatedUnsafe(std::chrono::steady_clock::time_point readyAt) {
+    if(readyAt < m_parkedUntil && m_dispatchQueue.empty() && (m_nWorkWaiters || m_nExternalWaiters)) {
+      // Every parked consumer has to recompute its timeout, so this is one of the rare cases where
+      // we wake everyone.
+      m_nWakeups.fetch_add(1, std::memory_order_relaxed);
+      m_queueUpdated.notify_all();
+      if(m_nExternalWaiters)
+        WakeExternalWaiters();
+    }
+  }
+
+  friend class DispatchTimerHandle;
+
   /// <summary>
   /// Similar to DispatchEvent, except assumes that the dispatch lock is currently held
   /// </summary>
@@ -73,6 +429,38 @@ protected:
   /// </remarks>
   void DispatchEventUnsafe(std::unique_lock<std::mutex>& lk);
 
+  /// <summary>
+  /// Detaches up to maxEvents ready thunks while the dispatch lock is held, then runs them back-to-back
+  /// </summary>
+  /// <param name="lk">A lock on m_dispatchLock, which will be released on return</param>
+  /// <param name="pnDispatched">If set, receives the number of thunks run, including one which threw</param>
+  /// <returns>The number of thunks that were dispatched</returns>
+  /// <remarks>
+  /// If the queue is aborted while the batch is running, the remainder of the batch is destroyed without
+  /// being run.  If a thunk throws, the thunks following it in the batch are returned to the front of the
+  /// queue in their original order and the exception is propagated to the caller.
+  /// </remarks>
+  size_t DispatchBatchUnsafe(std::unique_lock<std::mutex>& lk, size_t maxEvents, size_t* pnDispatched = nullptr);
+
+  /// <summary>
+  /// Invoked just before a batch of thunks is run
+  /// </summary>
+  /// <param name="nEvents">The number of thunks in the batch</param>
+  /// <remarks>
+  /// This method is called without the dispatch lock held, from the thread that is dispatching the batch
+  /// </remarks>
+  virtual void OnBatchBegin(size_t nEvents) {}
+
+  /// <summary>
+  /// Invoked after a batch of thunks has been run, including if the batch was cut short
+  /// </summary>
+  /// <param name="nDispatched">The number of thunks from the batch which were actually run</param>
+  /// <remarks>
+  /// Subclasses may use this method to perform work that is only needed once per batch, such as flushing
+  /// output that was accumulated by the individual thunks.
+  /// </remarks>
+  virtual void OnBatchEnd(size_t nDispatched) {}
+
   /// <summary>
   /// Utility virtual, called whenever a new event is deferred
   /// </summary>
@@ -83,18 +471,38 @@ protected:
   /// </remarks>
   virtual void OnPended(std::unique_lock<std::mutex>&& lk) {}
 
+  /// <summary>
+  /// Wakes up consumers which have parked somewhere other than the dispatch queue's condition variable
+  /// </summary>
+  /// <remarks>
+  /// Subclasses which park consumers with an external WorkWaiter must override this method.  It is called
+  /// with the dispatch lock held, and only when at least one such consumer is parked.
+  /// </remarks>
+  virtual void WakeExternalWaiters(void) {}
+
   /// <summary>
   /// Attaches an element to the end of the dispatch queue without any checks.
   /// </summary>
   template<class _Fx>
   void Pend(_Fx&& fx) {
     std::unique_lock<std::mutex> lk(m_dispatchLock);
-    m_dispatchQueue.push_back(new DispatchThunk<_Fx>(fx));
-    m_queueUpdated.notify_all();
+    PushReadyUnsafe(NewThunkUnsafe(std::forward<_Fx>(fx)));
+    SignalWorkAvailableUnsafe();
 
     OnPended(std::move(lk));
   }
 
+  /// <summary>
+  /// Wraps the passed callable in a dispatch thunk, using this queue's slab where possible
+  /// </summary>
+  /// <remarks>
+  /// The dispatch lock must be held by the caller
+  /// </remarks>
+  template<class _Fx>
+  DispatchThunkBase* NewThunkUnsafe(_Fx&& fx) {
+    return m_slab.New<DispatchThunk<typename std::decay<_Fx>::type>>(std::forward<_Fx>(fx));
+  }
+
 public:
   /// <returns>
   /// True if there are curerntly any dispatchers ready for execution--IE, DispatchEvent would return true
@@ -104,7 +512,53 @@ public:
   /// <returns>
   /// The total number of all ready and delayed events
   /// </returns>
-  size_t GetDispatchQueueLength(void) const {return m_dispatchQueue.size() + m_delayedQueue.size();}
+  size_t GetDispatchQueueLength(void) const {return m_dispatchQueue.size() + m_timers.Size();}
+
+  /// <returns>
+  /// The number of events which were discarded, rather than pended, because the dispatcher cap had been reached
+  /// </returns>
+  size_t GetDroppedCount(void) const { return m_nDropped; }
+
+  /// <returns>
+  /// The number of pended events which were discarded to make room for newer ones under the EvictOldest policy
+  /// </returns>
+  size_t GetEvictedCount(void) const { return m_nEvicted; }
+
+  /// <returns>
+  /// The number of keyed events which replaced a not-yet-executed event with the same key
+  /// </returns>
+  size_t GetCoalescedCount(void) const { return m_nCoalesced; }
+
+  /// <summary>
+  /// Enables or disables the collection of latency histograms and throughput for this queue
+  /// </summary>
+  /// <remarks>
+  /// Instrumentation is disabled by default.  While enabled, each event is timestamped when it becomes ready
+  /// and timed when it is run.  Disabling instrumentation retains everything collected so far, and enabling
+  /// it again resumes accumulation.  Events which became ready while instrumentation was disabled do not
+  /// contribute a queueing delay sample.
+  /// </remarks>
+  void SetInstrumented(bool instrumented);
+
+  /// <returns>True if this queue is collecting instrumentation</returns>
+  bool IsInstrumented(void) const { return m_stats != nullptr; }
+
+  /// <summary>
+  /// Takes a consistent snapshot of this queue's depth, overflow counters, and instrumentation
+  /// </summary>
+  /// <remarks>
+  /// Unlike GetDispatchQueueLength, this method acquires the dispatch lock
+  /// </remarks>
+  DispatchQueueStats GetStats(void);
+
+  /// <returns>
+  /// The number of times a producer found a consumer parked on this queue and had to wake it up
+  /// </returns>
+  /// <remarks>
+  /// Pends which arrive while the consumer is busy do not signal it.  On a busy queue this value will be much
+  /// smaller than the total number of events pended.
+  /// </remarks>
+  size_t GetWakeupCount(void) const { return m_nWakeups.load(std::memory_order_relaxed); }
 
   /// <summary>
   /// Causes the current dispatch queue to be dumped if it's non-empty
@@ -120,26 +574,73 @@ public:
   /// </remarks>
   void Abort(void);
 
+  /// <returns>The granularity with which the ready times of delayed events are tracked</returns>
+  std::chrono::steady_clock::duration GetTimerResolution(void);
+
+  /// <summary>
+  /// Changes the granularity with which the ready times of delayed events are tracked
+  /// </summary>
+  /// <returns>False if there are delayed events outstanding, in which case the resolution is unchanged</returns>
+  /// <remarks>
+  /// The default resolution is one millisecond.  Delayed events are never dispatched before their ready
+  /// time, but may be dispatched up to one tick after it.
+  /// </remarks>
+  bool SetTimerResolution(std::chrono::steady_clock::duration resolution);
+
 protected:
   /// <summary>
   /// Updates the upper bound on the number of allowed pending dispatchers
   /// </summary>
   void SetDispatcherCap(size_t dispatchCap) { m_dispatchCap = dispatchCap; }
 
+  /// <summary>
+  /// Sets the action taken when an event is pended to a queue which has reached its dispatcher cap
+  /// </summary>
+  /// <param name="timeout">The longest a producer will wait for room under the Block policy</param>
+  /// <remarks>
+  /// The default policy is RejectNewest.  Delayed events are admitted when they are pended and are not
+  /// subject to the cap.  A consumer must never pend to its own queue under the Block policy; it would wait
+  /// for itself until the timeout elapses.
+  /// </remarks>
+  void SetOverflowPolicy(DispatchOverflowPolicy policy, std::chrono::nanoseconds timeout = std::chrono::nanoseconds::zero()) {
+    std::lock_guard<std::mutex> lk(m_dispatchLock);
+    m_overflowPolicy = policy;
+    m_overflowTimeout = timeout;
+  }
+
+  /// <summary>
+  /// Sets the number of ready events which will be dispatched per lock acquisition by waiting routines
+  /// </summary>
+  /// <remarks>
+  /// The default batch size is 1, which causes each wait to dispatch exactly one event.  Larger values
+  /// reduce lock traffic on busy queues at the cost of each wait call potentially running several events.
+  /// </remarks>
+  void SetDispatchBatchSize(size_t dispatchBatchSize) { m_dispatchBatchSize = dispatchBatchSize ? dispatchBatchSize : 1; }
+
   /// <summary>
   /// Similar to WaitForEvent, but does not block
   /// </summary>
   /// <returns>True if an event was dispatched, false if the queue was empty when checked</returns>
   bool DispatchEvent(void);
 
+  /// <summary>
+  /// Dispatches up to the specified number of ready events under a single lock acquisition
+  /// </summary>
+  /// <returns>The number of events dispatched, zero if the queue was empty when checked</returns>
+  size_t DispatchBatch(size_t maxEvents = ~size_t(0));
+
   /// <summary>
   /// Similar to DispatchEvent, but will attempt to dispatch all events currently queued
   /// </summary>
   /// <returns>The total number of events dispatched</returns>
+  /// <remarks>
+  /// Events are detached from the queue in batches, so the dispatch lock is acquired once for every
+  /// group of events that were ready at the same time rather than once per event.
+  /// </remarks>
   int DispatchAllEvents(void) {
     int retVal = 0;
-    while(DispatchEvent())
-      retVal++;
+    while(size_t nDispatched = DispatchBatch())
+      retVal += (int)nDispatched;
     return retVal;
   }
 
@@ -147,14 +648,80 @@ public:
   /// <summary>
   /// Explicit overload for already-constructed dispatch thunk types
   /// </summary>
+  /// <remarks>
+  /// The queue takes ownership of the passed thunk, and will release it if it cannot be pended
+  /// </remarks>
   void AddExisting(DispatchThunkBase* pBase) {
     std::unique_lock<std::mutex> lk(m_dispatchLock);
-    if(m_dispatchQueue.size() >= m_dispatchCap)
+    if(!AdmitUnsafe(lk)) {
+      lk.unlock();
+      pBase->Release();
       return;
+    }
+
+    PushReadyUnsafe(pBase);
+    SignalWorkAvailableUnsafe();
+    OnPended(std::move(lk));
+  }
+
+  /// <summary>
+  /// Constructs a thunk of the specified type directly in this queue's storage and pends it
+  /// </summary>
+  /// <remarks>
+  /// This is the preferred alternative to AddExisting, because small thunks constructed in this way do not
+  /// require a heap allocation.  The thunk is not constructed if the overflow policy drops it.
+  /// </remarks>
+  template<class T, class... Args>
+  void Emplace(Args&&... args) {
+    std::unique_lock<std::mutex> lk(m_dispatchLock);
+    if(!AdmitUnsafe(lk))
+      return;
+
+    PushReadyUnsafe(m_slab.New<T>(std::forward<Args>(args)...));
+    SignalWorkAvailableUnsafe();
+    OnPended(std::move(lk));
+  }
+
+  /// <summary>
+  /// Pends a callable under the specified key, replacing any not-yet-executed callable pended with the same key
+  /// </summary>
+  /// <returns>True if an earlier callable was replaced, false if the callable was newly pended or dropped</returns>
+  /// <remarks>
+  /// A replacement takes the queue position of the callable it replaces, and the replaced callable is destroyed
+  /// without being run.  Keys share a single namespace per queue; callers pending unrelated work to the same
+  /// queue must take care that their keys do not collide.  Replacements never grow the queue and so are not
+  /// subject to the overflow policy.
+  /// </remarks>
+  template<class _Fx>
+  bool PendKeyed(size_t key, _Fx&& fx) {
+    // Declared ahead of the lock so that a replaced thunk is destroyed after the lock is released
+    std::unique_ptr<DispatchThunkBase, DispatchThunkReleaser> replaced;
+    std::unique_lock<std::mutex> lk(m_dispatchLock);
 
-    m_dispatchQueue.push_back(pBase);
-    m_queueUpdated.notify_all();
+    auto q = m_keyed.find(key);
+    if(q == m_keyed.end()) {
+      if(!AdmitUnsafe(lk, true))
+        return false;
+
+      // The lock may have been released while we waited for room, look again
+      q = m_keyed.find(key);
+    }
+
+    if(q != m_keyed.end()) {
+      replaced.reset(q->second->m_pThunk);
+      q->second->m_pThunk = NewThunkUnsafe(std::forward<_Fx>(fx));
+      m_nCoalesced++;
+      return true;
+    }
+
+    std::unique_ptr<DispatchThunkBase, DispatchThunkReleaser> thunk(NewThunkUnsafe(std::forward<_Fx>(fx)));
+    KeyedThunk* pKeyed = static_cast<KeyedThunk*>(m_slab.New<KeyedThunk>(*this, key, thunk.get()));
+    thunk.release();
+    m_keyed[key] = pKeyed;
+    PushReadyUnsafe(pKeyed);
+    SignalWorkAvailableUnsafe();
     OnPended(std::move(lk));
+    return false;
   }
 
   class DispatchThunkDelayedExpression {
@@ -170,12 +737,9 @@ public:
 
   public:
     template<class _Fx>
-    void operator,(_Fx&& fx) {
-      // Let the parent handle this one directly after composing a delayed dispatch thunk r-value
-      *m_pParent += DispatchThunkDelayed(
-        m_wakeup,
-        new DispatchThunk<_Fx>(std::forward<_Fx>(fx))
-      );
+    DispatchTimerHandle operator,(_Fx&& fx) {
+      // Let the parent handle this one directly, the thunk has to be constructed under its lock
+      return m_pParent->PendDelayed(m_wakeup, std::forward<_Fx>(fx));
     }
   };
 
@@ -202,23 +766,68 @@ public:
     return DispatchThunkDelayedExpression(this, rhs);
   }
 
+  /// <summary>
+  /// Constructs a thunk from the passed callable and pends it to the delayed queue
+  /// </summary>
+  /// <returns>A handle which may be used to cancel the thunk before it becomes ready</returns>
+  template<class _Fx>
+  DispatchTimerHandle PendDelayed(std::chrono::steady_clock::time_point readyAt, _Fx&& fx) {
+    std::lock_guard<std::mutex> lk(m_dispatchLock);
+    return PendDelayedUnsafe(readyAt, NewThunkUnsafe(std::forward<_Fx>(fx)));
+  }
+
   /// <summary>
   /// Directly pends a delayed dispatch thunk
   /// </summary>
   /// <remarks>
   /// This overload will always succeed and does not consult the dispatch cap
   /// </remarks>
-  void operator+=(DispatchThunkDelayed&& rhs) {
+  DispatchTimerHandle operator+=(DispatchThunkDelayed&& rhs) {
     std::lock_guard<std::mutex> lk(m_dispatchLock);
+    return PendDelayedUnsafe(rhs.GetReadyTime(), rhs.Get());
+  }
 
-    m_delayedQueue.push(std::forward<DispatchThunkDelayed>(rhs));
-    if(
-      m_delayedQueue.top().GetReadyTime() == rhs.GetReadyTime() &&
-      m_dispatchQueue.empty()
-    )
-      // We're becoming the new next-to-execute entity, dispatch queue currently empty, trigger wakeup
-      // so our newly pended delay thunk is eventually processed.
-      m_queueUpdated.notify_all();
+private:
+  DispatchTimerHandle PendDelayedUnsafe(std::chrono::steady_clock::time_point readyAt, DispatchThunkBase* thunk) {
+    DispatchTimerId id = m_timers.Add(readyAt, thunk);
+    SignalTimerUpdatedUnsafe(readyAt);
+    return DispatchTimerHandle(this, id);
+  }
+
+public:
+  /// <summary>
+  /// Pends a callable which will be dispatched at the specified time, and then at every period after that time
+  /// </summary>
+  /// <param name="policy">Determines what happens if the queue falls behind and deadlines are missed</param>
+  /// <param name="maxCatchUp">The most missed deadlines dispatched at once under the CatchUp policy</param>
+  /// <returns>A handle which may be used to cancel or reschedule the timer</returns>
+  /// <remarks>
+  /// Deadlines are absolute: each one is computed by adding the period to the previous deadline, so time spent
+  /// waiting for or running the callable does not cause the schedule to drift.  A periodic timer stays pending
+  /// until it is cancelled or the queue is destroyed.  The dispatch cap is not consulted, so maxCatchUp is what
+  /// bounds the number of calls a single timer can add to the queue when it becomes ready.
+  /// </remarks>
+  template<class _Fx>
+  DispatchTimerHandle PendPeriodic(std::chrono::steady_clock::time_point readyAt, std::chrono::steady_clock::duration period, _Fx&& fx, DispatchTimerPolicy policy = DispatchTimerPolicy::CatchUp, uint32_t maxCatchUp = DispatchTimerWheel::c_defaultMaxCatchUp) {
+    std::lock_guard<std::mutex> lk(m_dispatchLock);
+    std::shared_ptr<DispatchThunkBase> target(NewThunkUnsafe(std::forward<_Fx>(fx)), DispatchThunkReleaser());
+    DispatchTimerId id = m_timers.AddPeriodic(
+      readyAt,
+      period,
+      policy,
+      static_cast<DispatchThunkPeriodic*>(m_slab.New<DispatchThunkPeriodic>(target)),
+      maxCatchUp
+    );
+    SignalTimerUpdatedUnsafe(readyAt);
+    return DispatchTimerHandle(this, id);
+  }
+
+  /// <summary>
+  /// Pends a callable which will be dispatched once every period, starting one period from now
+  /// </summary>
+  template<class _Fx>
+  DispatchTimerHandle PendPeriodic(std::chrono::steady_clock::duration period, _Fx&& fx, DispatchTimerPolicy policy = DispatchTimerPolicy::CatchUp, uint32_t maxCatchUp = DispatchTimerWheel::c_defaultMaxCatchUp) {
+    return PendPeriodic(std::chrono::steady_clock::now() + period, period, std::forward<_Fx>(fx), policy, maxCatchUp);
   }
 
   /// <summary>
@@ -230,12 +839,28 @@ public:
     static_assert(!std::is_pointer<_Fx>::value, "Cannot pend a pointer to a function, we must have direct ownership");
 
     std::unique_lock<std::mutex> lk(m_dispatchLock);
-    if(m_dispatchQueue.size() >= m_dispatchCap)
+    if(!AdmitUnsafe(lk))
       return;
 
-    m_dispatchQueue.push_back(new DispatchThunk<_Fx>(std::forward<_Fx>(fx)));
-    m_queueUpdated.notify_all();
+    PushReadyUnsafe(NewThunkUnsafe(std::forward<_Fx>(fx)));
+    SignalWorkAvailableUnsafe();
     OnPended(std::move(lk));
   }
+
+  /// <summary>
+  /// Pends a callable and returns a future for the value it will return
+  /// </summary>
+  /// <remarks>
+  /// The callable is subject to the overflow policy like any other event.  If it is dropped, or the queue is
+  /// aborted before it runs, the future completes with dispatch_aborted_exception.  An exception thrown by the
+  /// callable is captured in the future rather than propagated to this queue's dispatcher.
+  /// </remarks>
+  template<class _Fx>
+  DispatchFuture<typename std::decay<decltype(std::declval<_Fx&>()())>::type> Async(_Fx&& fx) {
+    typedef typename std::decay<decltype(std::declval<_Fx&>()())>::type R;
+    auto state = std::make_shared<autowiring::DispatchFutureState<R>>();
+    *this += autowiring::DispatchFutureTask<R, typename std::decay<_Fx>::type>(state, std::forward<_Fx>(fx));
+    return DispatchFuture<R>(state);
+  }
 };
 
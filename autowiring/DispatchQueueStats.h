@@ -0,0 +1,169 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include <algorithm>
+#include ARRAY_HEADER
+#include ATOMIC_HEADER
+#include CHRONO_HEADER
+#include <cstdint>
+#include <string>
+
+/// <summary>
+/// A point-in-time copy of a latency histogram with power-of-two nanosecond buckets
+/// </summary>
+/// <remarks>
+/// Bucket zero counts samples under one nanosecond, and bucket i counts samples in [2^(i-1), 2^i) nanoseconds.
+/// </remarks>
+struct DispatchLatencyHistogram {
+  static const size_t c_nBuckets = 48;
+
+  DispatchLatencyHistogram(void) :
+    count(0),
+    total(0),
+    max(0)
+  {
+    buckets.fill(0);
+  }
+
+  std::array<uint64_t, c_nBuckets> buckets;
+
+  // Number of samples, and the sum and maximum of all samples
+  uint64_t count;
+  std::chrono::nanoseconds total;
+  std::chrono::nanoseconds max;
+
+  /// <returns>The index of the bucket that counts samples of the specified duration</returns>
+  static size_t BucketOf(std::chrono::nanoseconds sample) {
+    uint64_t ns = sample.count() > 0 ? (uint64_t)sample.count() : 0;
+    size_t i = 0;
+    while(ns && i < c_nBuckets - 1) {
+      ns >>= 1;
+      i++;
+    }
+    return i;
+  }
+
+  /// <returns>The exclusive upper bound of the specified bucket</returns>
+  static std::chrono::nanoseconds UpperBoundOf(size_t bucket) {
+    return std::chrono::nanoseconds(int64_t(1) << bucket);
+  }
+
+  /// <summary>
+  /// Adds the samples in another histogram to this one
+  /// </summary>
+  void Merge(const DispatchLatencyHistogram& rhs) {
+    for(size_t i = 0; i < c_nBuckets; i++)
+      buckets[i] += rhs.buckets[i];
+    count += rhs.count;
+    total += rhs.total;
+    max = std::max(max, rhs.max);
+  }
+
+  /// <returns>The mean of all samples, or zero if there are none</returns>
+  std::chrono::nanoseconds Mean(void) const {
+    return count ? total / (int64_t)count : std::chrono::nanoseconds::zero();
+  }
+
+  /// <returns>
+  /// An upper bound on the specified fraction of samples, accurate to within a factor of two
+  /// </returns>
+  std::chrono::nanoseconds Percentile(double fraction) const {
+    uint64_t threshold = (uint64_t)(fraction * count);
+    uint64_t seen = 0;
+    for(size_t i = 0; i < c_nBuckets; i++) {
+      seen += buckets[i];
+      if(seen > threshold)
+        return std::min(UpperBoundOf(i), max);
+    }
+    return max;
+  }
+};
+
+/// <summary>
+/// A snapshot of the instrumentation collected by a dispatch queue
+/// </summary>
+struct DispatchQueueStats {
+  DispatchQueueStats(void) :
+    instrumented(false),
+    depth(0),
+    maxDepth(0),
+    nPended(0),
+    nDispatched(0),
+    nDropped(0),
+    nEvicted(0),
+    nCoalesced(0),
+    elapsed(0)
+  {}
+
+  // The name or type of the queue's owner.  Only filled in by CoreContext::GetDispatchQueueStats.
+  std::string name;
+
+  // True if the queue is currently collecting instrumentation
+  bool instrumented;
+
+  // Number of ready events at the time of the snapshot, and the most that were ever ready at once
+  size_t depth;
+  size_t maxDepth;
+
+  // Events that entered the ready queue, and events which were run, while instrumentation was enabled
+  uint64_t nPended;
+  uint64_t nDispatched;
+
+  // Cumulative overflow accounting, collected whether or not instrumentation is enabled
+  size_t nDropped;
+  size_t nEvicted;
+  size_t nCoalesced;
+
+  // Time during which instrumentation has been enabled
+  std::chrono::nanoseconds elapsed;
+
+  // Time from an event becoming ready to the start of its execution, and the time spent executing it
+  DispatchLatencyHistogram queueDelay;
+  DispatchLatencyHistogram execTime;
+
+  /// <returns>The number of events dispatched per second while instrumentation was enabled</returns>
+  double Throughput(void) const {
+    return elapsed.count() ? nDispatched * 1e9 / elapsed.count() : 0.0;
+  }
+};
+
+/// <summary>
+/// Accumulator for a DispatchLatencyHistogram, which may be updated concurrently without a lock
+/// </summary>
+class DispatchLatencyRecorder {
+public:
+  DispatchLatencyRecorder(void) :
+    m_count(0),
+    m_total(0),
+    m_max(0)
+  {
+    for(auto& bucket : m_buckets)
+      bucket = 0;
+  }
+
+private:
+  std::atomic<uint64_t> m_buckets[DispatchLatencyHistogram::c_nBuckets];
+  std::atomic<uint64_t> m_count;
+  std::atomic<int64_t> m_total;
+  std::atomic<int64_t> m_max;
+
+public:
+  void Record(std::chrono::nanoseconds sample) {
+    m_buckets[DispatchLatencyHistogram::BucketOf(sample)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(sample.count(), std::memory_order_relaxed);
+
+    int64_t prior = m_max.load(std::memory_order_relaxed);
+    while(prior < sample.count() && !m_max.compare_exchange_weak(prior, sample.count(), std::memory_order_relaxed));
+  }
+
+  /// <summary>
+  /// Copies out the histogram.  Samples recorded concurrently may or may not be included.
+  /// </summary>
+  void CopyTo(DispatchLatencyHistogram& histogram) const {
+    for(size_t i = 0; i < DispatchLatencyHistogram::c_nBuckets; i++)
+      histogram.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    histogram.count = m_count.load(std::memory_order_relaxed);
+    histogram.total = std::chrono::nanoseconds(m_total.load(std::memory_order_relaxed));
+    histogram.max = std::chrono::nanoseconds(m_max.load(std::memory_order_relaxed));
+  }
+};
@@ -1,15 +1,66 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #pragma once
+#include <cstddef>
+#include MEMORY_HEADER
+#include <vector>
+#include ATOMIC_HEADER
 #include CHRONO_HEADER
+#include TYPE_TRAITS_HEADER
 #include UTILITY_HEADER
 
+class DispatchThunkSlab;
+
+/// <summary>
+/// The largest callable, in bytes, which will be stored in a dispatch queue's slab rather than on the heap
+/// </summary>
+/// <remarks>
+/// Lambdas whose captures exceed this size are still accepted, but will incur one heap allocation per
+/// pend.  This value may be overridden at build time if a project routinely pends large captures.
+/// </remarks>
+#ifndef AUTOWIRING_DISPATCH_INLINE_SIZE
+#define AUTOWIRING_DISPATCH_INLINE_SIZE 64
+#endif
+
 /// <summary>
 /// A simple virtual class used to hold a trivial thunk
 /// </summary>
 class DispatchThunkBase {
 public:
+  DispatchThunkBase(void) :
+    m_pSlab(nullptr)
+  {}
+
   virtual ~DispatchThunkBase(void){}
   virtual void operator()() = 0;
+
+private:
+  friend class DispatchThunkSlab;
+  friend class DispatchQueue;
+
+  // The slab where this thunk's storage was obtained, or nullptr if the thunk is on the heap
+  DispatchThunkSlab* m_pSlab;
+
+  // The time at which this thunk became ready, only recorded while its queue is instrumented
+  std::chrono::steady_clock::time_point m_readyAt;
+
+public:
+  /// <summary>
+  /// Destroys this thunk and returns its storage to wherever it was obtained
+  /// </summary>
+  /// <remarks>
+  /// Thunks must always be destroyed through this method rather than by a direct call to delete,
+  /// because the thunk may be resident in a dispatch queue's slab.
+  /// </remarks>
+  void Release(void);
+};
+
+/// <summary>
+/// Deleter type, allows a DispatchThunkBase to be held in a unique_ptr
+/// </summary>
+struct DispatchThunkReleaser {
+  void operator()(DispatchThunkBase* pThunk) const {
+    pThunk->Release();
+  }
 };
 
 template<class _Fx>
@@ -21,6 +72,10 @@ public:
     m_fx(fx)
   {}
 
+  DispatchThunk(_Fx&& fx) :
+    m_fx(std::move(fx))
+  {}
+
   _Fx m_fx;
 
   void operator()() override {
@@ -28,6 +83,100 @@ public:
   }
 };
 
+/// <summary>
+/// A fixed-block allocator used by a dispatch queue to hold small thunks without going to the heap
+/// </summary>
+/// <remarks>
+/// Allocation is only permitted while the owning dispatch queue's lock is held.  Blocks may be returned from
+/// any thread without a lock; returned blocks are collected on a lock-free stack and are reclaimed wholesale
+/// the next time the allocator runs out of free blocks.  Storage is only released when the slab is destroyed.
+/// </remarks>
+class DispatchThunkSlab {
+public:
+  DispatchThunkSlab(void);
+  ~DispatchThunkSlab(void);
+
+  // Total size of a single block, large enough for a DispatchThunk holding an inline-sized callable
+  static const size_t c_blockSize = sizeof(DispatchThunkBase) + AUTOWIRING_DISPATCH_INLINE_SIZE;
+
+  // Number of blocks obtained from the heap whenever the slab has to grow
+  static const size_t c_blocksPerChunk = 32;
+
+private:
+  struct Block {
+    Block* pFlink;
+  };
+
+  typedef std::aligned_storage<c_blockSize, std::alignment_of<std::max_align_t>::value>::type t_storage;
+
+  // Blocks which are ready to be handed out.  Only accessed under the dispatch lock.
+  Block* m_pFree;
+
+  // Blocks which have been returned by consumers, but not yet reclaimed
+  std::atomic<Block*> m_pReturned;
+
+  // All chunks ever obtained by this slab:
+  std::vector<std::unique_ptr<t_storage[]>> m_chunks;
+
+  /// <summary>
+  /// Obtains a single block, growing the slab if necessary
+  /// </summary>
+  void* Allocate(void);
+
+  /// <summary>
+  /// Returns a block to the pool of returned blocks
+  /// </summary>
+  void Free(void* pBlock);
+
+  // Thunks free themselves:
+  friend class DispatchThunkBase;
+
+public:
+  /// <returns>The total number of blocks owned by this slab</returns>
+  size_t GetCapacity(void) const { return m_chunks.size() * c_blocksPerChunk; }
+
+  /// <summary>
+  /// Constructs a new thunk of type T, on the slab if possible and on the heap otherwise
+  /// </summary>
+  /// <remarks>
+  /// The caller must be holding the dispatch lock of the queue that owns this slab
+  /// </remarks>
+  template<class T, class... Args>
+  DispatchThunkBase* New(Args&&... args) {
+    static_assert(std::is_base_of<DispatchThunkBase, T>::value, "Only dispatch thunks may be allocated on a dispatch slab");
+
+    if(
+      sizeof(T) > c_blockSize ||
+      std::alignment_of<T>::value > std::alignment_of<std::max_align_t>::value
+    )
+      // Too big to be held inline, defer to the heap
+      return new T(std::forward<Args>(args)...);
+
+    void* pBlock = Allocate();
+    T* retVal;
+    try {
+      retVal = new (pBlock) T(std::forward<Args>(args)...);
+    }
+    catch(...) {
+      Free(pBlock);
+      throw;
+    }
+    retVal->m_pSlab = this;
+    return retVal;
+  }
+};
+
+inline void DispatchThunkBase::Release(void) {
+  DispatchThunkSlab* pSlab = m_pSlab;
+  if(!pSlab) {
+    delete this;
+    return;
+  }
+
+  this->~DispatchThunkBase();
+  pSlab->Free(this);
+}
+
 /// <summary>
 /// A so-called "delayed" dispatch thunk which must not be executed prior to the specified time
 /// </summary>
@@ -60,7 +209,7 @@ public:
   // Little bit of a hack to support non-C++11
   void Reset(void) {
     if(m_thunk)
-      delete m_thunk;
+      m_thunk->Release();
   }
 
 private:
@@ -0,0 +1,332 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "DispatchThunk.h"
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <vector>
+#include CHRONO_HEADER
+#include MEMORY_HEADER
+
+/// <summary>
+/// Identifies a single timer in a DispatchTimerWheel
+/// </summary>
+/// <remarks>
+/// The generation field guards against reuse of a timer's storage: once a timer has fired or been
+/// cancelled, any identifier referring to it becomes permanently stale.
+/// </remarks>
+struct DispatchTimerId {
+  DispatchTimerId(void) :
+    index(~uint32_t(0)),
+    generation(0)
+  {}
+
+  DispatchTimerId(uint32_t index, uint32_t generation) :
+    index(index),
+    generation(generation)
+  {}
+
+  uint32_t index;
+  uint32_t generation;
+
+  bool IsValid(void) const { return index != ~uint32_t(0); }
+};
+
+/// <summary>
+/// Determines what a periodic timer does when one or more of its deadlines were missed
+/// </summary>
+enum class DispatchTimerPolicy {
+  // Missed deadlines are dispatched, back-to-back, so the total number of calls matches the amount of
+  // time elapsed.  At most a bounded number of calls are made at once, see DispatchTimerWheel::AddPeriodic;
+  // deadlines missed beyond that bound are dropped as they would be under Skip.
+  CatchUp,
+
+  // Missed deadlines are dropped, the timer is dispatched once and then resumes on the next deadline
+  // that has not yet elapsed
+  Skip
+};
+
+/// <summary>
+/// Thunk type used by periodic timers
+/// </summary>
+/// <remarks>
+/// A periodic timer holds one of these as a prototype.  Every time the timer becomes ready, a copy of the
+/// prototype is dispatched; all copies share a single instance of the user's callable.
+/// </remarks>
+class DispatchThunkPeriodic:
+  public DispatchThunkBase
+{
+public:
+  DispatchThunkPeriodic(const std::shared_ptr<DispatchThunkBase>& target) :
+    m_target(target)
+  {}
+
+  std::shared_ptr<DispatchThunkBase> m_target;
+
+  void operator()() override {
+    (*m_target)();
+  }
+};
+
+/// <summary>
+/// A hierarchical timing wheel used by DispatchQueue to hold delayed thunks
+/// </summary>
+/// <remarks>
+/// Insertion and removal are constant time.  Deadlines are rounded up to the wheel's resolution, so a
+/// timer will never be reported ready early, but may be reported up to one tick late.  The wheel spans
+/// 2^26 ticks, which is a little over 18 hours at the default one millisecond resolution; timers
+/// further out than that are held in a binary heap and moved into the wheel as they approach.
+///
+/// This class is not synchronized, the owning DispatchQueue's lock must be held for all calls.
+/// </remarks>
+class DispatchTimerWheel {
+public:
+  /// <param name="pSlab">Optional storage for the thunks dispatched by periodic timers</param>
+  DispatchTimerWheel(DispatchThunkSlab* pSlab = nullptr, std::chrono::steady_clock::duration resolution = std::chrono::milliseconds(1));
+
+  /// <summary>
+  /// Releases every thunk still held by the wheel without calling any of them
+  /// </summary>
+  ~DispatchTimerWheel(void);
+
+  static const uint32_t c_npos = ~uint32_t(0);
+
+  // Number of bits of the tick counter resolved by each level of the wheel
+  static const int c_levelBits[];
+  static const int c_nLevels = 4;
+
+  // The default bound on the number of missed deadlines a CatchUp timer will dispatch at once
+  static const uint32_t c_defaultMaxCatchUp = 16;
+
+private:
+  // Sentinel "level" values used to indicate where an entry currently lives
+  enum : int8_t {
+    // Entry is not in use
+    Free = -1,
+
+    // Entry is already due, and will be reported by the next call to PromoteReady
+    Due = -2,
+
+    // Entry is too far in the future for the wheel and is in the overflow heap
+    Overflow = -3
+  };
+
+  struct Entry {
+    Entry(void) :
+      thunk(nullptr),
+      period(std::chrono::steady_clock::duration::zero()),
+      policy(DispatchTimerPolicy::CatchUp),
+      maxCatchUp(1),
+      generation(0),
+      prev(c_npos),
+      next(c_npos),
+      level(Free),
+      slot(0)
+    {}
+
+    // The time at which this timer becomes ready, and its rounded-up tick counterpart
+    std::chrono::steady_clock::time_point readyAt;
+    uint64_t tick;
+
+    // Order of insertion, used to keep timers with identical ready times in FIFO order
+    uint64_t sequence;
+
+    // The thunk to be released into the dispatch queue once the timer becomes ready.  For periodic timers,
+    // this is the prototype from which each dispatched thunk is copied.
+    DispatchThunkBase* thunk;
+
+    // The interval between deadlines of a periodic timer, or zero for a one-shot timer
+    std::chrono::steady_clock::duration period;
+    DispatchTimerPolicy policy;
+
+    // The most thunks a CatchUp timer will dispatch at once
+    uint32_t maxCatchUp;
+
+    // Incremented every time the entry is released
+    uint32_t generation;
+
+    // Links in the list for this entry's slot, or the next free entry if this entry is free
+    uint32_t prev;
+    uint32_t next;
+
+    // Current location of this entry
+    int8_t level;
+    uint8_t slot;
+  };
+
+  struct OverflowEntry {
+    std::chrono::steady_clock::time_point readyAt;
+    DispatchTimerId id;
+
+    bool operator<(const OverflowEntry& rhs) const {
+      return rhs.readyAt < readyAt;
+    }
+  };
+
+  // Slab used to allocate periodic thunks, may be null
+  DispatchThunkSlab* const m_pSlab;
+
+  // Duration of a single tick, and the time of tick zero
+  std::chrono::steady_clock::duration m_resolution;
+  std::chrono::steady_clock::time_point m_epoch;
+
+  // The last tick that has been fully processed
+  uint64_t m_now;
+
+  // Storage for all timers, and the head of the free list in that storage
+  std::vector<Entry> m_entries;
+  uint32_t m_freeHead;
+  uint64_t m_nextSequence;
+
+  // Slot list heads, one array per level, and the number of entries resident in each level
+  std::vector<uint32_t> m_slots[c_nLevels];
+  size_t m_levelCount[c_nLevels];
+
+  // Timers which became due at the time they were added, or were found to be due by a cascade
+  uint32_t m_dueHead;
+  size_t m_dueCount;
+
+  // Timers too distant to fit in the wheel:
+  std::priority_queue<OverflowEntry> m_overflow;
+  size_t m_overflowCount;
+
+  // Scratch space used while collecting ready timers, retained to avoid reallocation
+  std::vector<uint32_t> m_ready;
+
+  /// <returns>The first tick at or after the specified time</returns>
+  uint64_t TickOf(std::chrono::steady_clock::time_point readyAt) const;
+
+  /// <returns>The time at which the specified tick begins</returns>
+  std::chrono::steady_clock::time_point TimeOf(uint64_t tick) const;
+
+  /// <returns>True if the specified identifier refers to a pending timer</returns>
+  bool IsPending(DispatchTimerId id) const;
+
+  /// <summary>
+  /// Places the specified entry in the wheel, the due list, or the overflow heap, as appropriate
+  /// </summary>
+  void Place(uint32_t index);
+
+  /// <summary>
+  /// Unlinks the specified entry from the wheel or the due list and updates the appropriate count
+  /// </summary>
+  void Unlink(uint32_t index);
+
+  /// <summary>
+  /// Pushes the specified entry onto the front of the specified list
+  /// </summary>
+  void Link(uint32_t& head, uint32_t index);
+
+  /// <summary>
+  /// Removes all entries from the specified list, and places them again relative to the current tick
+  /// </summary>
+  void Cascade(uint32_t& head);
+
+  /// <summary>
+  /// Moves the current tick directly to the specified tick, re-placing every entry in the wheel
+  /// </summary>
+  /// <remarks>
+  /// Used when the wheel has fallen far enough behind that stepping through each tick would be more
+  /// expensive than redistributing its contents.
+  /// </remarks>
+  void Rebase(uint64_t tick);
+
+  /// <summary>
+  /// Moves overflow timers that are now within the span of the wheel into the wheel
+  /// </summary>
+  void MigrateOverflow(void);
+
+  /// <summary>
+  /// Moves the contents of the specified list into m_ready
+  /// </summary>
+  void Collect(uint32_t& head);
+
+  /// <summary>
+  /// Returns an entry to the free list and invalidates any identifiers referring to it
+  /// </summary>
+  void FreeEntry(uint32_t index);
+
+  /// <summary>
+  /// Allocates a new entry and places it in the wheel
+  /// </summary>
+  DispatchTimerId NewEntry(std::chrono::steady_clock::time_point readyAt, DispatchThunkBase* thunk, std::chrono::steady_clock::duration period, DispatchTimerPolicy policy, uint32_t maxCatchUp);
+
+  /// <summary>
+  /// Dispatches the periodic timer at the specified index and places it again at its next deadline after now
+  /// </summary>
+  void Repeat(uint32_t index, std::chrono::steady_clock::time_point now, std::deque<DispatchThunkBase*>& ready);
+
+public:
+  /// <returns>True if no timers are pending</returns>
+  bool Empty(void) const { return !Size(); }
+
+  /// <returns>The number of timers pending</returns>
+  size_t Size(void) const;
+
+  /// <returns>The duration of a single tick of the wheel</returns>
+  std::chrono::steady_clock::duration GetResolution(void) const { return m_resolution; }
+
+  /// <summary>
+  /// Changes the duration of a single tick of the wheel
+  /// </summary>
+  /// <returns>False if timers are pending, in which case the resolution is not changed</returns>
+  bool SetResolution(std::chrono::steady_clock::duration resolution);
+
+  /// <summary>
+  /// Adds a new timer which will release the specified thunk once the ready time has elapsed
+  /// </summary>
+  DispatchTimerId Add(std::chrono::steady_clock::time_point readyAt, DispatchThunkBase* thunk);
+
+  /// <summary>
+  /// Adds a new timer which will release a copy of the specified thunk at the ready time and at every period after that
+  /// </summary>
+  /// <remarks>
+  /// Deadlines are computed from the first ready time rather than from the time of each dispatch, so the timer does
+  /// not drift.  The period must be positive.
+  ///
+  /// Under the CatchUp policy, no more than maxCatchUp thunks are dispatched for a single promotion, however far
+  /// behind the timer has fallen.  Any further missed deadlines are skipped, and the timer resumes on the next
+  /// deadline that has not yet elapsed.  This keeps a stalled queue from being flooded once it resumes.
+  /// </remarks>
+  DispatchTimerId AddPeriodic(std::chrono::steady_clock::time_point readyAt, std::chrono::steady_clock::duration period, DispatchTimerPolicy policy, DispatchThunkPeriodic* thunk, uint32_t maxCatchUp = c_defaultMaxCatchUp);
+
+  /// <summary>
+  /// Moves the next deadline of the specified timer
+  /// </summary>
+  /// <returns>False if the timer is no longer pending</returns>
+  /// <remarks>
+  /// Subsequent deadlines of a periodic timer are computed from the new deadline
+  /// </remarks>
+  bool Reschedule(DispatchTimerId id, std::chrono::steady_clock::time_point readyAt);
+
+  /// <summary>
+  /// Cancels the specified timer
+  /// </summary>
+  /// <returns>The timer's thunk, which the caller must release, or nullptr if the timer is no longer pending</returns>
+  DispatchThunkBase* Remove(DispatchTimerId id);
+
+  /// <returns>
+  /// The ready time of the specified timer, or time_point::max if the timer is no longer pending
+  /// </returns>
+  std::chrono::steady_clock::time_point GetReadyTime(DispatchTimerId id) const;
+
+  /// <summary>
+  /// Moves every thunk whose timer has elapsed as of the specified time to the back of the passed queue
+  /// </summary>
+  /// <returns>The number of thunks moved</returns>
+  /// <remarks>
+  /// Thunks are appended in order of their ready times.  Periodic timers contribute one thunk for each
+  /// deadline that is being dispatched and remain pending.
+  /// </remarks>
+  size_t PromoteReady(std::chrono::steady_clock::time_point now, std::deque<DispatchThunkBase*>& ready);
+
+  /// <returns>
+  /// A time at or before which PromoteReady will report the soonest pending timer, or time_point::max if no timers
+  /// are pending
+  /// </returns>
+  /// <remarks>
+  /// The returned value may be earlier than the true deadline when the soonest timer is still in an upper level
+  /// of the wheel.  Callers should treat this as the latest time they may sleep before calling PromoteReady.
+  /// </remarks>
+  std::chrono::steady_clock::time_point NextWakeup(void) const;
+};
@@ -0,0 +1,124 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include ATOMIC_HEADER
+#include <cstddef>
+#include <cstdint>
+#include <typeinfo>
+#include <vector>
+
+/// <summary>
+/// The number of times an event type was fired
+/// </summary>
+struct EventFiredCount {
+  const std::type_info* type;
+  uint64_t nFired;
+};
+
+/// <summary>
+/// Decides which event fires are reported through AutowiringEvents::EventFired
+/// </summary>
+/// <remarks>
+/// Reporting is disabled by default, in which case firing an event costs a single relaxed load more than
+/// it would without instrumentation.  Once enabled, every fire is counted in a per-type counter, and only
+/// one in every N fires of a type is reported, where N is that type's sample interval.  The counts can be
+/// collected periodically with TakeCounts, which is much cheaper than observing every EventFired report.
+///
+/// A tool which only needs the counts can turn off EventFired reports entirely with SetReportFires, in
+/// which case each fire costs a counter increment and nothing more.
+/// </remarks>
+class EventFiredSampler {
+public:
+  /// <summary>
+  /// Instrumentation state for a single event type
+  /// </summary>
+  struct Counter {
+    Counter(const std::type_info& type);
+
+    const std::type_info& type;
+
+    // Fires since the counts were last taken, and fires since sampling began
+    std::atomic<uint64_t> nFired;
+    std::atomic<uint64_t> nSeen;
+
+    // The sample interval for this type, or zero to use the default
+    std::atomic<size_t> interval;
+
+    // Every counter ever created, most recent first, so that counts can be collected
+    Counter* pNext;
+  };
+
+private:
+  static std::atomic<bool> s_enabled;
+  static std::atomic<bool> s_reportFires;
+  static std::atomic<size_t> s_defaultInterval;
+  static std::atomic<Counter*> s_pHead;
+
+public:
+  /// <returns>The counter for the specified event type</returns>
+  template<class T>
+  static Counter& CounterFor(void) {
+    static Counter counter(typeid(T));
+    return counter;
+  }
+
+  /// <summary>
+  /// Turns EventFired reporting on or off for all event types
+  /// </summary>
+  static void SetEnabled(bool enabled) { s_enabled = enabled; }
+
+  /// <returns>True if EventFired reporting is enabled</returns>
+  static bool IsEnabled(void) { return s_enabled.load(std::memory_order_relaxed); }
+
+  /// <summary>
+  /// Decides whether sampled fires are reported through AutowiringEvents::EventFired, true by default
+  /// </summary>
+  /// <remarks>
+  /// While this is false, fires are still counted as long as reporting is enabled, but never reported
+  /// individually; the only way to observe them is through TakeCounts.
+  /// </remarks>
+  static void SetReportFires(bool reportFires) { s_reportFires = reportFires; }
+
+  /// <summary>
+  /// Sets the sample interval used by event types which do not have their own
+  /// </summary>
+  /// <param name="interval">One fire in this many is reported, zero and one both report every fire</param>
+  static void SetDefaultSampleInterval(size_t interval) { s_defaultInterval = interval; }
+
+  /// <summary>
+  /// Sets the sample interval for the specified event type
+  /// </summary>
+  /// <param name="interval">One fire in this many is reported, or zero to use the default interval</param>
+  template<class T>
+  static void SetSampleInterval(size_t interval) { CounterFor<T>().interval = interval; }
+
+  /// <summary>
+  /// Counts a fire of the specified event type, if reporting is enabled
+  /// </summary>
+  /// <returns>True if this fire should be reported through AutowiringEvents::EventFired</returns>
+  template<class T>
+  static bool ShouldReport(void) {
+    if(!s_enabled.load(std::memory_order_relaxed))
+      return false;
+
+    Counter& counter = CounterFor<T>();
+    counter.nFired.fetch_add(1, std::memory_order_relaxed);
+    if(!s_reportFires.load(std::memory_order_relaxed))
+      return false;
+
+    uint64_t n = counter.nSeen.fetch_add(1, std::memory_order_relaxed);
+
+    size_t interval = counter.interval.load(std::memory_order_relaxed);
+    if(!interval)
+      interval = s_defaultInterval.load(std::memory_order_relaxed);
+    return interval <= 1 || n % interval == 0;
+  }
+
+  /// <summary>
+  /// Returns and resets the number of times each event type was fired since the counts were last taken
+  /// </summary>
+  /// <remarks>
+  /// Types which were not fired in the meantime are omitted.  Fires which are counted concurrently are
+  /// reported either by this call or by the next one.
+  /// </remarks>
+  static std::vector<EventFiredCount> TakeCounts(void);
+};
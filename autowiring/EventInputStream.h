@@ -1,13 +1,14 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #pragma once
+#include "autowiring_error.h"
 #include "Decompose.h"
 #include "Deserialize.h"
+#include "EventStreamFormat.h"
 #include "index_tuple.h"
 #include <string>
-#include <sstream>
 #include <deque>
-#include <map>
 #include MEMORY_HEADER
+#include STL_UNORDERED_MAP
 #include TYPE_TRAITS_HEADER
 
 #ifndef EnableIdentity
@@ -40,6 +41,9 @@ struct Expression<R(W::*)(ToBindArgs...) >: public ExpressionBase
   /// parameter pack expansion.
   /// </summary>
   void DeserializeAndForward(std::deque<std::string> & d){
+    if(d.size() != sizeof...(ToBindArgs))
+      // Written for a different signature, we can't safely bind these arguments
+      return;
     DeserializeAndForward(d, typename make_index_tuple<sizeof...(ToBindArgs)>::type());
   }
 
@@ -63,56 +67,85 @@ public:
   /// Returns true if memfn is enabled, otherwise false.
   /// </summary>
   bool IsEnabled(std::string str) {
-    return !(m_EventMap.find(str) == m_EventMap.end());
+    auto q = m_EventMap.find(autowiring::EventStreamFormat::IdOf(str));
+    return q != m_EventMap.end() && q->second.identity == str;
   }
 
   /// <summary>
   /// Enables a new event for deserialization via its identity
   /// </summary>
+  /// <remarks>
+  /// Throws an autowiring_error if a different identity with the same event ID is already enabled
+  /// </remarks>
   template<class MemFn, MemFn eventIden>
   void SpecialAssign(std::string str) {
     // We cannot serialize an identity we don't recognize
     static_assert(std::is_same<typename Decompose<MemFn>::type, T>::value, "Cannot add a member function unrelated to the output type for this class");
-    if (!IsEnabled(str))
-    {
-      std::shared_ptr<ExpressionBase> ptr = std::make_shared<Expression<MemFn> >(eventIden);
-      m_EventMap[str] = ptr;
+    Entry& entry = m_EventMap[autowiring::EventStreamFormat::IdOf(str)];
+    if(entry.expression) {
+      if(entry.identity != str)
+        throw autowiring_error("Event identity has the same ID as another identity already enabled");
+      return;
     }
+    entry.identity = str;
+    entry.expression = std::make_shared<Expression<MemFn> >(eventIden);
   }
 
   /// <summary>
   /// Interprets and fires a SINGLE EVENT from the passed input buffer
   /// </summary>
   /// <returns>
-  /// The number of bytes processed from the input buffer
+  /// The number of bytes processed from the input buffer, or zero if the buffer does not begin with a
+  /// complete record of a version we understand
   /// </returns>
+  /// <remarks>
+  /// Events which have not been enabled on this stream are skipped, and their size is returned as usual
+  /// </remarks>
   size_t FireSingle(const void* pData, size_t dataSize) const {
-    //First wrap all the bytes in a string.
-    auto chptr = (const char *)pData;
-    std::string MyString(chptr);
+    typedef autowiring::EventStreamFormat Format;
+    auto pBytes = static_cast<const unsigned char*>(pData);
+    if(dataSize < Format::c_prefixSize || pBytes[0] != Format::c_version)
+      return 0;
 
-    std::size_t location = MyString.find("\xDE");
-    std::string topevent = MyString.substr(0, location);
+    size_t bodyLength = Format::GetU32(pBytes + 1);
+    if(bodyLength < Format::c_bodyHeaderSize || dataSize - Format::c_prefixSize < bodyLength)
+      return 0;
 
-    std::deque<std::string> d;
-    std::istringstream buf(topevent);
+    const size_t recordLength = Format::c_prefixSize + bodyLength;
+    const unsigned char* pCur = pBytes + Format::c_prefixSize;
+    const unsigned char* pEnd = pBytes + recordLength;
 
-    std::string s;
-    while(std::getline(buf, s, '\xD8'))
-      d.push_back(s);
+    auto find1 = m_EventMap.find(Format::GetU32(pCur));
+    if(find1 == m_EventMap.end())
+      return recordLength;
 
-    std::string query = d[0];
-    d.pop_front(); // Now a list of arguments
+    uint32_t nArgs = Format::GetU32(pCur + 4);
+    pCur += Format::c_bodyHeaderSize;
 
-    auto find1 = m_EventMap.find(query);
-    if (find1 != m_EventMap.end())
-    {
-      auto evt = find1 -> second;
-      evt->DeserializeAndForward(d);
+    std::deque<std::string> d;
+    for(uint32_t i = 0; i < nArgs; i++) {
+      if(pEnd - pCur < 4)
+        return recordLength;
+      size_t argLength = Format::GetU32(pCur);
+      pCur += 4;
+      if((size_t)(pEnd - pCur) < argLength)
+        // Malformed record, drop it rather than read past its end
+        return recordLength;
+
+      d.emplace_back(reinterpret_cast<const char*>(pCur), argLength);
+      pCur += argLength;
     }
-    return location + 1;
+
+    find1->second.expression->DeserializeAndForward(d);
+    return recordLength;
   }
   
 private:
-  std::map<std::string, std::shared_ptr<ExpressionBase> > m_EventMap;
-};
\ No newline at end of file
+  struct Entry {
+    // The identity the event was enabled with, kept so that a colliding identity can be detected
+    std::string identity;
+    std::shared_ptr<ExpressionBase> expression;
+  };
+
+  std::unordered_map<uint32_t, Entry> m_EventMap;
+};
@@ -1,13 +1,18 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #pragma once
+#include "autowiring_error.h"
 #include "Decompose.h"
 #include "Deserialize.h"
+#include "EventStreamFormat.h"
 #include <map>
 #include <string>
-#include <sstream>
 #include <cassert>
+#include <cstring>
+#include <vector>
 
 #include MEMORY_HEADER
+#include MUTEX_HEADER
+#include STL_UNORDERED_MAP
 #include TYPE_TRAITS_HEADER
 
 #ifndef EnableIdentity
@@ -16,7 +21,51 @@
 
 class EventOutputStreamBase {
 private:
-  std::stringstream m_OutputStream;
+  // Serialized records, in the format described by EventStreamFormat.  Reset keeps the allocation, so a
+  // stream which is drained regularly stops allocating once it has grown to fit its busiest interval.
+  std::vector<unsigned char> m_buffer;
+
+  // Guards the identity maps, which are consulted by every thread that fires an event to this stream
+  mutable std::mutex m_identityLock;
+
+  // The event IDs of the member functions enabled on this stream, keyed by the bytes of the member function
+  // pointer, which have no portable integral representation
+  std::unordered_map<std::string, uint32_t> m_identities;
+
+  // The identity each event ID was derived from, used to detect collisions
+  std::unordered_map<uint32_t, std::string> m_owners;
+
+  template<class MemFn>
+  static std::string BytesOf(MemFn memfn) {
+    return std::string(reinterpret_cast<const char*>(&memfn), sizeof(MemFn));
+  }
+
+  /// <summary>
+  /// Assigns an event ID to the member function with the specified bytes, derived from the passed identity
+  /// </summary>
+  /// <remarks>
+  /// Throws an autowiring_error if the ID is already owned by a different identity on this stream, because
+  /// the reader of the stream would have no way to tell the two events apart
+  /// </remarks>
+  void AddIdentity(const std::string& memfnBytes, const std::string& identity);
+
+  /// <returns>False if no member function with the specified bytes has been enabled</returns>
+  bool QueryIdentity(const std::string& memfnBytes, uint32_t& id) const;
+
+  void AppendU32(uint32_t value);
+
+  /// <summary>
+  /// Appends a length-prefixed argument
+  /// </summary>
+  void AppendArgument(const void* pData, size_t nBytes);
+
+  /// <summary>
+  /// Starts a new record whose body length will be filled in by EndRecord
+  /// </summary>
+  /// <returns>The offset of the record, to be passed to EndRecord</returns>
+  size_t BeginRecord(uint32_t id, uint32_t nArgs);
+  void EndRecord(size_t offset);
+
 public:
 
   EventOutputStreamBase(void);
@@ -35,44 +84,47 @@ public:
   /// <returns>
   /// A pointer to the first byte of data stored in this output stream
   /// </returns>
+  /// <remarks>
+  /// The pointer is owned by the stream, and is only valid until the next event is written or the stream
+  /// is reset.
+  /// </remarks>
   const void* GetData(void) const;
 
   /// <summary>
   /// Resets the output stream, preparing it for new writes.  Does not release or reallocate memory.
   /// </summary>
   void Reset(void);
-  
+
   /// <summary>
-  /// Converts member functions to their string representation for serialization.
+  /// Assigns an event ID to a member function, derived from the passed identity
   /// </summary>
-  template <class MemFn>
-  std::string AddAndQueryMemFn(MemFn memfn, std::string str = "Query")
-  {
-    std::map<std::string, MemFn> local;
-    static std::map<std::string, MemFn> my_map = local;
-    if(str == "Query")
-    {
-      for(const auto& entry : my_map) {
-        if((entry.second) == memfn) return entry.first;
-      }
-      return "";
-    }
-    my_map[str] = memfn;
-    return "";
+  template<class MemFn>
+  void AddIdentity(MemFn memfn, const std::string& identity) {
+    AddIdentity(BytesOf(memfn), identity);
+  }
+
+  /// <summary>
+  /// Finds the event ID assigned to a member function
+  /// </summary>
+  /// <returns>False if the member function has not been enabled</returns>
+  template<class MemFn>
+  bool QueryIdentity(MemFn memfn, uint32_t& id) const {
+    return QueryIdentity(BytesOf(memfn), id);
   }
 
   template <class Arg>
   //SFINAE STUB OUT: replace with check_if overloads <<
   typename std::enable_if< std::is_same<Arg, std::basic_string<char> const *>::value, void >::type
     SerializeMethod(Arg & arg){
-      m_OutputStream << "\xD8" << *arg;
+      AppendArgument(arg->data(), arg->size());
     }
   
   template <class Arg>
   //stub out such that if ARGUMENT defines a static method called AutoSerialize which returns an std::string,
   typename std::enable_if<std::is_base_of<autowiring::Serialize, Arg>::value, void >::type
     SerializeMethod(Arg & arg){
-      m_OutputStream << "\xD8" << arg.AutoSerialize();
+      std::string serialized = arg.AutoSerialize();
+      AppendArgument(serialized.data(), serialized.size());
     }    
   
   template <class Arg1>
@@ -84,23 +136,10 @@ public:
     SerializeMethod(Arg1 & arg1){
       assert(false);
       //static_assert(false, "Fundamental belief about serialized argument types violated");
-    }
-    
 
-  /// <summary>
-  /// Comment.
-  /// </summary>
-  template<class MemFn>
-  void EmitHeader(MemFn eventIden){
-    m_OutputStream << AddAndQueryMemFn(eventIden);
-  }
-
-  /// <summary>
-  /// Comment.
-  /// </summary>
-  void EmitFooter(void){
-    m_OutputStream <<  "\xDE";
-  }
+      // Keeps the record well-formed in release builds
+      AppendArgument(nullptr, 0);
+    }
 
   /// <summary>
   /// Recursive serialize message: base case
@@ -116,37 +155,30 @@ public:
   void Serialize2(Head &value, Targs&... args){
     //Emit an arg
     SerializeMethod(value);
-    //m_OutputStream << "\xD8" << *value;
     Serialize2(args...);
   }
 
+  /// <summary>
+  /// Writes a single event to the stream, if it has been enabled
+  /// </summary>
   template <typename Memfn, typename... Targs>
   void SerializeInit(Memfn memfn, Targs&... args){
-    EmitHeader(memfn);
-    Serialize2( args...);
-    EmitFooter();
-  }
+    uint32_t id;
+    if(!QueryIdentity(memfn, id))
+      return;
 
-  template <typename Memfn, typename Head, typename... Targs>
-  void SerializeInit(Memfn memfn, Head &value, Targs&... args){
-    EmitHeader(memfn);
-    Serialize2(value, args...);
-    EmitFooter();
+    size_t offset = BeginRecord(id, sizeof...(Targs));
+    Serialize2(args...);
+    EndRecord(offset);
   }
 
-
-  // See here: http://stackoverflow.com/questions/257288/is-it-possible-to-write-a-c-template-to-check-for-a-functions-existence
-
   /// <summary>
   /// Returns true if memfn is enabled, otherwise false.
   /// </summary>
   template<class MemFn>
-  bool IsEnabled(MemFn eventIden, bool amIRegistered = false) {
-  static int registration = 0; //first time func is checked
-  if (amIRegistered && registration < 1){
-    registration++;
-  }
-  return (!!registration);
+  bool IsEnabled(MemFn eventIden) const {
+    uint32_t id;
+    return QueryIdentity(eventIden, id);
   }
 
 };
@@ -174,9 +206,6 @@ public:
     // We cannot serialize an identity we don't recognize
     static_assert(std::is_same<typename Decompose<MemFn>::type, T>::value, "Cannot add a member function unrelated to the output type for this class");
     if (!IsEnabled(eventIden))
-    {
-    IsEnabled(eventIden,  true);
-    AddAndQueryMemFn(eventIden, str);
-    }
+      AddIdentity(eventIden, str);
   }
 };
\ No newline at end of file
@@ -0,0 +1,85 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include "DispatchQueueStats.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Instrumentation collected for one type of listener on a single event type
+/// </summary>
+struct EventListenerStats {
+  EventListenerStats(void) :
+    nCalls(0),
+    nExceptions(0)
+  {}
+
+  // The listener's concrete type
+  std::string name;
+
+  // Times the listener was called, and how many of those calls threw
+  uint64_t nCalls;
+  uint64_t nExceptions;
+
+  // Time spent in each call
+  DispatchLatencyHistogram execTime;
+};
+
+/// <summary>
+/// A snapshot of the instrumentation collected for an event type
+/// </summary>
+/// <remarks>
+/// Fires of both synchronous and Deferred events are counted, but only synchronous listener calls are
+/// counted and timed, because Deferred calls run on each listener's own dispatch queue, whose statistics
+/// are reported by DispatchQueue::GetStats.
+/// </remarks>
+struct EventStats {
+  EventStats(void) :
+    instrumented(false),
+    nFired(0),
+    nInvocations(0),
+    nExceptions(0)
+  {}
+
+  // The event type
+  std::string name;
+
+  // True if the event is currently collecting instrumentation
+  bool instrumented;
+
+  // Fires of the event, listener calls made on behalf of those fires, and calls which threw
+  uint64_t nFired;
+  uint64_t nInvocations;
+  uint64_t nExceptions;
+
+  // Per listener type, sorted by name
+  std::vector<EventListenerStats> listeners;
+
+  /// <summary>
+  /// Adds the instrumentation in another snapshot of the same event type to this one
+  /// </summary>
+  void Merge(const EventStats& rhs) {
+    instrumented = instrumented || rhs.instrumented;
+    nFired += rhs.nFired;
+    nInvocations += rhs.nInvocations;
+    nExceptions += rhs.nExceptions;
+
+    for(const EventListenerStats& listener : rhs.listeners) {
+      auto q = std::lower_bound(
+        listeners.begin(),
+        listeners.end(),
+        listener,
+        [] (const EventListenerStats& lhs, const EventListenerStats& rhs) { return lhs.name < rhs.name; }
+      );
+      if(q == listeners.end() || q->name != listener.name) {
+        listeners.insert(q, listener);
+        continue;
+      }
+
+      q->nCalls += listener.nCalls;
+      q->nExceptions += listener.nExceptions;
+      q->execTime.Merge(listener.execTime);
+    }
+  }
+};
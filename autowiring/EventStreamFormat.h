@@ -0,0 +1,59 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace autowiring {
+  /// <summary>
+  /// The binary layout shared by EventOutputStream and EventInputStream
+  /// </summary>
+  /// <remarks>
+  /// A stream is a sequence of records, one per event, and every multi-byte field is a little-endian
+  /// unsigned 32-bit integer:
+  ///
+  ///   version        1 byte, currently c_version
+  ///   body length    the number of bytes which follow this field
+  ///   event id       see IdOf
+  ///   argument count
+  ///   arguments      each one a length followed by that many bytes, which may take any value
+  ///
+  /// A reader can step over a record it does not understand by its body length alone.
+  /// </remarks>
+  struct EventStreamFormat {
+    static const uint8_t c_version = 1;
+
+    // The version byte and the body length
+    static const size_t c_prefixSize = 5;
+
+    // The event ID and the argument count, which start every body
+    static const size_t c_bodyHeaderSize = 8;
+
+    /// <returns>The ID of an event, given the identity it was enabled with</returns>
+    /// <remarks>
+    /// This is a 32-bit FNV-1a hash, so the writer and the reader of a stream agree on the ID of an event
+    /// as long as they enable it with the same identity, and neither needs to tell the other about it.
+    /// </remarks>
+    static uint32_t IdOf(const std::string& identity) {
+      uint32_t id = 2166136261U;
+      for(unsigned char c : identity)
+        id = (id ^ c) * 16777619U;
+      return id;
+    }
+
+    static void PutU32(unsigned char* p, uint32_t value) {
+      p[0] = (unsigned char)value;
+      p[1] = (unsigned char)(value >> 8);
+      p[2] = (unsigned char)(value >> 16);
+      p[3] = (unsigned char)(value >> 24);
+    }
+
+    static uint32_t GetU32(const unsigned char* p) {
+      return
+        (uint32_t)p[0] |
+        ((uint32_t)p[1] << 8) |
+        ((uint32_t)p[2] << 16) |
+        ((uint32_t)p[3] << 24);
+    }
+  };
+}
@@ -3,6 +3,8 @@
 #include "is_any.h"
 #include "index_tuple.h"
 #include "JunctionBox.h"
+#include <cstring>
+#include <typeinfo>
 
 class Deferred;
 
@@ -12,18 +14,26 @@ class JunctionBox;
 /// <summary>
 /// A fully bound member function call
 /// </summary>
+/// <remarks>
+/// The arguments live in a block shared by every listener that receives the same event, so that firing to
+/// many listeners copies the arguments once.  A relay may only move the arguments if it was told when it was
+/// constructed that it is their sole consumer; listeners on other threads could otherwise still be reading them.
+/// </remarks>
 template<class T, class... Args>
 class CurriedInvokeRelay:
   public DispatchThunkBase
 {
 public:
+  typedef std::tuple<typename std::decay<Args>::type...> t_args;
+
   CurriedInvokeRelay(CurriedInvokeRelay& rhs) = delete;
   CurriedInvokeRelay(CurriedInvokeRelay&& rhs) = delete;
 
-  CurriedInvokeRelay(T& obj, Deferred(T::*fnPtr)(Args...), Args... args) :
+  CurriedInvokeRelay(T& obj, Deferred(T::*fnPtr)(Args...), std::shared_ptr<t_args> args, bool consume) :
     m_obj(obj),
     m_fnPtr(fnPtr),
-    m_args(std::forward<Args>(args)...)
+    m_args(std::move(args)),
+    m_consume(consume)
   {}
 
 private:
@@ -32,14 +42,20 @@ private:
 
   // Function call to be made, and its arguments:
   Deferred(T::*m_fnPtr)(Args...);
-  std::tuple<typename std::decay<Args>::type...> m_args;
+  std::shared_ptr<t_args> m_args;
+
+  // True if no other relay shares our arguments, in which case we may move them
+  bool m_consume;
 
   /// <summary>
   /// Places a call to the bound member function pointer by unpacking a lambda into it
   /// </summary>
   template<int... S>
   void CallByUnpackingTuple(index_tuple<S...>) {
-    (m_obj.*m_fnPtr)(std::move(std::get<S>(m_args))...);
+    if(m_consume)
+      (m_obj.*m_fnPtr)(std::move(std::get<S>(*m_args))...);
+    else
+      (m_obj.*m_fnPtr)(std::get<S>(*m_args)...);
   }
 
 public:
@@ -59,12 +75,26 @@ class InvokeRelay<Deferred (T::*)(Args...)> {
 public:
   InvokeRelay(std::shared_ptr<JunctionBox<T>> erp, Deferred (T::*fnPtr)(Args...)):
     erp(erp),
-    fnPtr(fnPtr)
+    fnPtr(fnPtr),
+    routed(false),
+    routeKey(0)
+  {}
+
+  /// <summary>
+  /// Constructs a relay which only reaches listeners subscribed to the specified routing key
+  /// </summary>
+  InvokeRelay(std::shared_ptr<JunctionBox<T>> erp, Deferred (T::*fnPtr)(Args...), size_t routeKey):
+    erp(erp),
+    fnPtr(fnPtr),
+    routed(true),
+    routeKey(routeKey)
   {}
 
   // Null constructor
   InvokeRelay():
-    erp(nullptr)
+    erp(nullptr),
+    routed(false),
+    routeKey(0)
   {}
 
   static_assert(!is_any<std::is_rvalue_reference<Args>...>::value, "Can't use rvalue references as event argument type");
@@ -72,6 +102,13 @@ public:
 private:
   std::shared_ptr<JunctionBox<T>> erp;
   Deferred (T::*fnPtr)(Args...);
+  bool routed;
+  size_t routeKey;
+
+  /// <returns>The targets of this relay, or null if there are none</returns>
+  std::shared_ptr<const typename JunctionBox<T>::t_deferredTargets> GetTargets(void) const {
+    return routed ? erp->GetDeferredTargets(routeKey) : erp->GetDeferredTargets();
+  }
 
 public:
   void operator()(const typename std::decay<Args>::type&... args) const {
@@ -83,9 +120,68 @@ public:
       // Context not yet started
       return;
 
-    std::lock_guard<std::mutex> lk(erp->GetDispatchQueueLock());
-    for(DispatchQueue* q : erp->GetDispatchQueue())
-      q->AddExisting(new CurriedInvokeRelay<T, Args...>(dynamic_cast<T&>(*q), fnPtr, args...));
+    erp->RecordFire();
+
+    // One argument block for all listeners, each of which then receives a thunk small enough to be
+    // constructed in its queue's slab
+    auto targets = GetTargets();
+    if(!targets || targets->empty())
+      return;
+
+    auto block = std::make_shared<typename CurriedInvokeRelay<T, Args...>::t_args>(args...);
+    const bool consume = targets->size() == 1;
+    for(const auto& target : *targets)
+      target.queue->template Emplace<CurriedInvokeRelay<T, Args...>>(*target.obj, fnPtr, block, consume);
+  }
+
+  /// <summary>
+  /// Similar to the function call operator, except that only the most recent call is retained
+  /// </summary>
+  /// <remarks>
+  /// If a listener has not yet executed an earlier call to this event which was made through this method,
+  /// the earlier call is replaced with this one and keeps its place in the listener's queue.  This is
+  /// appropriate for events that describe state, where only the latest value matters to a listener that
+  /// has fallen behind.  Calls made through the function call operator are never replaced.
+  /// </remarks>
+  void Coalesce(const typename std::decay<Args>::type&... args) const {
+    if(!erp)
+      // Context has already been destroyed
+      return;
+
+    if(!erp->IsInitiated())
+      // Context not yet started
+      return;
+
+    erp->RecordFire();
+    auto targets = GetTargets();
+    if(!targets || targets->empty())
+      return;
+
+    const size_t key = GetKey();
+    auto block = std::make_shared<typename CurriedInvokeRelay<T, Args...>::t_args>(args...);
+    const bool consume = targets->size() == 1;
+    for(const auto& target : *targets) {
+      T* pObj = target.obj.get();
+      auto pfn = fnPtr;
+      target.queue->PendKeyed(key, [pObj, pfn, block, consume] () mutable {
+        CurriedInvokeRelay<T, Args...>(*pObj, pfn, std::move(block), consume)();
+      });
+    }
+  }
+
+private:
+  /// <summary>
+  /// Computes the dispatch queue key used to coalesce calls to this event
+  /// </summary>
+  size_t GetKey(void) const {
+    // Member function pointers have no portable integral representation, so we hash their bytes
+    unsigned char bytes[sizeof(fnPtr)];
+    std::memcpy(bytes, &fnPtr, sizeof(fnPtr));
+
+    size_t key = typeid(T).hash_code();
+    for(unsigned char b : bytes)
+      key = (key ^ b) * 1099511628211ULL;
+    return key;
   }
 };
 
@@ -94,12 +190,26 @@ class InvokeRelay<void (T::*)(Args...)> {
 public:
   InvokeRelay(std::shared_ptr<JunctionBox<T>> erp, void (T::*fnPtr)(Args...)) :
     erp(erp),
-    fnPtr(fnPtr)
+    fnPtr(fnPtr),
+    routed(false),
+    routeKey(0)
+  {}
+
+  /// <summary>
+  /// Constructs a relay which only reaches listeners subscribed to the specified routing key
+  /// </summary>
+  InvokeRelay(std::shared_ptr<JunctionBox<T>> erp, void (T::*fnPtr)(Args...), size_t routeKey) :
+    erp(erp),
+    fnPtr(fnPtr),
+    routed(true),
+    routeKey(routeKey)
   {}
 
   // Null constructor
   InvokeRelay():
-    erp(nullptr)
+    erp(nullptr),
+    routed(false),
+    routeKey(0)
   {}
 
   static_assert(!is_any<std::is_rvalue_reference<Args>...>::value, "Can't use rvalue references as event argument type");
@@ -107,6 +217,8 @@ public:
 private:
   std::shared_ptr<JunctionBox<T>> erp;
   void (T::*fnPtr)(Args...);
+  bool routed;
+  size_t routeKey;
 
 public:
   /// <summary>
@@ -129,6 +241,8 @@ public:
       (obj.*fnPtr)(args...);
     };
 
+    if(routed)
+      return erp->FireCurriedTo(routeKey, std::move(fw), args...);
     return erp->FireCurried(
       std::move(fw),
       args...
@@ -136,6 +250,114 @@ public:
   }
 };
 
+/// <summary>
+/// Relay for an event whose member function is known at compile time
+/// </summary>
+/// <remarks>
+/// Listeners are called through a stateless thunk which names the member function directly, rather than
+/// through a member function pointer captured at run time, so each call compiles to an ordinary virtual
+/// call that the compiler is free to inline into the loop over listeners.
+/// </remarks>
+template<class MemFn, MemFn pfn>
+class StaticInvokeRelay {};
+
+template<class T, typename... Args, void (T::*pfn)(Args...)>
+class StaticInvokeRelay<void (T::*)(Args...), pfn> {
+public:
+  explicit StaticInvokeRelay(std::shared_ptr<JunctionBox<T>> erp) :
+    erp(std::move(erp))
+  {}
+
+  // Null constructor
+  StaticInvokeRelay() {}
+
+  static_assert(!is_any<std::is_rvalue_reference<Args>...>::value, "Can't use rvalue references as event argument type");
+
+private:
+  std::shared_ptr<JunctionBox<T>> erp;
+
+  struct Thunk {
+    void operator()(T& obj, Args... args) const {
+      (obj.*pfn)(args...);
+    }
+  };
+
+public:
+  /// <summary>
+  /// The function call operation itself
+  /// </summary>
+  /// <returns>False if an exception was thrown by a recipient, true otherwise</returns>
+  bool operator()(Args... args) const {
+    if(!erp)
+      // Context has already been destroyed
+      return true;
+
+    if(!erp->IsInitiated())
+      // Context not yet started
+      return true;
+
+    // Give the serializer a chance to handle these arguments:
+    erp->SerializeInit(pfn, args...);
+    return erp->FireCurried(Thunk(), args...);
+  }
+};
+
+/// <summary>
+/// Relay for events whose listeners are called concurrently on a thread pool
+/// </summary>
+template<class FnPtr>
+class ParallelInvokeRelay {};
+
+template<class T, typename... Args>
+class ParallelInvokeRelay<void (T::*)(Args...)> {
+public:
+  ParallelInvokeRelay(std::shared_ptr<JunctionBox<T>> erp, void (T::*fnPtr)(Args...), std::shared_ptr<CoreThreadPool> pool) :
+    erp(erp),
+    fnPtr(fnPtr),
+    pool(pool)
+  {}
+
+  // Null constructor
+  ParallelInvokeRelay() :
+    erp(nullptr)
+  {}
+
+  static_assert(!is_any<std::is_rvalue_reference<Args>...>::value, "Can't use rvalue references as event argument type");
+
+private:
+  std::shared_ptr<JunctionBox<T>> erp;
+  void (T::*fnPtr)(Args...);
+
+  // The pool that will call listeners, or null to call them sequentially on the firing thread
+  std::shared_ptr<CoreThreadPool> pool;
+
+public:
+  /// <summary>
+  /// The function call operation itself
+  /// </summary>
+  /// <returns>False if an exception was thrown by a recipient, true otherwise</returns>
+  bool operator()(Args... args) const {
+    if(!erp)
+      // Context has already been destroyed
+      return true;
+
+    if(!erp->IsInitiated())
+      // Context not yet started
+      return true;
+
+    // Give the serializer a chance to handle these arguments:
+    erp->SerializeInit(fnPtr, args...);
+
+    auto fw = [this](T& obj, Args... args) {
+      (obj.*fnPtr)(args...);
+    };
+
+    if(!pool)
+      return erp->FireCurried(std::move(fw), args...);
+    return erp->FireCurriedParallel(*pool, std::move(fw), args...);
+  }
+};
+
 /// <summary>
 /// Makes an invocation relay for a particular junction box and function pointer
 /// </summary>
@@ -1,5 +1,7 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #pragma once
+#include "CoreThreadPool.h"
+#include "CurrentContextPusher.h"
 #include "DispatchQueue.h"
 #include "DispatchThunk.h"
 #include "EventOutputStream.h"
@@ -9,10 +11,16 @@
 #include "JunctionBoxBase.h"
 #include "JunctionBoxEntry.h"
 #include "TypeUnifier.h"
-#include <set>
+#include <algorithm>
+#include <vector>
+#include ATOMIC_HEADER
+#include CHRONO_HEADER
+#include FUNCTIONAL_HEADER
+#include MUTEX_HEADER
 #include STL_TUPLE_HEADER
 #include RVALUE_HEADER
 #include MEMORY_HEADER
+#include STL_UNORDERED_MAP
 #include STL_UNORDERED_SET
 #include TYPE_TRAITS_HEADER
 
@@ -35,49 +43,224 @@ class JunctionBox:
 {
 public:
   JunctionBox(void):
-    m_numberOfDeletions(0)
+    m_listeners(std::make_shared<t_listenerSet>()),
+    m_deferredTargets(std::make_shared<t_deferredTargets>()),
+    m_routes(std::make_shared<t_routes>())
   {}
 
   virtual ~JunctionBox(void) {}
 
 protected:
-  // Collection of all known listeners:
-  typedef std::set<JunctionBoxEntry<T>> t_listenerSet;
-  t_listenerSet m_st;
+  // An immutable snapshot of all known listeners.  Add and Remove replace the snapshot under m_lock rather
+  // than modifying it, so firing only has to atomically load the current snapshot and never locks.
+  typedef std::vector<JunctionBoxEntry<T>> t_listenerSet;
+  std::shared_ptr<const t_listenerSet> m_listeners;
 
-  // Incremented every time an event is deleted to notify potentially invalidated iterators
-  volatile int m_numberOfDeletions;
+  /// <returns>The current listener snapshot</returns>
+  std::shared_ptr<const t_listenerSet> GetListeners(void) const {
+    return std::atomic_load(&m_listeners);
+  }
+
+public:
+  /// <summary>
+  /// A listener which is also a dispatch queue, and so receives Deferred events
+  /// </summary>
+  struct DeferredTarget {
+    DispatchQueue* queue;
+
+    // The same listener as queue, adjusted ahead of time so firing need not cast
+    std::shared_ptr<T> obj;
+  };
+  typedef std::vector<DeferredTarget> t_deferredTargets;
+
+  /// <returns>The current snapshot of Deferred event targets</returns>
+  /// <remarks>
+  /// Maintained alongside the listener snapshot and with the same guarantees, so that Deferred events can
+  /// be fired without taking the dispatch queue lock
+  /// </remarks>
+  std::shared_ptr<const t_deferredTargets> GetDeferredTargets(void) const {
+    return std::atomic_load(&m_deferredTargets);
+  }
+
+protected:
+  std::shared_ptr<const t_deferredTargets> m_deferredTargets;
+
+  /// <summary>
+  /// Replaces the Deferred target snapshot with one built from the dispatch queue set
+  /// </summary>
+  /// <remarks>
+  /// The caller must hold m_lock
+  /// </remarks>
+  void UpdateDeferredTargetsUnsafe(void) {
+    auto targets = std::make_shared<t_deferredTargets>();
+    targets->reserve(m_dispatch.size());
+    for(const auto& entry : *m_listeners) {
+      DispatchQueue* pDispatch = autowiring::fast_pointer_cast<DispatchQueue, T>(entry.m_ptr).get();
+      if(pDispatch)
+        targets->push_back(DeferredTarget{pDispatch, entry.m_ptr});
+    }
+    std::atomic_store(&m_deferredTargets, std::shared_ptr<const t_deferredTargets>(std::move(targets)));
+  }
+
+  /// <summary>
+  /// The listeners which have subscribed to a routing key
+  /// </summary>
+  struct Route {
+    t_listenerSet listeners;
+    t_deferredTargets deferred;
+  };
+  typedef std::unordered_map<size_t, Route> t_routes;
+
+  // An immutable snapshot of the routing index, replaced under m_lock in the same way as m_listeners
+  std::shared_ptr<const t_routes> m_routes;
+
+  /// <returns>A copy of the specified route without the specified listener</returns>
+  static Route WithoutListener(const Route& route, const std::shared_ptr<T>& listener) {
+    // Elements are pushed rather than erased, because JunctionBoxEntry does not support assignment
+    Route retVal;
+    for(const auto& entry : route.listeners)
+      if(entry.m_ptr != listener)
+        retVal.listeners.push_back(entry);
+    for(const auto& target : route.deferred)
+      if(target.obj != listener)
+        retVal.deferred.push_back(target);
+    return retVal;
+  }
+
+  /// <summary>
+  /// Removes the specified listener from every route
+  /// </summary>
+  /// <remarks>
+  /// The caller must hold m_lock
+  /// </remarks>
+  void RemoveRoutesUnsafe(const std::shared_ptr<T>& listener) {
+    std::shared_ptr<t_routes> routes;
+    for(const auto& route : *m_routes)
+      for(const auto& entry : route.second.listeners)
+        if(entry.m_ptr == listener) {
+          if(!routes)
+            routes = std::make_shared<t_routes>(*m_routes);
+          (*routes)[route.first] = WithoutListener(route.second, listener);
+          break;
+        }
+
+    if(routes)
+      std::atomic_store(&m_routes, std::shared_ptr<const t_routes>(std::move(routes)));
+  }
 
 public:
+  /// <summary>
+  /// Subscribes a listener to events fired with the specified routing key
+  /// </summary>
+  /// <returns>False if the listener is not a listener on this junction box</returns>
+  /// <remarks>
+  /// A subscribed listener continues to receive events fired without a key.  The subscription ends when
+  /// the listener is removed from this junction box.
+  /// </remarks>
+  bool AddRoute(size_t key, const std::shared_ptr<T>& listener) {
+    std::lock_guard<std::mutex> lk(m_lock);
+    const JunctionBoxEntry<T>* pEntry = nullptr;
+    for(const auto& entry : *m_listeners)
+      if(entry.m_ptr == listener)
+        pEntry = &entry;
+    if(!pEntry)
+      return false;
+
+    auto q = m_routes->find(key);
+    if(q != m_routes->end())
+      for(const auto& entry : q->second.listeners)
+        if(entry.m_ptr == listener)
+          // Already subscribed
+          return true;
+
+    auto routes = std::make_shared<t_routes>(*m_routes);
+    Route& route = (*routes)[key];
+    route.listeners.push_back(*pEntry);
+    DispatchQueue* pDispatch = autowiring::fast_pointer_cast<DispatchQueue, T>(listener).get();
+    if(pDispatch)
+      route.deferred.push_back(DeferredTarget{pDispatch, listener});
+    std::atomic_store(&m_routes, std::shared_ptr<const t_routes>(std::move(routes)));
+    return true;
+  }
+
+  /// <summary>
+  /// Ends a subscription made with AddRoute
+  /// </summary>
+  /// <returns>False if the listener was not subscribed to the specified key</returns>
+  bool RemoveRoute(size_t key, const std::shared_ptr<T>& listener) {
+    std::lock_guard<std::mutex> lk(m_lock);
+    auto q = m_routes->find(key);
+    if(q == m_routes->end())
+      return false;
+
+    Route route = WithoutListener(q->second, listener);
+    if(route.listeners.size() == q->second.listeners.size())
+      return false;
+
+    auto routes = std::make_shared<t_routes>(*m_routes);
+    if(route.listeners.empty())
+      routes->erase(key);
+    else
+      (*routes)[key] = std::move(route);
+    std::atomic_store(&m_routes, std::shared_ptr<const t_routes>(std::move(routes)));
+    return true;
+  }
+
+  /// <returns>The Deferred event targets subscribed to the specified key, or null if there are none</returns>
+  std::shared_ptr<const t_deferredTargets> GetDeferredTargets(size_t key) const {
+    std::shared_ptr<const t_routes> routes = std::atomic_load(&m_routes);
+    auto q = routes->find(key);
+    if(q == routes->end())
+      return nullptr;
+
+    // Aliases the routing snapshot, which keeps the targets alive
+    return std::shared_ptr<const t_deferredTargets>(routes, &q->second.deferred);
+  }
+
   /// <summary>
   /// Recursive serialize message: Initial Processing- n arg case
   /// </summary>
   template <typename Memfn, typename... Targs>
   void SerializeInit(Memfn memfn, Targs&... args) {
-    //First distribute the arguments to any listening serializers in current context
-    if (m_PotentialMarshals){
-      auto m_vector = *m_PotentialMarshals;
-      auto it = m_vector.begin();
-
-      while (it != m_vector.end()){
-        auto testptr = (*it).lock();
-        if (testptr) {
-          //if given eventid is enabled for given eventoutputstream, serialize!
-          if (testptr->IsEnabled(memfn))
-            testptr->SerializeInit(memfn, args...);
-          ++it;
-        }
-        else
-          it = m_vector.erase(it); //opportunistically kill dead references.
+    //First distribute the arguments to any listening serializers in current context.  Each stream
+    //ignores events which it has not enabled.
+    if (m_PotentialMarshals)
+      for(const auto& marshal : *m_PotentialMarshals) {
+        auto testptr = marshal.lock();
+        if (testptr)
+          testptr->SerializeInit(memfn, args...);
       }
+  }
+
+  /// <summary>
+  /// Serializes each element of a batch of single-argument events, resolving listening serializers once
+  /// </summary>
+  template<class Memfn, class It>
+  void SerializeBatch(Memfn memfn, It first, It last) {
+    if(!m_PotentialMarshals || first == last)
+      return;
+
+    std::vector<std::shared_ptr<EventOutputStreamBase>> streams;
+    for(const auto& marshal : *m_PotentialMarshals) {
+      auto testptr = marshal.lock();
+      if(testptr && testptr->IsEnabled(memfn))
+        streams.push_back(testptr);
     }
+
+    for(const auto& stream : streams)
+      for(It cur = first; cur != last; ++cur) {
+        auto& arg = *cur;
+        stream->SerializeInit(memfn, arg);
+      }
   }
 
   /// <summary>
   /// Convenience method allowing consumers to quickly determine whether any listeners exist
   /// </summary>
+  const std::type_info& GetEventType(void) const override { return typeid(T); }
+
   bool HasListeners(void) const override {
-    return (std::lock_guard<std::mutex>)m_lock, !m_st.empty();
+    return !GetListeners()->empty();
   }
 
   void Add(const JunctionBoxEntry<Object>& rhs) override {
@@ -98,14 +281,25 @@ public:
   /// </summary>
   void Add(const JunctionBoxEntry<T>& rhs) {
     std::lock_guard<std::mutex> lk(m_lock);
+    for(const auto& entry : *m_listeners)
+      if(entry == rhs)
+        return;
 
-    // Trivial insert
-    m_st.insert(rhs);
+    // Copy-on-write, the prior snapshot may be in use by a concurrent fire
+    auto listeners = std::make_shared<t_listenerSet>();
+    listeners->reserve(m_listeners->size() + 1);
+    for(const auto& entry : *m_listeners)
+      listeners->push_back(entry);
+    // Copied without any instrumentation rhs may have cached for some other junction box
+    listeners->push_back(JunctionBoxEntry<T>(rhs.m_owner, rhs.m_ptr));
+    std::atomic_store(&m_listeners, std::shared_ptr<const t_listenerSet>(std::move(listeners)));
 
     // If the RHS implements DispatchQueue, add it to that collection as well:
     DispatchQueue* pDispatch = autowiring::fast_pointer_cast<DispatchQueue, T>(rhs.m_ptr).get();
-    if(pDispatch)
+    if(pDispatch) {
       m_dispatch.insert(pDispatch);
+      UpdateDeferredTargetsUnsafe();
+    }
   }
 
   /// <summary>
@@ -114,15 +308,60 @@ public:
   void Remove(const JunctionBoxEntry<T>& rhs) {
     std::lock_guard<std::mutex> lk(m_lock);
 
-    // Update the deletion count
-    m_numberOfDeletions++;
-
     // If the RHS implements DispatchQueue, remove it from the dispatchers collection
     DispatchQueue* pDispatch = autowiring::fast_pointer_cast<DispatchQueue, T>(rhs.m_ptr).get();
     if(pDispatch)
       m_dispatch.erase(pDispatch);
 
-    m_st.erase(rhs);
+    auto listeners = std::make_shared<t_listenerSet>();
+    listeners->reserve(m_listeners->size());
+    for(const auto& entry : *m_listeners)
+      if(!(entry == rhs))
+        listeners->push_back(entry);
+    if(listeners->size() == m_listeners->size())
+      return;
+    std::atomic_store(&m_listeners, std::shared_ptr<const t_listenerSet>(std::move(listeners)));
+    if(pDispatch)
+      UpdateDeferredTargetsUnsafe();
+    RemoveRoutesUnsafe(rhs.m_ptr);
+  }
+
+  /// <summary>
+  /// Records the context of a listener which threw, and gives exception filters a chance to see the exception
+  /// </summary>
+  /// <remarks>
+  /// Must be called from within the handler that caught the exception
+  /// </remarks>
+  void OnFiringException(const JunctionBoxEntry<T>& entry, std::vector<std::weak_ptr<CoreContext>>& teardown) const {
+    teardown.push_back(ContextDumbToWeak(entry.m_owner));
+
+    // If T doesn't inherit Object, then we need to cast to a unifying type which does
+    typedef typename SelectTypeUnifier<T>::type TActual;
+    this->FilterFiringException(autowiring::fast_pointer_cast<TActual>(entry.m_ptr));
+  }
+
+  /// <summary>
+  /// Calls a listener, timing the call if instrumentation is enabled
+  /// </summary>
+  /// <param name="stats">The stats block, or null if instrumentation is disabled</param>
+  /// <param name="entry">The entry for obj, which caches its instrumentation</param>
+  template<class Call>
+  static void InvokeListener(StatsBlock* stats, const JunctionBoxEntry<T>& entry, T& obj, const Call& call) {
+    if(!stats) {
+      call();
+      return;
+    }
+
+    ListenerStatsBlock& listener = GetListenerStats(*stats, entry, typeid(obj));
+    auto start = std::chrono::steady_clock::now();
+    try {
+      call();
+    }
+    catch(...) {
+      RecordInvocation(*stats, listener, start, true);
+      throw;
+    }
+    RecordInvocation(*stats, listener, start, false);
   }
 
   /// <summary>
@@ -130,35 +369,53 @@ public:
   /// </summary>
   /// <param name="fn">A nearly-curried routine to be invoked</param>
   /// <return>False if an exception was thrown by a recipient, true otherwise</return>
+  /// <remarks>
+  /// Listeners are called from the snapshot that was current when firing began.  A listener added during
+  /// the fire will not receive this event, and a listener removed during the fire may still receive it; the
+  /// snapshot holds a reference to every listener in it, so no listener is destroyed while it is being called.
+  /// </remarks>
   template<class Fn, class... Args>
   bool FireCurried(const Fn& fn, Args&... args) const {
-    std::unique_lock<std::mutex> lk(m_lock);
-    int deleteCount = m_numberOfDeletions;
+    const std::shared_ptr<const t_listenerSet> listeners = GetListeners();
+    return FireCurriedOn(*listeners, fn, args...);
+  }
+
+  /// <summary>
+  /// Variant of FireCurried which only calls listeners subscribed to the specified routing key
+  /// </summary>
+  /// <remarks>
+  /// Costs a single hash lookup no matter how many listeners subscribe to other keys
+  /// </remarks>
+  template<class Fn, class... Args>
+  bool FireCurriedTo(size_t key, const Fn& fn, Args&... args) const {
+    const std::shared_ptr<const t_routes> routes = std::atomic_load(&m_routes);
+    auto q = routes->find(key);
+    if(q == routes->end()) {
+      RecordFire();
+      return true;
+    }
+    return FireCurriedOn(q->second.listeners, fn, args...);
+  }
+
+private:
+  /// <summary>
+  /// Calls each listener in the passed set, which must be kept alive by the caller
+  /// </summary>
+  template<class Fn, class... Args>
+  bool FireCurriedOn(const t_listenerSet& listeners, const Fn& fn, Args&... args) const {
+    StatsBlock* stats = GetStatsBlock();
+    if(stats)
+      stats->nFired.fetch_add(1, std::memory_order_relaxed);
 
     // Set of contexts that need to be torn down in the event of an exception:
     std::vector<std::weak_ptr<CoreContext>> teardown;
 
-    for(auto it = m_st.begin(); it != m_st.end(); ){
-      JunctionBoxEntry<T> currentEvent(*it);
-
-      lk.unlock();
+    for(const JunctionBoxEntry<T>& currentEvent : listeners) {
       try {
-        fn(*currentEvent.m_ptr, args...);
+        T& obj = *currentEvent.m_ptr;
+        InvokeListener(stats, currentEvent, obj, [&] { fn(obj, args...); });
       } catch(...) {
-        teardown.push_back(ContextDumbToWeak(currentEvent.m_owner));
-        
-        // If T doesn't inherit Object, then we need to cast to a unifying type which does
-        typedef typename SelectTypeUnifier<T>::type TActual;
-        this->FilterFiringException(autowiring::fast_pointer_cast<TActual>(currentEvent.m_ptr));
-      }
-      lk.lock();
-
-      // Increment iterator correctly even if it's been invalidated
-      if (deleteCount == m_numberOfDeletions){
-        ++it;
-      } else {
-        it = m_st.upper_bound(currentEvent);
-        deleteCount = m_numberOfDeletions;
+        OnFiringException(currentEvent, teardown);
       }
     }
     if(teardown.empty())
@@ -166,7 +423,156 @@ public:
       return true;
 
     // Exceptions thrown, teardown and then indicate an error
-    lk.unlock();
+    TerminateAll(teardown);
+    return false;
+  }
+
+public:
+  /// <summary>
+  /// Variant of FireCurried which calls listeners concurrently on the specified pool
+  /// </summary>
+  /// <return>False if an exception was thrown by a recipient, true otherwise</return>
+  /// <remarks>
+  /// Listeners are claimed one at a time by the firing thread and by up to one pool worker per remaining
+  /// listener, so the fire takes about as long as the slowest listener rather than the sum of all of them.
+  /// The firing thread takes part and returns only once every listener has been called, so this method is
+  /// safe to use from one of the pool's own workers and still completes if the pool is stopped or busy.
+  ///
+  /// Listeners may run concurrently with one another and must not rely on the order in which they are
+  /// called.  Exceptions are handed to exception filters on the firing thread, after all listeners have
+  /// returned, and contexts whose listeners threw are torn down exactly as they are by FireCurried.
+  /// </remarks>
+  template<class Fn, class... Args>
+  bool FireCurriedParallel(CoreThreadPool& pool, const Fn& fn, Args&... args) const {
+    const std::shared_ptr<const t_listenerSet> listeners = GetListeners();
+    if(listeners->size() < 2 || !pool.GetWorkerCount())
+      // Nothing to gain from involving the pool
+      return FireCurried(fn, args...);
+
+    StatsBlock* stats = GetStatsBlock();
+    if(stats)
+      stats->nFired.fetch_add(1, std::memory_order_relaxed);
+
+    // Shared with the pool, which may hold on to it after we return if a worker starts late
+    struct State {
+      State(const std::shared_ptr<const t_listenerSet>& listeners, StatsBlock* stats, std::function<void(T&)>&& call) :
+        listeners(listeners),
+        context(GetCurrentContext()),
+        stats(stats),
+        call(std::move(call)),
+        exceptions(listeners->size()),
+        next(0),
+        nDone(0)
+      {}
+
+      const std::shared_ptr<const t_listenerSet> listeners;
+
+      // The context current on the firing thread, which every listener sees as current no matter which
+      // thread calls it
+      const std::shared_ptr<CoreContext> context;
+
+      // Kept alive by the junction box, which outlives the fire
+      StatsBlock* const stats;
+
+      // Refers to the caller's arguments, and so only valid until every listener has been claimed
+      const std::function<void(T&)> call;
+
+      // The exception thrown by each listener, if any
+      std::vector<std::exception_ptr> exceptions;
+
+      // The next listener to be claimed, and the number of listeners that have returned
+      std::atomic<size_t> next;
+      size_t nDone;
+      std::mutex lock;
+      std::condition_variable done;
+
+      void Drain(void) {
+        const size_t n = listeners->size();
+        for(size_t i; (i = next++) < n;) {
+          try {
+            CurrentContextPusher pshr(context);
+            const JunctionBoxEntry<T>& entry = (*listeners)[i];
+            T& obj = *entry.m_ptr;
+            InvokeListener(stats, entry, obj, [&] { call(obj); });
+          }
+          catch(...) {
+            exceptions[i] = std::current_exception();
+          }
+
+          std::lock_guard<std::mutex> lk(lock);
+          if(++nDone == n)
+            done.notify_all();
+        }
+      }
+    };
+
+    auto state = std::make_shared<State>(
+      listeners,
+      stats,
+      [&fn, &args...] (T& obj) { fn(obj, args...); }
+    );
+
+    const size_t nHelpers = std::min(pool.GetWorkerCount(), listeners->size() - 1);
+    for(size_t i = 0; i < nHelpers; i++)
+      pool += [state] { state->Drain(); };
+    state->Drain();
+
+    {
+      std::unique_lock<std::mutex> lk(state->lock);
+      state->done.wait(lk, [&] { return state->nDone == listeners->size(); });
+    }
+
+    std::vector<std::weak_ptr<CoreContext>> teardown;
+    for(size_t i = 0; i < listeners->size(); i++) {
+      if(!state->exceptions[i])
+        continue;
+
+      try {
+        std::rethrow_exception(state->exceptions[i]);
+      }
+      catch(...) {
+        OnFiringException((*listeners)[i], teardown);
+      }
+    }
+    if(teardown.empty())
+      return true;
+
+    TerminateAll(teardown);
+    return false;
+  }
+  /// <summary>
+  /// Calls each listener once for every element of a batch
+  /// </summary>
+  /// <param name="fn">Called with a listener and one element</param>
+  /// <return>False if an exception was thrown by a recipient, true otherwise</return>
+  /// <remarks>
+  /// All elements are delivered from a single listener snapshot.  Each listener receives every element, in
+  /// order, before the next listener is called.  A listener which throws receives no further elements from
+  /// this batch, and its context is torn down as it is by FireCurried.  Instrumentation counts the batch as
+  /// a single fire, and each listener's handling of the batch as a single call.
+  /// </remarks>
+  template<class Fn, class It>
+  bool FireCurriedBatch(const Fn& fn, It first, It last) const {
+    const std::shared_ptr<const t_listenerSet> listeners = GetListeners();
+    StatsBlock* stats = GetStatsBlock();
+    if(stats)
+      stats->nFired.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<std::weak_ptr<CoreContext>> teardown;
+    for(const JunctionBoxEntry<T>& currentEvent : *listeners) {
+      try {
+        T& obj = *currentEvent.m_ptr;
+        InvokeListener(stats, currentEvent, obj, [&] {
+          for(It cur = first; cur != last; ++cur)
+            fn(obj, *cur);
+        });
+      } catch(...) {
+        OnFiringException(currentEvent, teardown);
+      }
+    }
+    if(teardown.empty())
+      return true;
+
     TerminateAll(teardown);
     return false;
   }
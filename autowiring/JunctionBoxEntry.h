@@ -1,16 +1,28 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #pragma once
 #include <stdexcept>
+#include ATOMIC_HEADER
 #include MEMORY_HEADER
 
 class CoreContext;
+struct JunctionBoxListenerStats;
 
 struct JunctionBoxEntryBase {
   JunctionBoxEntryBase(CoreContext* owner) :
-    m_owner(owner)
+    m_owner(owner),
+    m_stats(nullptr)
+  {}
+
+  JunctionBoxEntryBase(const JunctionBoxEntryBase& rhs) :
+    m_owner(rhs.m_owner),
+    m_stats(rhs.m_stats.load(std::memory_order_acquire))
   {}
 
   CoreContext* const m_owner;
+
+  // The junction box's instrumentation for this listener, resolved the first time the listener is called
+  // while instrumentation is enabled, so that later calls need not look it up
+  mutable std::atomic<JunctionBoxListenerStats*> m_stats;
 };
 
 /// <summary>
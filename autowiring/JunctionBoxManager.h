@@ -1,6 +1,7 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #pragma once
 #include "EventRegistry.h"
+#include "EventStats.h"
 #include "JunctionBoxBase.h"
 #include "JunctionBoxEntry.h"
 #include "uuid.h"
@@ -64,6 +65,20 @@ public:
   /// </summary>
   void Initiate(void);
 
+  /// <summary>
+  /// Enables or disables instrumentation on every junction box known to this manager
+  /// </summary>
+  void SetInstrumented(bool instrumented);
+
+  /// <summary>
+  /// Merges the instrumentation collected by each junction box into the passed collection
+  /// </summary>
+  /// <param name="stats">Event statistics, sorted by name, to which this manager's statistics are added</param>
+  /// <remarks>
+  /// Events which are not instrumented and have no fires recorded are omitted
+  /// </remarks>
+  void GetStats(std::vector<EventStats>& stats) const;
+
   void AddEventReceiver(JunctionBoxEntry<Object> receiver);
   void RemoveEventReceiver(JunctionBoxEntry<Object> pRecvr);
 
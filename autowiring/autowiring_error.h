@@ -17,3 +17,10 @@ public:
   const char* what(void) const throw() override {return m_what;}
 };
 
+
+/// <summary>
+/// Thrown when a dispatch operation was aborted
+/// </summary>
+class dispatch_aborted_exception:
+  public std::exception
+{};
@@ -51,7 +51,12 @@ AutoNetServer* NewAutoNetServerImpl(void) {
 // CoreThread overrides
 void AutoNetServerImpl::Run(void){
   std::cout << "Starting Autonet server..." << std::endl;
-  
+
+  // Event fires are counted while we run, and the counts are collected by PollEventCounts rather than
+  // having every fire reported to us individually
+  EventFiredSampler::SetReportFires(false);
+  EventFiredSampler::SetEnabled(true);
+
   m_Server.listen(m_Port);
   m_Server.start_accept();
   
@@ -61,10 +66,14 @@ void AutoNetServerImpl::Run(void){
   });
 
   PollThreadUtilization(std::chrono::milliseconds(1000));
+  PollEventCounts(std::chrono::milliseconds(1000));
   CoreThread::Run();
 }
 
 void AutoNetServerImpl::OnStop(void) {
+  EventFiredSampler::SetEnabled(false);
+  EventFiredSampler::SetReportFires(true);
+
   if (m_Server.is_listening())
     m_Server.stop_listening();
   
@@ -341,3 +350,22 @@ void AutoNetServerImpl::PollThreadUtilization(std::chrono::milliseconds period){
     PollThreadUtilization(period);
   };
 }
+
+void AutoNetServerImpl::PollEventCounts(std::chrono::milliseconds period){
+  *this += period, [this, period] {
+    // Counts are kept process-wide, so they are attributed to the global context
+    int contextID = ResolveContextID(AutoGlobalContext().get());
+    for(const EventFiredCount& count : EventFiredSampler::TakeCounts())
+      BroadcastMessage(
+        "eventFired",
+        contextID,
+        Json::object{
+          {"name", autowiring::demangle(*count.type)},
+          {"count", static_cast<double>(count.nFired)}
+        }
+      );
+
+    // Poll again after "period" milliseconds
+    PollEventCounts(period);
+  };
+}
@@ -137,6 +137,11 @@ protected:
   /// </summary>
   void PollThreadUtilization(std::chrono::milliseconds period);
 
+  /// <summary>
+  /// Append a lambda to this queue that will broadcast the number of times each event type was fired
+  /// </summary>
+  void PollEventCounts(std::chrono::milliseconds period);
+
 
   /*******************************************
   *             Member variables             *
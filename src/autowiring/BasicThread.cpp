@@ -16,7 +16,8 @@ BasicThread::BasicThread(const char* pName):
   m_stop(false),
   m_running(false),
   m_completed(false),
-  m_priority(ThreadPriority::Default)
+  m_priority(ThreadPriority::Default),
+  m_schedulingFailed(false)
 {}
 
 std::mutex& BasicThread::GetLock(void) {
@@ -33,6 +34,18 @@ void BasicThread::DoRun(std::shared_ptr<Object>&& refTracker) {
   if(GetName())
     SetCurrentThreadName();
 
+  // Placement and scheduling must be in effect before any user code runs.  Context defaults are obtained
+  // first, we cannot take the context's lock while holding our own.
+  {
+    ThreadScheduling scheduling = GetContext()->GetThreadScheduling();
+    std::lock_guard<std::mutex> lk(m_state->m_lock);
+    RecordThreadStart();
+    if(m_scheduling)
+      scheduling = *m_scheduling;
+    if(!scheduling.IsDefault())
+      m_schedulingFailed = !ApplyThreadScheduling(scheduling);
+  }
+
   // Now we wait for the thread to be good to go:
   try {
     Run();
@@ -129,23 +142,22 @@ bool BasicThread::Start(std::shared_ptr<Object> outstanding) {
   if(!context)
     return false;
 
-  {
-    std::lock_guard<std::mutex> lk(m_state->m_lock);
-    if(m_running)
-      // Already running, short-circuit
-      return true;
+  std::lock_guard<std::mutex> lk(m_state->m_lock);
+  if(m_running)
+    // Already running, short-circuit
+    return true;
 
-    if(m_completed)
-      // Already completed (perhaps cancelled), short-circuit
-      return false;
+  if(m_completed)
+    // Already completed (perhaps cancelled), short-circuit
+    return false;
 
-    // Currently running:
-    m_running = true;
-    m_state->m_stateCondition.notify_all();
-  }
+  // Currently running:
+  m_running = true;
+  m_state->m_stateCondition.notify_all();
 
   // Place the new thread entity directly in the space where it goes to avoid
-  // any kind of races arising from asynchronous access to this space
+  // any kind of races arising from asynchronous access to this space.  This is done under the lock so that
+  // the thread handle is valid for anyone who observes that we are running.
   m_state->m_thisThread.~thread();
   new (&m_state->m_thisThread) std::thread(
     [this, outstanding] () mutable {
@@ -155,6 +167,33 @@ bool BasicThread::Start(std::shared_ptr<Object> outstanding) {
   return true;
 }
 
+bool BasicThread::SetThreadScheduling(const ThreadScheduling& scheduling) {
+  std::lock_guard<std::mutex> lk(m_state->m_lock);
+  m_scheduling.reset(new ThreadScheduling(scheduling));
+  if(!m_running)
+    return true;
+  m_schedulingFailed = !ApplyThreadScheduling(scheduling);
+  return !m_schedulingFailed;
+}
+
+bool BasicThread::DidThreadSchedulingFail(void) const {
+  std::lock_guard<std::mutex> lk(m_state->m_lock);
+  return m_schedulingFailed;
+}
+
+bool BasicThread::GetThreadScheduling(ThreadScheduling& scheduling) {
+  std::shared_ptr<CoreContext> context = m_context.lock();
+  ThreadScheduling inherited = context ? context->GetThreadScheduling() : ThreadScheduling();
+
+  std::lock_guard<std::mutex> lk(m_state->m_lock);
+  scheduling = m_scheduling ? *m_scheduling : inherited;
+  if(!m_running)
+    return false;
+
+  QueryThreadScheduling(scheduling);
+  return true;
+}
+
 void BasicThread::Wait(void) {
   std::unique_lock<std::mutex> lk(m_state->m_lock);
   m_state->m_stateCondition.wait(
@@ -2,4 +2,10 @@
 #include "stdafx.h"
 #include "BasicThreadStateBlock.h"
 
+BasicThreadStateBlock::BasicThreadStateBlock(void):
+  m_startTime(std::chrono::steady_clock::time_point::min()),
+  m_kernelThreadId(0),
+  m_affinityMask(0)
+{}
+
 BasicThreadStateBlock::~BasicThreadStateBlock(){}
@@ -4,6 +4,7 @@
 #include "AutoInjectable.h"
 #include "AutoPacketFactory.h"
 #include "BoltBase.h"
+#include "ContextEnumerator.h"
 #include "CoreThread.h"
 #include "demangle.h"
 #include "GlobalCoreContext.h"
@@ -330,6 +331,62 @@ std::vector<std::shared_ptr<BasicThread>> CoreContext::CopyBasicThreadList(void)
   return retVal;
 }
 
+std::vector<DispatchQueueStats> CoreContext::GetDispatchQueueStats(void) const {
+  std::vector<DispatchQueueStats> retVal;
+
+  // Enumeration outside of the lock is safe for the same reasons as in CopyBasicThreadList
+  for(CoreRunnable* q : m_threads) {
+    DispatchQueue* queue = dynamic_cast<DispatchQueue*>(q);
+    if(!queue)
+      continue;
+
+    retVal.push_back(queue->GetStats());
+
+    // Prefer the name the queue was given, falling back to its concrete type
+    ContextMember* member = dynamic_cast<ContextMember*>(q);
+    retVal.back().name =
+      member && member->GetName() ?
+      member->GetName() :
+      autowiring::demangle(typeid(*q));
+  }
+  return retVal;
+}
+
+void CoreContext::SetEventsInstrumented(bool instrumented) {
+  // Peer contexts share a junction box manager, there is no harm in visiting it twice
+  for(const auto& ctxt : ContextEnumerator(shared_from_this()))
+    ctxt->m_junctionBoxManager->SetInstrumented(instrumented);
+}
+
+std::vector<EventStats> CoreContext::GetEventStats(void) {
+  std::vector<EventStats> retVal;
+  std::unordered_set<JunctionBoxManager*> visited;
+  for(const auto& ctxt : ContextEnumerator(shared_from_this()))
+    // Peer contexts share a junction box manager, which must only be counted once
+    if(visited.insert(ctxt->m_junctionBoxManager.get()).second)
+      ctxt->m_junctionBoxManager->GetStats(retVal);
+  return retVal;
+}
+
+void CoreContext::SetThreadScheduling(const ThreadScheduling& scheduling) {
+  auto value = std::make_shared<ThreadScheduling>(scheduling);
+  std::lock_guard<std::mutex> lk(m_stateBlock->m_lock);
+  m_threadScheduling = value;
+}
+
+ThreadScheduling CoreContext::GetThreadScheduling(void) const {
+  for(const CoreContext* cur = this; cur; cur = cur->m_pParent.get()) {
+    std::shared_ptr<const ThreadScheduling> value;
+    {
+      std::lock_guard<std::mutex> lk(cur->m_stateBlock->m_lock);
+      value = cur->m_threadScheduling;
+    }
+    if(value)
+      return *value;
+  }
+  return ThreadScheduling();
+}
+
 void CoreContext::Initiate(void) {
   // First-pass check, used to prevent recursive deadlocks traceable to here that might
   // result from entities trying to initiate subcontexts from CoreRunnable::Start
@@ -3,6 +3,9 @@
 #include "CoreJob.h"
 #include "CoreContext.h"
 
+// The most events a single burst will dispatch before yielding its executor thread to other jobs
+static const size_t c_maxBurstEvents = 64;
+
 CoreJob::CoreJob(const char* name) :
   ContextMember(name),
   m_running(false),
@@ -27,42 +30,57 @@ void CoreJob::OnPended(std::unique_lock<std::mutex>&& lk){
     // We're currently signalled to stop, we must empty the queue and then
     // return here--we can't accept dispatch delivery on a stopped queue.
     while(!m_dispatchQueue.empty()) {
-      delete m_dispatchQueue.front();
+      ReleaseUnsafe(m_dispatchQueue.front());
       m_dispatchQueue.pop_front();
+      SignalSpaceAvailableUnsafe();
     }
   else {
-    // Need to ask the thread pool to handle our events again:
+    // Need to ask the thread pool to handle our events again.  Only one burst is ever in flight, so
+    // we remain a single consumer of our own queue.
     m_curEventInTeardown = false;
-    m_curEvent = std::async(
-      std::launch::async,
-      [this, outstanding] () mutable {
-        this->DispatchAllAndClearCurrent();
-        outstanding.reset();
-      }
-    );
+    SubmitBurst(std::move(outstanding));
   }
 }
 
-void CoreJob::DispatchAllAndClearCurrent(void) {
+void CoreJob::SubmitBurst(std::shared_ptr<Object> outstanding) {
+  m_executor->Submit(
+    [this, outstanding] () mutable {
+      if(this->DispatchBurst())
+        // More work is waiting, go to the back of the executor's queue so other jobs get a turn
+        this->SubmitBurst(std::move(outstanding));
+      outstanding.reset();
+    }
+  );
+}
+
+bool CoreJob::DispatchBurst(void) {
   CurrentContextPusher pshr(GetContext());
-  for(;;) {
-    // Trivially run down the queue as long as we're in the pool:
-    this->DispatchAllEvents();
-
-    // Check the size of the queue.  Could be that someone added something
-    // between when we finished looping, and when we obtained the lock, and
-    // we don't want to exit our pool if that has happened.
-    std::lock_guard<std::mutex> lk(m_dispatchLock);
-    if(AreAnyDispatchersReady())
-      continue;
-
-    // Indicate that we're tearing down and will be done very soon.  This is
-    // a signal to consumers that a call to m_curEvent.wait() will be nearly
-    // non-blocking.
-    m_curEventInTeardown = true;
-    m_queueUpdated.notify_all();
-    break;
+  for(size_t nRemaining = c_maxBurstEvents; nRemaining;) {
+    // Exceptions are discarded, as they were when each burst had its own future, but the rest of the
+    // queue is still run.  Every event that ran counts against the burst, including one which threw.
+    size_t nDispatched = 0;
+    try {
+      std::unique_lock<std::mutex> lk(m_dispatchLock);
+      DispatchBatchUnsafe(lk, nRemaining, &nDispatched);
+      if(!nDispatched)
+        break;
+    }
+    catch(...) {}
+    nRemaining -= nDispatched;
   }
+
+  // Check the size of the queue.  Could be that someone added something
+  // between when we finished looping, and when we obtained the lock, or
+  // that the burst ran out before the queue did.
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  if(AreAnyDispatchersReady())
+    return true;
+
+  // Indicate that this burst is over.  We must not touch any members after
+  // the lock is released, a waiter may destroy us as soon as it's able to.
+  m_curEventInTeardown = true;
+  SignalDrainedUnsafe();
+  return false;
 }
 
 bool CoreJob::Start(std::shared_ptr<Object> outstanding) {
@@ -70,6 +88,9 @@ bool CoreJob::Start(std::shared_ptr<Object> outstanding) {
   if(!context)
     return false;
 
+  // Use an executor that our context provides, if there is one, otherwise share the default
+  m_executor = m_contextExecutor ? m_contextExecutor : CoreJobExecutor::GetDefault();
+
   m_outstanding = outstanding;
   m_running = true;
 
@@ -102,29 +123,27 @@ void CoreJob::Stop(bool graceful) {
   // Hit our condition variable to wake up any listeners:
   std::lock_guard<std::mutex> lk(m_dispatchLock);
   m_shouldStop = true;
-  m_queueUpdated.notify_all();
+  SignalDrainedUnsafe();
 }
 
 void CoreJob::Wait() {
   {
     std::unique_lock<std::mutex> lk(m_dispatchLock);
-    m_queueUpdated.wait(
+    WaiterCount waiting(m_nDrainWaiters);
+    m_queueDrained.wait(
       lk,
       [this] {
         return ShouldStop() && m_curEventInTeardown;
       }
     );
   }
-
-  // If the current event is valid, we can block on it until it becomes valid:
-  if(m_curEvent.valid())
-    m_curEvent.wait();
 }
 
 bool CoreJob::WaitFor(std::chrono::nanoseconds duration) {
   {
     std::unique_lock<std::mutex> lk(m_dispatchLock);
-    if(!m_queueUpdated.wait_for(
+    WaiterCount waiting(m_nDrainWaiters);
+    if(!m_queueDrained.wait_for(
       lk,
       duration,
       [this] {
@@ -133,9 +152,5 @@ bool CoreJob::WaitFor(std::chrono::nanoseconds duration) {
     ))
       return false;
   }
-
-  // If the current event is valid, we can block on it until it becomes valid:
-  if(m_curEvent.valid())
-    m_curEvent.wait();
   return true;
 }
\ No newline at end of file
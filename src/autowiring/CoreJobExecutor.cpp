@@ -0,0 +1,133 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "CoreJobExecutor.h"
+#include <algorithm>
+#include <deque>
+#include CHRONO_HEADER
+#include MUTEX_HEADER
+#include THREAD_HEADER
+
+// Idle threads exit after this long without work
+static const std::chrono::seconds c_idleTimeout(10);
+
+struct CoreJobExecutor::State {
+  State(size_t maxThreads) :
+    maxThreads(maxThreads),
+    nThreads(0),
+    nIdle(0),
+    released(false)
+  {}
+
+  std::mutex lock;
+  std::condition_variable workAvailable;
+  std::deque<std::function<void()>> queue;
+
+  size_t maxThreads;
+  size_t nThreads;
+  size_t nIdle;
+
+  // Set when the owning executor is destroyed, threads exit as soon as the queue is empty
+  bool released;
+};
+
+CoreJobExecutor::CoreJobExecutor(size_t maxThreads) :
+  m_state(std::make_shared<State>(maxThreads ? maxThreads : DefaultMaxThreads()))
+{}
+
+CoreJobExecutor::~CoreJobExecutor(void) {
+  std::lock_guard<std::mutex> lk(m_state->lock);
+  m_state->released = true;
+  m_state->workAvailable.notify_all();
+}
+
+size_t CoreJobExecutor::DefaultMaxThreads(void) {
+  return std::max<size_t>(8, 2 * std::thread::hardware_concurrency());
+}
+
+std::shared_ptr<CoreJobExecutor> CoreJobExecutor::GetDefault(void) {
+  // Never destroyed, jobs may still be running during static teardown
+  static std::shared_ptr<CoreJobExecutor>* s_default = new std::shared_ptr<CoreJobExecutor>(new CoreJobExecutor);
+  return *s_default;
+}
+
+size_t CoreJobExecutor::GetMaxThreads(void) const {
+  std::lock_guard<std::mutex> lk(m_state->lock);
+  return m_state->maxThreads;
+}
+
+void CoreJobExecutor::SetMaxThreads(size_t maxThreads) {
+  std::lock_guard<std::mutex> lk(m_state->lock);
+  m_state->maxThreads = maxThreads ? maxThreads : 1;
+}
+
+size_t CoreJobExecutor::GetThreadCount(void) const {
+  std::lock_guard<std::mutex> lk(m_state->lock);
+  return m_state->nThreads;
+}
+
+void CoreJobExecutor::Submit(std::function<void()>&& fn) {
+  std::lock_guard<std::mutex> lk(m_state->lock);
+  m_state->queue.push_back(std::move(fn));
+
+  if(m_state->queue.size() <= m_state->nIdle) {
+    // Someone is already waiting for this
+    m_state->workAvailable.notify_one();
+    return;
+  }
+
+  if(m_state->nThreads >= m_state->maxThreads)
+    // Work will be picked up when one of the existing threads finishes what it's doing
+    return;
+
+  std::shared_ptr<State> state = m_state;
+  std::thread thread;
+  try {
+    thread = std::thread(
+      [state] {
+        std::unique_lock<std::mutex> lk(state->lock);
+        for(;;) {
+          if(state->queue.empty()) {
+            state->nIdle++;
+            state->workAvailable.wait_for(
+              lk,
+              c_idleTimeout,
+              [&state] { return !state->queue.empty() || state->released; }
+            );
+            state->nIdle--;
+          }
+
+          if(state->queue.empty() || state->nThreads > state->maxThreads)
+            // Idle for too long, released, or surplus to a reduced bound
+            break;
+
+          std::function<void()> fn = std::move(state->queue.front());
+          state->queue.pop_front();
+          lk.unlock();
+          try {
+            fn();
+          }
+          catch(...) {
+            // Nobody to report this to, submitters are responsible for their own exception handling
+          }
+          fn = nullptr;
+          lk.lock();
+        }
+        state->nThreads--;
+      }
+    );
+  }
+  catch(...) {
+    if(!m_state->nThreads) {
+      // Nobody is left to run this, hand it back to the caller
+      m_state->queue.pop_back();
+      throw;
+    }
+
+    // One of the existing threads will get to it eventually
+    return;
+  }
+
+  // The new thread cannot observe this count until we release the lock
+  m_state->nThreads++;
+  thread.detach();
+}
@@ -3,11 +3,151 @@
 #include "CoreThread.h"
 #include "Autowired.h"
 #include "BasicThreadStateBlock.h"
+#include THREAD_HEADER
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/// <summary>
+/// Hints to the processor that the caller is busy-waiting
+/// </summary>
+static inline void CpuRelax(void) {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+  _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#endif
+}
 
 CoreThread::CoreThread(const char* pName):
-  BasicThread(pName)
+  BasicThread(pName),
+  m_arrivalInterval(std::chrono::nanoseconds::zero())
 {}
 
+void CoreThread::SetWaitStrategy(const CoreThreadWaitStrategy& strategy) {
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  m_waitStrategy = strategy;
+  m_arrivalInterval = std::chrono::nanoseconds::zero();
+}
+
+CoreThreadWaitStrategy CoreThread::GetWaitStrategy(void) {
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  return m_waitStrategy;
+}
+
+void CoreThread::SpinUnsafe(std::unique_lock<std::mutex>& lk, std::chrono::steady_clock::time_point wakeTime) {
+  const CoreThreadWaitStrategy strategy = m_waitStrategy;
+  if(strategy.adaptive && m_arrivalInterval > strategy.spinFor + strategy.yieldFor)
+    // Work has not been arriving quickly enough lately for spinning to pay off
+    return;
+
+  auto now = std::chrono::steady_clock::now();
+  auto spinUntil = std::min(wakeTime, now + strategy.spinFor);
+  auto yieldUntil = std::min(wakeTime, spinUntil + strategy.yieldFor);
+
+  // Only the first spinner clears the signal, otherwise we could hide an arrival from a spinner who
+  // is already running
+  if(!m_nSpinners++)
+    m_spinSignal.store(false, std::memory_order_relaxed);
+  lk.unlock();
+
+  while(!m_spinSignal.load(std::memory_order_acquire) && now < yieldUntil) {
+    if(now < spinUntil)
+      CpuRelax();
+    else
+      std::this_thread::yield();
+    now = std::chrono::steady_clock::now();
+  }
+
+  lk.lock();
+  m_nSpinners--;
+}
+
+void CoreThread::RecordArrivalUnsafe(std::chrono::steady_clock::time_point waitStart) {
+  if(!m_waitStrategy.adaptive)
+    return;
+
+  // Exponentially weighted, so that the estimate follows changes in the arrival rate within a few events
+  auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - waitStart);
+  m_arrivalInterval += (waited - m_arrivalInterval) / 8;
+}
+
+bool CoreThread::Watch(int fd, uint32_t events, std::function<void(uint32_t)> callback) {
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  if(!m_poller) {
+    m_poller.reset(DispatchPoller::New());
+    if(!m_poller)
+      return false;
+
+    // Anyone parked on the condition variable has to move over to the poller
+    m_queueUpdated.notify_all();
+  }
+
+  if(!m_poller->Add(fd, events))
+    return false;
+
+  auto& watch = m_watches[fd];
+  if(watch)
+    watch->active = false;
+  watch = std::make_shared<DescriptorWatch>(std::move(callback));
+  return true;
+}
+
+bool CoreThread::Unwatch(int fd) {
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  auto q = m_watches.find(fd);
+  if(q == m_watches.end())
+    return false;
+
+  q->second->active = false;
+  m_poller->Remove(fd);
+  m_watches.erase(q);
+  return true;
+}
+
+void CoreThread::PollUnsafe(std::unique_lock<std::mutex>& lk, std::chrono::steady_clock::time_point wakeTime) {
+  std::vector<std::pair<int, uint32_t>> ready;
+  auto wait = [&] {
+    lk.unlock();
+    m_poller->Wait(wakeTime, ready);
+    lk.lock();
+  };
+
+  if(wakeTime == std::chrono::steady_clock::time_point::min())
+    // Just checking, there is no need for producers to wake us
+    wait();
+  else {
+    WorkWaiter waiting(*this, wakeTime, true);
+    wait();
+  }
+
+  if(m_aborted)
+    return;
+
+  for(const auto& entry : ready) {
+    auto q = m_watches.find(entry.first);
+    if(q == m_watches.end() || q->second->queued.exchange(true))
+      // Unwatched while we were waiting, or the callback is already on its way
+      continue;
+
+    std::shared_ptr<DescriptorWatch> watch = q->second;
+    uint32_t events = entry.second;
+    PushReadyUnsafe(NewThunkUnsafe([watch, events] {
+      // Cleared first, the descriptor may become ready again while the callback runs
+      watch->queued = false;
+      if(watch->active)
+        watch->callback(events);
+    }));
+  }
+}
+
+void CoreThread::WakeExternalWaiters(void) {
+  m_poller->Wake();
+}
+
 void CoreThread::DoRunLoopCleanup(std::shared_ptr<CoreContext>&& ctxt, std::shared_ptr<Object>&& refTracker) {
   try {
     // If we are asked to rundown while we still have elements in our dispatch queue,
@@ -29,26 +169,49 @@ void CoreThread::WaitForEvent(void) {
   if(m_aborted)
     throw dispatch_aborted_exception();
 
+  if(m_poller) {
+    // Watched descriptors are only serviced by the timed variant
+    WaitForEventUnsafe(lk, std::chrono::steady_clock::time_point::max());
+    return;
+  }
+
+  // Give work a chance to arrive before we park, unless there are timers, which the timed variant handles
+  std::chrono::steady_clock::time_point waitStart;
+  if(m_dispatchQueue.empty() && m_timers.Empty() && !m_waitStrategy.IsBlocking()) {
+    waitStart = std::chrono::steady_clock::now();
+    SpinUnsafe(lk, std::chrono::steady_clock::time_point::max());
+  }
+
   // Unconditional delay:
-  m_queueUpdated.wait(lk, [this] () -> bool {
-    if(m_aborted)
-      throw dispatch_aborted_exception();
+  {
+    WorkWaiter waiting(*this, std::chrono::steady_clock::time_point::max());
+    m_queueUpdated.wait(lk, [this] () -> bool {
+      if(m_aborted)
+        throw dispatch_aborted_exception();
+
+      return
+      // We will need to transition out if the delay queue receives any items:
+      !this->m_timers.Empty() ||
 
-    return
-    // We will need to transition out if the delay queue receives any items:
-    !this->m_delayedQueue.empty() ||
+      // Or if someone starts watching descriptors, we must block in the poller instead:
+      this->m_poller ||
 
-    // We also transition out if the dispatch queue has any events:
-    !this->m_dispatchQueue.empty();
-  });
+      // We also transition out if the dispatch queue has any events:
+      !this->m_dispatchQueue.empty();
+    });
+  }
 
   if(m_dispatchQueue.empty())
     // The delay queue has items but the dispatch queue does not, we need to switch
     // to the suggested sleep timeout variant:
-    WaitForEventUnsafe(lk, m_delayedQueue.top().GetReadyTime());
-  else
+    WaitForEventUnsafe(lk, std::chrono::steady_clock::time_point::max());
+  else {
+    if(waitStart != std::chrono::steady_clock::time_point())
+      RecordArrivalUnsafe(waitStart);
+
     // We have an event, we can just hop over to this variant:
-    DispatchEventUnsafe(lk);
+    DispatchBatchUnsafe(lk, m_dispatchBatchSize);
+  }
 }
 
 bool CoreThread::WaitForEvent(std::chrono::milliseconds milliseconds) {
@@ -68,13 +231,39 @@ bool CoreThread::WaitForEventUnsafe(std::unique_lock<std::mutex>& lk, std::chron
   if(m_aborted)
     throw dispatch_aborted_exception();
 
+  if(m_poller && !m_dispatchQueue.empty()) {
+    // Check descriptors even when there is work waiting, otherwise a busy queue would starve them
+    PollUnsafe(lk, std::chrono::steady_clock::time_point::min());
+    if(m_aborted)
+      throw dispatch_aborted_exception();
+  }
+
+  // Threads which watch descriptors block in the poller right away, spinning would delay their I/O
+  std::chrono::steady_clock::time_point waitStart;
+  if(m_dispatchQueue.empty() && !m_poller && !m_waitStrategy.IsBlocking()) {
+    waitStart = std::chrono::steady_clock::now();
+    SpinUnsafe(lk, SuggestSoonestWakeupTimeUnsafe(wakeTime));
+    if(m_aborted)
+      throw dispatch_aborted_exception();
+    PromoteReadyEventsUnsafe();
+  }
+
   while(m_dispatchQueue.empty()) {
-    // Derive a wakeup time using the high precision timer:
-    wakeTime = SuggestSoonestWakeupTimeUnsafe(wakeTime);
+    // Derive a wakeup time using the high precision timer.  This may be earlier than any delayed
+    // event's ready time, the timing wheel sometimes needs attention before anything is ready.
+    auto wakeup = SuggestSoonestWakeupTimeUnsafe(wakeTime);
 
     // Now we wait, either for the timeout to elapse or for the dispatch queue itself to
     // transition to the "aborted" state.
-    std::cv_status status = m_queueUpdated.wait_until(lk, wakeTime);
+    std::cv_status status;
+    if(m_poller) {
+      PollUnsafe(lk, wakeup);
+      status = std::chrono::steady_clock::now() < wakeup ? std::cv_status::no_timeout : std::cv_status::timeout;
+    }
+    else {
+      WorkWaiter waiting(*this, wakeup);
+      status = m_queueUpdated.wait_until(lk, wakeup);
+    }
 
     // Short-circuit if the queue was aborted
     if(m_aborted)
@@ -87,12 +276,14 @@ bool CoreThread::WaitForEventUnsafe(std::unique_lock<std::mutex>& lk, std::chron
     if(!m_dispatchQueue.empty())
       break;
 
-    if(status == std::cv_status::timeout)
+    if(status == std::cv_status::timeout && wakeup == wakeTime)
       // Can't proceed, queue is empty and nobody is ready to be run
       return false;
   }
 
-  DispatchEventUnsafe(lk);
+  if(waitStart != std::chrono::steady_clock::time_point())
+    RecordArrivalUnsafe(waitStart);
+  DispatchBatchUnsafe(lk, m_dispatchBatchSize);
   return true;
 }
 
@@ -3,7 +3,14 @@
 #include "BasicThread.h"
 #include "BasicThreadStateBlock.h"
 #include <pthread.h>
+#include <sched.h>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 #include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 using std::chrono::seconds;
 using std::chrono::milliseconds;
@@ -13,13 +20,228 @@ void BasicThread::SetCurrentThreadName(void) const {
   pthread_setname_np(pthread_self(), m_name);
 }
 
+void BasicThread::RecordThreadStart(void) {
+  m_state->m_startTime = std::chrono::steady_clock::now();
+  m_state->m_kernelThreadId = syscall(SYS_gettid);
+}
+
 std::chrono::steady_clock::time_point BasicThread::GetCreationTime(void) {
-  return std::chrono::steady_clock::time_point::min();
+  std::lock_guard<std::mutex> lk(m_state->m_lock);
+  return m_state->m_startTime;
+}
+
+/// <summary>
+/// Reads the user and kernel times of the specified thread in this process, in clock ticks
+/// </summary>
+static bool GetTaskTicks(int64_t tid, uint64_t& utime, uint64_t& stime) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/task/%lld/stat", (long long)tid);
+  FILE* pFile = fopen(path, "r");
+  if(!pFile)
+    return false;
+
+  char buf[1024];
+  size_t n = fread(buf, 1, sizeof(buf) - 1, pFile);
+  fclose(pFile);
+  buf[n] = 0;
+
+  // The thread name is parenthesized and may itself contain spaces and parentheses, so we skip past the
+  // last closing parenthesis.  The fields that follow begin with the third field, state, and the times are
+  // the fourteenth and fifteenth fields.
+  const char* p = strrchr(buf, ')');
+  return p && sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %" SCNu64 " %" SCNu64, &utime, &stime) == 2;
+}
+
+/// <summary>
+/// Obtains the kernel and user times of a running thread
+/// </summary>
+static void GetThreadTimesUnsafe(pthread_t thread, int64_t tid, std::chrono::nanoseconds& kernelTime, std::chrono::nanoseconds& userTime) {
+  kernelTime = userTime = std::chrono::nanoseconds::zero();
+
+  // The thread's processor clock gives us an exact total, but the split between user and kernel time is
+  // only available at the resolution of the scheduler tick.  Apportion the exact total according to the
+  // sampled split.
+  clockid_t clock;
+  timespec ts;
+  if(pthread_getcpuclockid(thread, &clock) || clock_gettime(clock, &ts))
+    return;
+  std::chrono::nanoseconds total = seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+
+  uint64_t utime, stime;
+  if(!GetTaskTicks(tid, utime, stime) || !(utime + stime)) {
+    userTime = total;
+    return;
+  }
+  kernelTime = std::chrono::nanoseconds((int64_t)(total.count() * ((double)stime / (utime + stime))));
+  userTime = total - kernelTime;
 }
 
 void BasicThread::GetThreadTimes(std::chrono::milliseconds& kernelTime, std::chrono::milliseconds& userTime) {
-  rusage usage;
-  getrusage(RUSAGE_SELF, &usage);
-  kernelTime = std::chrono::duration_cast<milliseconds>(seconds(usage.ru_stime.tv_sec) + microseconds(usage.ru_stime.tv_usec));
-  userTime = std::chrono::duration_cast<milliseconds>(seconds(usage.ru_utime.tv_sec) + microseconds(usage.ru_utime.tv_usec));
+  std::chrono::nanoseconds kernel(0), user(0);
+  {
+    std::lock_guard<std::mutex> lk(m_state->m_lock);
+    if(m_running && m_state->m_kernelThreadId)
+      GetThreadTimesUnsafe(m_state->m_thisThread.native_handle(), m_state->m_kernelThreadId, kernel, user);
+  }
+  kernelTime = std::chrono::duration_cast<milliseconds>(kernel);
+  userTime = std::chrono::duration_cast<milliseconds>(user);
+}
+
+bool BasicThread::GetThreadStatistics(BasicThreadStatistics& statistics) {
+  std::lock_guard<std::mutex> lk(m_state->m_lock);
+  if(!m_running || !m_state->m_kernelThreadId)
+    return false;
+
+  const int64_t tid = m_state->m_kernelThreadId;
+  statistics.startTime = m_state->m_startTime;
+  GetThreadTimesUnsafe(m_state->m_thisThread.native_handle(), tid, statistics.kernelTime, statistics.userTime);
+
+  // Scheduler statistics give the time spent on the run queue, in nanoseconds, as the second field
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/task/%lld/schedstat", (long long)tid);
+  if(FILE* pFile = fopen(path, "r")) {
+    uint64_t runTime, waitTime;
+    if(fscanf(pFile, "%" SCNu64 " %" SCNu64, &runTime, &waitTime) == 2)
+      statistics.runQueueWait = std::chrono::nanoseconds(waitTime);
+    fclose(pFile);
+  }
+
+  snprintf(path, sizeof(path), "/proc/self/task/%lld/status", (long long)tid);
+  if(FILE* pFile = fopen(path, "r")) {
+    char line[256];
+    while(fgets(line, sizeof(line), pFile)) {
+      uint64_t value;
+      if(sscanf(line, "voluntary_ctxt_switches: %" SCNu64, &value) == 1)
+        statistics.voluntaryContextSwitches = value;
+      else if(sscanf(line, "nonvoluntary_ctxt_switches: %" SCNu64, &value) == 1)
+        statistics.involuntaryContextSwitches = value;
+    }
+    fclose(pFile);
+  }
+  return true;
+}
+
+/// <summary>
+/// Reads the set of processors which belong to the specified NUMA node
+/// </summary>
+/// <returns>False if the node does not exist</returns>
+static bool GetNumaNodeCpus(int node, cpu_set_t& cpus) {
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  FILE* pFile = fopen(path, "r");
+  if(!pFile)
+    return false;
+
+  // The list is a comma-delimited series of processor indices and ranges, such as "0-3,8-11"
+  CPU_ZERO(&cpus);
+  int first, last;
+  while(fscanf(pFile, "%d", &first) == 1) {
+    last = first;
+    int delim = fgetc(pFile);
+    if(delim == '-') {
+      if(fscanf(pFile, "%d", &last) != 1)
+        break;
+      delim = fgetc(pFile);
+    }
+    for(int i = first; i <= last && i < CPU_SETSIZE; i++)
+      CPU_SET(i, &cpus);
+    if(delim != ',')
+      break;
+  }
+  fclose(pFile);
+  return true;
+}
+
+/// <summary>
+/// The processors this process was allowed to run on when it was loaded
+/// </summary>
+/// <remarks>
+/// Captured during static initialization, before main has a chance to pin its own thread.  The affinity of
+/// the process id is that of the main thread alone, so it cannot be used in place of this later on.
+/// </remarks>
+static const cpu_set_t s_processCpus = [] {
+  cpu_set_t cpus;
+  if(sched_getaffinity(0, sizeof(cpus), &cpus)) {
+    CPU_ZERO(&cpus);
+    long nCpus = sysconf(_SC_NPROCESSORS_CONF);
+    for(long i = 0; i < nCpus && i < CPU_SETSIZE; i++)
+      CPU_SET(i, &cpus);
+  }
+  return cpus;
+}();
+
+bool BasicThread::ApplyThreadScheduling(const ThreadScheduling& scheduling) {
+  pthread_t thread = m_state->m_thisThread.native_handle();
+  bool retVal = true;
+
+  // Start from the processors available to the process as a whole, and narrow from there:
+  cpu_set_t cpus = s_processCpus;
+
+  if(!scheduling.cpus.empty()) {
+    cpu_set_t requested;
+    CPU_ZERO(&requested);
+    for(int cpu : scheduling.cpus)
+      if(0 <= cpu && cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &requested);
+    CPU_AND(&cpus, &cpus, &requested);
+  }
+
+  if(scheduling.numaNode >= 0) {
+    cpu_set_t node;
+    if(GetNumaNodeCpus(scheduling.numaNode, node))
+      CPU_AND(&cpus, &cpus, &node);
+    else
+      retVal = false;
+  }
+
+  if(!CPU_COUNT(&cpus) || pthread_setaffinity_np(thread, sizeof(cpus), &cpus))
+    retVal = false;
+
+  sched_param param = {};
+  int policy;
+  switch(scheduling.policy) {
+  case ThreadSchedulingPolicy::Fifo:
+    policy = SCHED_FIFO;
+    param.sched_priority = scheduling.realtimePriority;
+    break;
+  case ThreadSchedulingPolicy::RoundRobin:
+    policy = SCHED_RR;
+    param.sched_priority = scheduling.realtimePriority;
+    break;
+  default:
+    policy = SCHED_OTHER;
+    break;
+  }
+  if(pthread_setschedparam(thread, policy, &param))
+    retVal = false;
+  return retVal;
+}
+
+void BasicThread::QueryThreadScheduling(ThreadScheduling& scheduling) {
+  pthread_t thread = m_state->m_thisThread.native_handle();
+
+  cpu_set_t cpus;
+  if(!pthread_getaffinity_np(thread, sizeof(cpus), &cpus)) {
+    scheduling.cpus.clear();
+    for(int i = 0; i < CPU_SETSIZE; i++)
+      if(CPU_ISSET(i, &cpus))
+        scheduling.cpus.push_back(i);
+  }
+
+  int policy;
+  sched_param param;
+  if(!pthread_getschedparam(thread, &policy, &param)) {
+    switch(policy) {
+    case SCHED_FIFO:
+      scheduling.policy = ThreadSchedulingPolicy::Fifo;
+      break;
+    case SCHED_RR:
+      scheduling.policy = ThreadSchedulingPolicy::RoundRobin;
+      break;
+    default:
+      scheduling.policy = ThreadSchedulingPolicy::Default;
+      break;
+    }
+    scheduling.realtimePriority = param.sched_priority;
+  }
 }
@@ -2,6 +2,7 @@
 #include "stdafx.h"
 #include "BasicThread.h"
 #include "BasicThreadStateBlock.h"
+#include "DispatchPoller.h"
 #include <pthread.h>
 #include <libproc.h>
 #include <mach/thread_info.h>
@@ -20,8 +21,13 @@ void BasicThread::SetCurrentThreadName(void) const {
   pthread_setname_np(m_name);
 }
 
+void BasicThread::RecordThreadStart(void) {
+  m_state->m_startTime = std::chrono::steady_clock::now();
+}
+
 std::chrono::steady_clock::time_point BasicThread::GetCreationTime(void) {
-  return std::chrono::steady_clock::time_point::min();
+  std::lock_guard<std::mutex> lk(m_state->m_lock);
+  return m_state->m_startTime;
 }
 
 void BasicThread::GetThreadTimes(std::chrono::milliseconds& kernelTime, std::chrono::milliseconds& userTime) {
@@ -41,4 +47,71 @@ void BasicThread::GetThreadTimes(std::chrono::milliseconds& kernelTime, std::chr
   // User time is in ns increments
   kernelTime = std::chrono::duration_cast<milliseconds>(nanoseconds(info.pth_system_time));
   userTime = std::chrono::duration_cast<milliseconds>(nanoseconds(info.pth_user_time));
-}
\ No newline at end of file
+}
+
+bool BasicThread::ApplyThreadScheduling(const ThreadScheduling& scheduling) {
+  // The Mach scheduler only accepts affinity hints, it has no way to pin a thread to a processor
+  bool retVal = scheduling.cpus.empty() && scheduling.numaNode < 0;
+
+  sched_param param = {};
+  int policy;
+  switch(scheduling.policy) {
+  case ThreadSchedulingPolicy::Fifo:
+    policy = SCHED_FIFO;
+    param.sched_priority = scheduling.realtimePriority;
+    break;
+  case ThreadSchedulingPolicy::RoundRobin:
+    policy = SCHED_RR;
+    param.sched_priority = scheduling.realtimePriority;
+    break;
+  default:
+    // Time-sharing threads are created at the midpoint of the time-sharing priority band
+    policy = SCHED_OTHER;
+    param.sched_priority = (sched_get_priority_min(SCHED_OTHER) + sched_get_priority_max(SCHED_OTHER)) / 2;
+    break;
+  }
+  if(pthread_setschedparam(m_state->m_thisThread.native_handle(), policy, &param))
+    retVal = false;
+  return retVal;
+}
+
+void BasicThread::QueryThreadScheduling(ThreadScheduling& scheduling) {
+  int policy;
+  sched_param param;
+  if(pthread_getschedparam(m_state->m_thisThread.native_handle(), &policy, &param))
+    return;
+
+  switch(policy) {
+  case SCHED_FIFO:
+    scheduling.policy = ThreadSchedulingPolicy::Fifo;
+    break;
+  case SCHED_RR:
+    scheduling.policy = ThreadSchedulingPolicy::RoundRobin;
+    break;
+  default:
+    scheduling.policy = ThreadSchedulingPolicy::Default;
+    break;
+  }
+  scheduling.realtimePriority = param.sched_priority;
+}
+
+bool BasicThread::GetThreadStatistics(BasicThreadStatistics& statistics) {
+  std::chrono::milliseconds kernelTime, userTime;
+  {
+    std::lock_guard<std::mutex> lk(m_state->m_lock);
+    if(!m_running)
+      return false;
+    statistics.startTime = m_state->m_startTime;
+  }
+
+  // Mach does not report run queue delay or context switches for individual threads
+  GetThreadTimes(kernelTime, userTime);
+  statistics.kernelTime = kernelTime;
+  statistics.userTime = userTime;
+  return true;
+}
+
+DispatchPoller* DispatchPoller::New(void) {
+  // Descriptor polling is not yet supported on this platform
+  return nullptr;
+}
@@ -0,0 +1,248 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "CoreThreadPool.h"
+#include "CoreContext.h"
+#include <algorithm>
+#include THREAD_HEADER
+
+// Workers are owned by their pool, the thread-specific pointer only refers to them
+autowiring::thread_specific_ptr<CoreThreadPool::Worker> CoreThreadPool::s_currentWorker([](Worker*) {});
+
+CoreThreadPool::CoreThreadPool(size_t nWorkers, const char* name) :
+  ContextMember(name),
+  m_nIdle(0),
+  m_nShared(0),
+  m_nPending(0),
+  m_nextWorker(0),
+  m_nSteals(0),
+  m_nRunning(0),
+  m_running(false),
+  m_shouldStop(false),
+  m_aborted(false)
+{
+  if(!nWorkers)
+    nWorkers = std::max(std::thread::hardware_concurrency(), 1U);
+
+  for(size_t i = 0; i < nWorkers; i++)
+    m_workers.push_back(std::unique_ptr<Worker>(new Worker(this, i)));
+}
+
+CoreThreadPool::~CoreThreadPool(void) {
+  // Nothing here is synchronized, all of our workers have exited by the time we are destroyed
+  for(auto& worker : m_workers) {
+    for(DispatchThunkBase* thunk : worker->shared)
+      thunk->Release();
+    for(DispatchThunkBase* thunk : worker->pinned)
+      thunk->Release();
+  }
+}
+
+CoreThreadPool::Worker* CoreThreadPool::SelectWorker(void) {
+  if(m_aborted)
+    return nullptr;
+
+  // Keep work that our own workers generate local, it will be stolen if the worker is busy
+  Worker* pCurrent = s_currentWorker.get();
+  if(pCurrent && pCurrent->pPool == this)
+    return pCurrent;
+  return m_workers[m_nextWorker++ % m_workers.size()].get();
+}
+
+CoreThreadPool::Worker* CoreThreadPool::SelectWorker(size_t affinityKey) {
+  if(m_aborted)
+    return nullptr;
+  return m_workers[affinityKey % m_workers.size()].get();
+}
+
+void CoreThreadPool::OnPended(Worker& worker, bool pinned) {
+  if(!m_nIdle)
+    // Everyone is busy, the lambda will be picked up without any help from us
+    return;
+
+  std::lock_guard<std::mutex> lk(m_lock);
+  if(worker.parked)
+    // The worker we just pended to is asleep, it's the best candidate
+    UnparkUnsafe(worker);
+  else if(!pinned && !m_idle.empty())
+    // Someone else can steal it
+    UnparkUnsafe(*m_workers[m_idle.back()]);
+}
+
+void CoreThreadPool::UnparkUnsafe(Worker& worker) {
+  worker.parked = false;
+  m_idle.erase(std::find(m_idle.begin(), m_idle.end(), worker.index));
+  m_nIdle--;
+  worker.wake.notify_one();
+}
+
+DispatchThunkBase* CoreThreadPool::Take(Worker& worker) {
+  DispatchThunkBase* retVal = nullptr;
+  {
+    std::lock_guard<std::mutex> lk(worker.lock);
+    if(!worker.pinned.empty()) {
+      retVal = worker.pinned.front();
+      worker.pinned.pop_front();
+      return retVal;
+    }
+    if(!worker.shared.empty()) {
+      retVal = worker.shared.front();
+      worker.shared.pop_front();
+      m_nShared--;
+      return retVal;
+    }
+  }
+
+  // Nothing local, see if anyone has something we can take.  We take from the back, the owner takes
+  // from the front, so we only contend with the owner when its queue is nearly empty.
+  for(size_t i = 1; i < m_workers.size() && m_nShared; i++) {
+    Worker& victim = *m_workers[(worker.index + i) % m_workers.size()];
+    std::lock_guard<std::mutex> lk(victim.lock);
+    if(victim.shared.empty())
+      continue;
+
+    retVal = victim.shared.back();
+    victim.shared.pop_back();
+    m_nShared--;
+    m_nSteals++;
+    return retVal;
+  }
+  return nullptr;
+}
+
+bool CoreThreadPool::Park(Worker& worker) {
+  std::unique_lock<std::mutex> lk(m_lock);
+  if(m_aborted || (m_shouldStop && !m_nPending))
+    return false;
+
+  // Advertise that we're idle before the final check, so that a producer either sees us parked or we
+  // see its lambda:
+  worker.parked = true;
+  m_idle.push_back(worker.index);
+  m_nIdle++;
+
+  bool hasPinned;
+  {
+    std::lock_guard<std::mutex> wlk(worker.lock);
+    hasPinned = !worker.pinned.empty();
+  }
+  if(hasPinned || m_nShared) {
+    UnparkUnsafe(worker);
+    return true;
+  }
+
+  worker.wake.wait(lk, [&worker] { return !worker.parked; });
+  return true;
+}
+
+void CoreThreadPool::Run(Worker& worker) {
+  s_currentWorker.reset(&worker);
+  for(;;) {
+    DispatchThunkBase* thunk = Take(worker);
+    if(!thunk) {
+      if(Park(worker))
+        continue;
+      break;
+    }
+
+    {
+      std::unique_ptr<DispatchThunkBase, DispatchThunkReleaser> ptr(thunk);
+      if(!m_aborted)
+        try {
+          (*ptr)();
+        }
+        catch(...) {
+          try {
+            // Ask that the enclosing context filter this exception, if possible:
+            GetContext()->FilterException();
+          }
+          catch(...) {
+            // Generic exception, unhandled, we can't do anything about this
+          }
+
+          // Signal shutdown on the enclosing context--cannot wait, if we wait we WILL deadlock
+          GetContext()->SignalShutdown(false);
+        }
+    }
+
+    if(!--m_nPending && m_shouldStop) {
+      // Last lambda in a graceful rundown, everyone who's parked can now exit
+      std::lock_guard<std::mutex> lk(m_lock);
+      while(!m_idle.empty())
+        UnparkUnsafe(*m_workers[m_idle.back()]);
+    }
+  }
+
+  if(m_aborted) {
+    // Anything left in our own queues will never be run
+    std::lock_guard<std::mutex> lk(worker.lock);
+    for(DispatchThunkBase* thunk : worker.shared)
+      thunk->Release();
+    for(DispatchThunkBase* thunk : worker.pinned)
+      thunk->Release();
+    m_nShared -= worker.shared.size();
+    m_nPending -= worker.shared.size() + worker.pinned.size();
+    worker.shared.clear();
+    worker.pinned.clear();
+  }
+  s_currentWorker.reset();
+}
+
+bool CoreThreadPool::Start(std::shared_ptr<Object> outstanding) {
+  std::shared_ptr<CoreContext> context = m_context.lock();
+  if(!context)
+    return false;
+
+  {
+    std::lock_guard<std::mutex> lk(m_lock);
+    if(m_running)
+      return true;
+    if(m_shouldStop)
+      return false;
+
+    m_outstanding = outstanding;
+    m_running = true;
+    m_nRunning = m_workers.size();
+  }
+
+  for(auto& worker : m_workers) {
+    Worker* pWorker = worker.get();
+    std::thread(
+      [this, pWorker, outstanding] {
+        // The context holds a reference to us, so we remain valid as long as the context is current
+        CurrentContextPusher pshr(GetContext());
+        Run(*pWorker);
+
+        std::lock_guard<std::mutex> lk(m_lock);
+        if(!--m_nRunning)
+          m_running = false;
+        m_stateCondition.notify_all();
+      }
+    ).detach();
+  }
+  return true;
+}
+
+void CoreThreadPool::Stop(bool graceful) {
+  std::lock_guard<std::mutex> lk(m_lock);
+  m_shouldStop = true;
+  if(!graceful)
+    m_aborted = true;
+
+  // Reset the outstanding pointer, our workers hold their own references:
+  m_outstanding.reset();
+
+  // Parked workers either have to exit, or find that there's still work left to do:
+  while(!m_idle.empty())
+    UnparkUnsafe(*m_workers[m_idle.back()]);
+  m_stateCondition.notify_all();
+}
+
+void CoreThreadPool::Wait(void) {
+  std::unique_lock<std::mutex> lk(m_lock);
+  m_stateCondition.wait(lk, [this] { return m_shouldStop && !m_nRunning; });
+}
+
+bool CoreThreadPool::WaitFor(std::chrono::nanoseconds duration) {
+  std::unique_lock<std::mutex> lk(m_lock);
+  return m_stateCondition.wait_for(lk, duration, [this] { return m_shouldStop && !m_nRunning; });
+}
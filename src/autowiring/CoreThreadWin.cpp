@@ -2,6 +2,7 @@
 #include "stdafx.h"
 #include "BasicThread.h"
 #include "BasicThreadStateBlock.h"
+#include "DispatchPoller.h"
 #include CHRONO_HEADER
 #include <Windows.h>
 #include <Avrt.h>
@@ -101,6 +102,11 @@ void BasicThread::SetThreadPriority(ThreadPriority threadPriority) {
   );
 }
 
+void BasicThread::RecordThreadStart(void) {
+  m_state->m_startTime = std::chrono::steady_clock::now();
+  m_state->m_kernelThreadId = ::GetCurrentThreadId();
+}
+
 std::chrono::steady_clock::time_point BasicThread::GetCreationTime(void) {
   HANDLE hThread = m_state->m_thisThread.native_handle();
   if(hThread == INVALID_HANDLE_VALUE)
@@ -126,3 +132,77 @@ void BasicThread::GetThreadTimes(std::chrono::milliseconds& kernelTime, std::chr
   kernelTime = std::chrono::duration_cast<milliseconds>(nanoseconds(100 * (int64_t&) ftKernel));
   userTime = std::chrono::duration_cast<milliseconds>(nanoseconds(100 * (int64_t&) ftUser));
 }
+
+bool BasicThread::ApplyThreadScheduling(const ThreadScheduling& scheduling) {
+  HANDLE hThread = m_state->m_thisThread.native_handle();
+  bool retVal = true;
+
+  // Start from the processors available to the process as a whole, and narrow from there:
+  DWORD_PTR processMask, systemMask;
+  if(!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+    return false;
+
+  DWORD_PTR mask = processMask;
+  if(!scheduling.cpus.empty()) {
+    DWORD_PTR requested = 0;
+    for(int cpu : scheduling.cpus)
+      if(0 <= cpu && cpu < (int)(8 * sizeof(DWORD_PTR)))
+        requested |= DWORD_PTR(1) << cpu;
+    mask &= requested;
+  }
+
+  if(scheduling.numaNode >= 0) {
+    ULONGLONG nodeMask;
+    if(GetNumaNodeProcessorMask((UCHAR)scheduling.numaNode, &nodeMask))
+      mask &= (DWORD_PTR)nodeMask;
+    else
+      retVal = false;
+  }
+
+  if(mask && SetThreadAffinityMask(hThread, mask))
+    m_state->m_affinityMask = mask;
+  else
+    retVal = false;
+
+  // Windows has no real-time scheduling policies that can be requested for a single thread
+  if(scheduling.policy != ThreadSchedulingPolicy::Default)
+    retVal = false;
+  return retVal;
+}
+
+void BasicThread::QueryThreadScheduling(ThreadScheduling& scheduling) {
+  // There is no way to read a thread's affinity mask without changing it, so report the last mask we
+  // applied.  A thread we have never pinned runs on the processors available to the process.
+  DWORD_PTR mask = (DWORD_PTR)m_state->m_affinityMask;
+  if(!mask) {
+    DWORD_PTR systemMask;
+    if(!GetProcessAffinityMask(GetCurrentProcess(), &mask, &systemMask))
+      return;
+  }
+
+  scheduling.cpus.clear();
+  for(int i = 0; i < (int)(8 * sizeof(DWORD_PTR)); i++)
+    if(mask & (DWORD_PTR(1) << i))
+      scheduling.cpus.push_back(i);
+  scheduling.policy = ThreadSchedulingPolicy::Default;
+  scheduling.realtimePriority = 0;
+}
+
+bool BasicThread::GetThreadStatistics(BasicThreadStatistics& statistics) {
+  std::lock_guard<std::mutex> lk(m_state->m_lock);
+  if(!m_running)
+    return false;
+  statistics.startTime = m_state->m_startTime;
+
+  // Windows does not report run queue delay or context switches for individual threads
+  FILETIME ftCreate, ftExit, ftKernel, ftUser;
+  ::GetThreadTimes(m_state->m_thisThread.native_handle(), &ftCreate, &ftExit, &ftKernel, &ftUser);
+  statistics.kernelTime = nanoseconds(100 * (int64_t&) ftKernel);
+  statistics.userTime = nanoseconds(100 * (int64_t&) ftUser);
+  return true;
+}
+
+DispatchPoller* DispatchPoller::New(void) {
+  // Descriptor polling is not yet supported on this platform
+  return nullptr;
+}
@@ -0,0 +1,118 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "DispatchPoller.h"
+#include <cerrno>
+#include <climits>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/// <summary>
+/// A DispatchPoller based on epoll, which is woken up by an eventfd registered alongside the watched descriptors
+/// </summary>
+class EpollDispatchPoller:
+  public DispatchPoller
+{
+public:
+  EpollDispatchPoller(int epfd, int wakefd) :
+    m_epfd(epfd),
+    m_wakefd(wakefd)
+  {}
+
+  ~EpollDispatchPoller(void) {
+    close(m_wakefd);
+    close(m_epfd);
+  }
+
+private:
+  const int m_epfd;
+  const int m_wakefd;
+
+  static uint32_t ToEpoll(uint32_t events) {
+    return
+      (events & DispatchPollReadable ? (uint32_t)EPOLLIN : 0) |
+      (events & DispatchPollWritable ? (uint32_t)EPOLLOUT : 0);
+  }
+
+  static uint32_t FromEpoll(uint32_t events) {
+    return
+      (events & EPOLLIN ? (uint32_t)DispatchPollReadable : 0) |
+      (events & EPOLLOUT ? (uint32_t)DispatchPollWritable : 0) |
+      (events & EPOLLERR ? (uint32_t)DispatchPollError : 0) |
+      (events & (EPOLLHUP | EPOLLRDHUP) ? (uint32_t)DispatchPollHangup : 0);
+  }
+
+public:
+  bool Add(int fd, uint32_t events) override {
+    epoll_event ev = {};
+    ev.events = ToEpoll(events);
+    ev.data.fd = fd;
+    return
+      !epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev) ||
+      (errno == EEXIST && !epoll_ctl(m_epfd, EPOLL_CTL_MOD, fd, &ev));
+  }
+
+  bool Remove(int fd) override {
+    // Kernels before 2.6.9 require a non-null event even though it is ignored
+    epoll_event ev = {};
+    return !epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, &ev);
+  }
+
+  void Wait(std::chrono::steady_clock::time_point wakeTime, std::vector<std::pair<int, uint32_t>>& ready) override {
+    int timeout = -1;
+    if(wakeTime != std::chrono::steady_clock::time_point::max()) {
+      auto now = std::chrono::steady_clock::now();
+      if(wakeTime <= now)
+        timeout = 0;
+      else {
+        // Round up, waking before the wake time would just cause the caller to wait again
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(wakeTime - now + std::chrono::milliseconds(1) - std::chrono::nanoseconds(1));
+        timeout = ms.count() < INT_MAX ? (int)ms.count() : INT_MAX;
+      }
+    }
+
+    epoll_event events[64];
+    int n = epoll_wait(m_epfd, events, sizeof(events) / sizeof(*events), timeout);
+    for(int i = 0; i < n; i++) {
+      // epoll_event is packed on some architectures, so its fields are copied out rather than referenced
+      int fd = events[i].data.fd;
+      if(fd == m_wakefd) {
+        // Reset the counter so the next wait blocks again
+        uint64_t count;
+        if(read(m_wakefd, &count, sizeof(count)) < 0)
+          continue;
+      }
+      else
+        ready.push_back(std::make_pair(fd, FromEpoll(events[i].events)));
+    }
+  }
+
+  void Wake(void) override {
+    // A full counter already guarantees a wakeup, so the result is of no interest
+    uint64_t one = 1;
+    if(write(m_wakefd, &one, sizeof(one)) < 0)
+      return;
+  }
+};
+
+DispatchPoller* DispatchPoller::New(void) {
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if(epfd < 0)
+    return nullptr;
+
+  int wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if(wakefd < 0) {
+    close(epfd);
+    return nullptr;
+  }
+
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = wakefd;
+  if(epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev)) {
+    close(wakefd);
+    close(epfd);
+    return nullptr;
+  }
+  return new EpollDispatchPoller(epfd, wakefd);
+}
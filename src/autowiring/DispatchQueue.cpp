@@ -5,19 +5,31 @@
 
 DispatchQueue::DispatchQueue(void):
   m_dispatchCap(1024),
+  m_overflowPolicy(DispatchOverflowPolicy::RejectNewest),
+  m_overflowTimeout(std::chrono::nanoseconds::zero()),
+  m_nDropped(0),
+  m_nEvicted(0),
+  m_nCoalesced(0),
+  m_dispatchBatchSize(1),
+  m_timers(&m_slab),
+  m_stats(nullptr),
+  m_nWorkWaiters(0),
+  m_nDrainWaiters(0),
+  m_nSpaceWaiters(0),
+  m_nExternalWaiters(0),
+  m_nWakeups(0),
+  m_nSpinners(0),
+  m_spinSignal(false),
+  m_parkedUntil(std::chrono::steady_clock::time_point::max()),
   m_aborted(false)
 {}
 
 DispatchQueue::~DispatchQueue(void) {
   // Wipe out each entry in the queue, we can't call any of them because we're in teardown
   for(DispatchThunkBase* thunk : m_dispatchQueue)
-    delete thunk;
-  
-  while (!m_delayedQueue.empty()) {
-    DispatchThunkDelayed thunk = m_delayedQueue.top();
-    thunk.Reset();
-    m_delayedQueue.pop();
-  }
+    thunk->Release();
+
+  // Delayed thunks are released by the timing wheel's own destructor
 }
 
 void DispatchQueue::Abort(void) {
@@ -27,61 +39,222 @@ void DispatchQueue::Abort(void) {
   // Do not permit any more lambdas to be pended to our queue:
   m_dispatchCap = 0;
 
-  // Destroy the whole dispatch queue:
+  // Destroy the whole dispatch queue, none of the keyed entries will be run now:
+  m_keyed.clear();
   while(!m_dispatchQueue.empty()) {
-    delete m_dispatchQueue.front();
+    m_dispatchQueue.front()->Release();
     m_dispatchQueue.pop_front();
   }
 
   // Wake up anyone who is still waiting:
+  m_spinSignal = true;
   m_queueUpdated.notify_all();
+  m_queueDrained.notify_all();
+  m_spaceAvailable.notify_all();
+  if(m_nExternalWaiters)
+    WakeExternalWaiters();
 }
 
-std::chrono::steady_clock::time_point
-DispatchQueue::SuggestSoonestWakeupTimeUnsafe(std::chrono::steady_clock::time_point latestTime) const {
-  return
-    m_delayedQueue.empty() ?
+bool DispatchQueue::AdmitUnsafe(std::unique_lock<std::mutex>& lk, bool keyed) {
+  if(m_dispatchQueue.size() < m_dispatchCap)
+    return true;
+
+  // The queue may be more than full, because a batch cut short by an exception puts its remainder back
+  // without being admitted again.  Every policy treats that the same as being exactly full, and nothing
+  // is dropped or evicted to bring the queue back under its cap.
 
-    // Nothing in the queue, no way to suggest a shorter time
-    latestTime :
+  switch(m_aborted || !m_dispatchCap ? DispatchOverflowPolicy::RejectNewest : m_overflowPolicy) {
+  case DispatchOverflowPolicy::RejectNewest:
+    break;
+  case DispatchOverflowPolicy::Coalesce:
+    if(keyed)
+      return true;
+    break;
+  case DispatchOverflowPolicy::EvictOldest:
+    ReleaseUnsafe(m_dispatchQueue.front());
+    m_dispatchQueue.pop_front();
+    m_nEvicted++;
+    return true;
+  case DispatchOverflowPolicy::Block:
+    {
+      WaiterCount waiting(m_nSpaceWaiters);
+      if(
+        m_spaceAvailable.wait_for(
+          lk,
+          m_overflowTimeout,
+          [this] { return m_aborted || m_dispatchQueue.size() < m_dispatchCap; }
+        ) &&
+        !m_aborted
+      )
+        return true;
+    }
+    break;
+  }
+
+  m_nDropped++;
+  return false;
+}
 
-    // Return the shorter of the maximum wait time and the time of the queue ready--we don't want to tell the
-    // caller to wait longer than the limit of their interest.
-    std::min(
-      m_delayedQueue.top().GetReadyTime(),
-      latestTime
-    );
+void DispatchQueue::ReleaseUnsafe(DispatchThunkBase* thunk) {
+  if(!m_keyed.empty())
+    // This might be the thunk holding a key, in which case the key must be freed for reuse
+    if(KeyedThunk* pKeyed = dynamic_cast<KeyedThunk*>(thunk))
+      m_keyed.erase(pKeyed->m_key);
+  thunk->Release();
+}
+
+void DispatchQueue::KeyedThunk::operator()(void) {
+  // Once we have claimed the held thunk, the next event pended under our key gets a new queue position
+  std::unique_ptr<DispatchThunkBase, DispatchThunkReleaser> thunk;
+  {
+    std::lock_guard<std::mutex> lk(m_queue.m_dispatchLock);
+    m_queue.m_keyed.erase(m_key);
+    thunk.reset(m_pThunk);
+    m_pThunk = nullptr;
+  }
+  (*thunk)();
+}
+
+std::chrono::steady_clock::duration DispatchQueue::GetTimerResolution(void) {
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  return m_timers.GetResolution();
+}
+
+bool DispatchQueue::SetTimerResolution(std::chrono::steady_clock::duration resolution) {
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  return m_timers.SetResolution(resolution);
+}
+
+std::chrono::steady_clock::time_point
+DispatchQueue::SuggestSoonestWakeupTimeUnsafe(std::chrono::steady_clock::time_point latestTime) const {
+  // Return the shorter of the maximum wait time and the next time the timing wheel needs attention--we
+  // don't want to tell the caller to wait longer than the limit of their interest.
+  return std::min(m_timers.NextWakeup(), latestTime);
 }
 
 void DispatchQueue::PromoteReadyEventsUnsafe(void) {
   // Move all ready elements out of the delayed queue and into the dispatch queue:
-  for(
-    auto now = std::chrono::steady_clock::now();
-    !m_delayedQueue.empty() && m_delayedQueue.top().GetReadyTime() < now;
-    m_delayedQueue.pop()
-  )
-    // This item's ready time has elapsed, we can add it to our dispatch queue now:
-    m_dispatchQueue.push_back(m_delayedQueue.top().Get());
+  auto now = std::chrono::steady_clock::now();
+  size_t nReady = m_dispatchQueue.size();
+  m_timers.PromoteReady(now, m_dispatchQueue);
+
+  if(m_stats)
+    // Promoted events become ready now, for the purposes of measuring queueing delay
+    for(size_t i = nReady; i < m_dispatchQueue.size(); i++)
+      RecordReadyUnsafe(m_dispatchQueue[i], now);
+}
+
+void DispatchQueue::SetInstrumented(bool instrumented) {
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  if(instrumented == !!m_stats)
+    return;
+
+  auto now = std::chrono::steady_clock::now();
+  if(instrumented) {
+    if(!m_statsBlock)
+      m_statsBlock.reset(new StatsBlock);
+    m_stats = m_statsBlock.get();
+    m_stats->enabledAt = now;
+  }
+  else {
+    m_stats->elapsed += now - m_stats->enabledAt;
+    m_stats = nullptr;
+  }
+}
+
+DispatchQueueStats DispatchQueue::GetStats(void) {
+  DispatchQueueStats retVal;
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  retVal.instrumented = !!m_stats;
+  retVal.depth = m_dispatchQueue.size();
+  retVal.nDropped = m_nDropped;
+  retVal.nEvicted = m_nEvicted;
+  retVal.nCoalesced = m_nCoalesced;
+  if(!m_statsBlock)
+    return retVal;
+
+  retVal.maxDepth = m_statsBlock->maxDepth;
+  retVal.nPended = m_statsBlock->nPended;
+  retVal.nDispatched = m_statsBlock->nDispatched;
+  retVal.elapsed = m_statsBlock->elapsed;
+  if(m_stats)
+    retVal.elapsed += std::chrono::steady_clock::now() - m_stats->enabledAt;
+  m_statsBlock->queueDelay.CopyTo(retVal.queueDelay);
+  m_statsBlock->execTime.CopyTo(retVal.execTime);
+  return retVal;
+}
+
+void DispatchQueue::Invoke(DispatchThunkBase& thunk, StatsBlock* stats) {
+  if(!stats) {
+    thunk();
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  if(thunk.m_readyAt != std::chrono::steady_clock::time_point())
+    stats->queueDelay.Record(start - thunk.m_readyAt);
+  thunk();
+  stats->execTime.Record(std::chrono::steady_clock::now() - start);
+  stats->nDispatched.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool DispatchQueue::CancelTimer(DispatchTimerId id) {
+  std::unique_ptr<DispatchThunkBase, DispatchThunkReleaser> thunk;
+  {
+    std::lock_guard<std::mutex> lk(m_dispatchLock);
+    thunk.reset(m_timers.Remove(id));
+  }
+
+  // Thunk is released here, outside of the lock, in case its captures have nontrivial destructors
+  return !!thunk;
+}
+
+bool DispatchQueue::RescheduleTimer(DispatchTimerId id, std::chrono::steady_clock::time_point readyAt) {
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  if(!m_timers.Reschedule(id, readyAt))
+    return false;
+
+  SignalTimerUpdatedUnsafe(readyAt);
+  return true;
+}
+
+bool DispatchQueue::IsTimerPending(DispatchTimerId id) {
+  std::lock_guard<std::mutex> lk(m_dispatchLock);
+  return m_timers.GetReadyTime(id) != std::chrono::steady_clock::time_point::max();
+}
+
+bool DispatchTimerHandle::IsPending(void) const {
+  return m_pQueue && m_pQueue->IsTimerPending(m_id);
+}
+
+bool DispatchTimerHandle::Cancel(void) {
+  return m_pQueue && m_pQueue->CancelTimer(m_id);
+}
+
+bool DispatchTimerHandle::Reschedule(std::chrono::steady_clock::time_point readyAt) {
+  return m_pQueue && m_pQueue->RescheduleTimer(m_id, readyAt);
 }
 
 void DispatchQueue::DispatchEventUnsafe(std::unique_lock<std::mutex>& lk) {
   // Pull the ready thunk off of the front of the queue and pop it while we hold the lock.
   // Then, we will excecute the call while the lock has been released so we do not create
   // deadlocks.
-  std::unique_ptr<DispatchThunkBase> thunk(m_dispatchQueue.front());
+  std::unique_ptr<DispatchThunkBase, DispatchThunkReleaser> thunk(m_dispatchQueue.front());
   m_dispatchQueue.pop_front();
-  bool wasEmpty = m_dispatchQueue.empty();
+  StatsBlock* stats = m_stats;
+  SignalSpaceAvailableUnsafe();
+  // Only bother signalling emptiness if someone is actually waiting for it
+  bool notifyDrained = m_dispatchQueue.empty() && m_nDrainWaiters;
   lk.unlock();
 
   MakeAtExit(
-    [this, wasEmpty] {
-      // If we emptied the queue, we'd like to reobtain the lock and tell everyone
-      // that the queue is now empty.
-      if(wasEmpty)
-        m_queueUpdated.notify_all();
+    [this, notifyDrained] {
+      // If we emptied the queue, we'd like to tell everyone who was waiting for that
+      if(notifyDrained)
+        m_queueDrained.notify_all();
     }
   ),
-  (*thunk)();
+  Invoke(*thunk, stats);
 }
 
 bool DispatchQueue::DispatchEvent(void) {
@@ -93,3 +266,71 @@ bool DispatchQueue::DispatchEvent(void) {
   return true;
 }
 
+
+size_t DispatchQueue::DispatchBatchUnsafe(std::unique_lock<std::mutex>& lk, size_t maxEvents, size_t* pnDispatched) {
+  if(m_dispatchQueue.empty() || !maxEvents) {
+    lk.unlock();
+    return 0;
+  }
+
+  // Detach the whole batch while we hold the lock.  When everything is ready we can just trade
+  // containers with the queue; otherwise we have to copy out the leading entries.
+  std::deque<DispatchThunkBase*> batch;
+  if(maxEvents >= m_dispatchQueue.size())
+    batch.swap(m_dispatchQueue);
+  else {
+    auto last = m_dispatchQueue.begin() + maxEvents;
+    batch.assign(m_dispatchQueue.begin(), last);
+    m_dispatchQueue.erase(m_dispatchQueue.begin(), last);
+  }
+  bool notifyDrained = m_dispatchQueue.empty() && m_nDrainWaiters;
+  StatsBlock* stats = m_stats;
+  SignalSpaceAvailableUnsafe();
+  lk.unlock();
+
+  size_t nDispatched = 0;
+  auto restore = [this, &lk, &batch, &nDispatched] {
+    // We did not get through the whole batch, either because the queue was aborted or because
+    // a thunk threw.  Whatever is left goes back where it came from, unless we were aborted.
+    // Thunks put back in this way were admitted once already, so they may leave the queue over
+    // its cap; see AdmitUnsafe.
+    lk.lock();
+    if(m_aborted)
+      for(size_t i = nDispatched; i < batch.size(); i++)
+        ReleaseUnsafe(batch[i]);
+    else
+      m_dispatchQueue.insert(m_dispatchQueue.begin(), batch.begin() + nDispatched, batch.end());
+    lk.unlock();
+  };
+
+  // Nothing here runs in a destructor, so the batch hooks are free to throw
+  try {
+    OnBatchBegin(batch.size());
+    while(nDispatched < batch.size() && !m_aborted) {
+      // Ownership transfers to the local before the call so the thunk is released even on exception
+      std::unique_ptr<DispatchThunkBase, DispatchThunkReleaser> thunk(batch[nDispatched++]);
+      Invoke(*thunk, stats);
+    }
+  }
+  catch(...) {
+    if(pnDispatched)
+      *pnDispatched = nDispatched;
+    restore();
+    OnBatchEnd(nDispatched);
+    throw;
+  }
+
+  if(pnDispatched)
+    *pnDispatched = nDispatched;
+  if(nDispatched != batch.size())
+    restore();
+  else if(notifyDrained)
+    m_queueDrained.notify_all();
+  OnBatchEnd(nDispatched);
+  return nDispatched;
+}
+
+size_t DispatchQueue::DispatchBatch(size_t maxEvents) {
+  std::unique_lock<std::mutex> lk(m_dispatchLock);
+  return DispatchBatchUnsafe(lk, maxEvents);
+}
@@ -0,0 +1,42 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "DispatchThunk.h"
+
+const size_t DispatchThunkSlab::c_blockSize;
+const size_t DispatchThunkSlab::c_blocksPerChunk;
+
+DispatchThunkSlab::DispatchThunkSlab(void) :
+  m_pFree(nullptr),
+  m_pReturned(nullptr)
+{}
+
+DispatchThunkSlab::~DispatchThunkSlab(void) {}
+
+void* DispatchThunkSlab::Allocate(void) {
+  if(!m_pFree)
+    // Reclaim everything consumers have handed back to us since the last time we ran dry
+    m_pFree = m_pReturned.exchange(nullptr, std::memory_order_acquire);
+
+  if(!m_pFree) {
+    // Still nothing available, we have to obtain a new chunk and thread it onto the free list
+    std::unique_ptr<t_storage[]> chunk(new t_storage[c_blocksPerChunk]);
+    for(size_t i = c_blocksPerChunk; i--;) {
+      Block* pBlock = reinterpret_cast<Block*>(&chunk[i]);
+      pBlock->pFlink = m_pFree;
+      m_pFree = pBlock;
+    }
+    m_chunks.push_back(std::move(chunk));
+  }
+
+  Block* retVal = m_pFree;
+  m_pFree = retVal->pFlink;
+  return retVal;
+}
+
+void DispatchThunkSlab::Free(void* pvBlock) {
+  // Push onto the returned stack.  Consumers only ever push and the allocator only ever takes the
+  // entire stack at once, so there is no ABA hazard here.
+  Block* pBlock = static_cast<Block*>(pvBlock);
+  pBlock->pFlink = m_pReturned.load(std::memory_order_relaxed);
+  while(!m_pReturned.compare_exchange_weak(pBlock->pFlink, pBlock, std::memory_order_release, std::memory_order_relaxed));
+}
@@ -0,0 +1,396 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "DispatchTimerWheel.h"
+#include <algorithm>
+#include <stdexcept>
+
+const int DispatchTimerWheel::c_levelBits[DispatchTimerWheel::c_nLevels] = {8, 6, 6, 6};
+const uint32_t DispatchTimerWheel::c_npos;
+
+// Total number of ticks spanned by the wheel, timers further out than this are held in the overflow heap
+static const uint64_t c_wheelSpan = uint64_t(1) << 26;
+
+DispatchTimerWheel::DispatchTimerWheel(DispatchThunkSlab* pSlab, std::chrono::steady_clock::duration resolution) :
+  m_pSlab(pSlab),
+  m_resolution(resolution.count() > 0 ? resolution : std::chrono::steady_clock::duration(1)),
+  m_epoch(std::chrono::steady_clock::now()),
+  m_now(0),
+  m_freeHead(c_npos),
+  m_nextSequence(0),
+  m_dueHead(c_npos),
+  m_dueCount(0),
+  m_overflowCount(0)
+{
+  for(int level = 0; level < c_nLevels; level++) {
+    m_slots[level].assign(size_t(1) << c_levelBits[level], c_npos);
+    m_levelCount[level] = 0;
+  }
+}
+
+DispatchTimerWheel::~DispatchTimerWheel(void) {
+  for(Entry& entry : m_entries)
+    if(entry.level != Free)
+      entry.thunk->Release();
+}
+
+size_t DispatchTimerWheel::Size(void) const {
+  size_t retVal = m_dueCount + m_overflowCount;
+  for(int level = 0; level < c_nLevels; level++)
+    retVal += m_levelCount[level];
+  return retVal;
+}
+
+bool DispatchTimerWheel::SetResolution(std::chrono::steady_clock::duration resolution) {
+  if(!Empty() || resolution.count() <= 0)
+    return false;
+
+  // Nothing is pending, so we can start counting ticks over again
+  m_resolution = resolution;
+  m_epoch = std::chrono::steady_clock::now();
+  m_now = 0;
+  return true;
+}
+
+uint64_t DispatchTimerWheel::TickOf(std::chrono::steady_clock::time_point readyAt) const {
+  if(readyAt <= m_epoch)
+    return 0;
+
+  // Round up, timers must never be reported ready before their ready time
+  auto delta = (readyAt - m_epoch).count();
+  auto resolution = m_resolution.count();
+  return uint64_t(delta / resolution) + (delta % resolution ? 1 : 0);
+}
+
+std::chrono::steady_clock::time_point DispatchTimerWheel::TimeOf(uint64_t tick) const {
+  return m_epoch + m_resolution * tick;
+}
+
+bool DispatchTimerWheel::IsPending(DispatchTimerId id) const {
+  return
+    id.index < m_entries.size() &&
+    m_entries[id.index].generation == id.generation &&
+    m_entries[id.index].level != Free;
+}
+
+void DispatchTimerWheel::Link(uint32_t& head, uint32_t index) {
+  Entry& entry = m_entries[index];
+  entry.prev = c_npos;
+  entry.next = head;
+  if(head != c_npos)
+    m_entries[head].prev = index;
+  head = index;
+}
+
+void DispatchTimerWheel::Unlink(uint32_t index) {
+  Entry& entry = m_entries[index];
+  uint32_t& head = entry.level == Due ? m_dueHead : m_slots[entry.level][entry.slot];
+
+  if(entry.prev == c_npos)
+    head = entry.next;
+  else
+    m_entries[entry.prev].next = entry.next;
+  if(entry.next != c_npos)
+    m_entries[entry.next].prev = entry.prev;
+
+  if(entry.level == Due)
+    m_dueCount--;
+  else
+    m_levelCount[entry.level]--;
+}
+
+void DispatchTimerWheel::Place(uint32_t index) {
+  Entry& entry = m_entries[index];
+  if(entry.tick <= m_now) {
+    entry.level = Due;
+    Link(m_dueHead, index);
+    m_dueCount++;
+    return;
+  }
+
+  // Find the lowest level which can resolve this timer's distance from the current tick:
+  uint64_t delta = entry.tick - m_now;
+  int shift = 0;
+  for(int level = 0; level < c_nLevels; level++) {
+    int bits = c_levelBits[level];
+    if(delta < (uint64_t(1) << (shift + bits))) {
+      entry.level = (int8_t)level;
+      entry.slot = (uint8_t)((entry.tick >> shift) & ((uint64_t(1) << bits) - 1));
+      Link(m_slots[level][entry.slot], index);
+      m_levelCount[level]++;
+      return;
+    }
+    shift += bits;
+  }
+
+  // Too far out for the wheel to hold, this one goes in the heap
+  entry.level = Overflow;
+  OverflowEntry overflow;
+  overflow.readyAt = entry.readyAt;
+  overflow.id = DispatchTimerId(index, entry.generation);
+  m_overflow.push(overflow);
+  m_overflowCount++;
+}
+
+void DispatchTimerWheel::Cascade(uint32_t& head) {
+  uint32_t index = head;
+  head = c_npos;
+  while(index != c_npos) {
+    Entry& entry = m_entries[index];
+    uint32_t next = entry.next;
+    m_levelCount[entry.level]--;
+    Place(index);
+    index = next;
+  }
+}
+
+void DispatchTimerWheel::Rebase(uint64_t tick) {
+  m_now = tick;
+  for(int level = 0; level < c_nLevels; level++) {
+    if(!m_levelCount[level])
+      continue;
+    for(uint32_t& head : m_slots[level])
+      // Entries only ever stay at their level or move down, so a single pass is sufficient
+      Cascade(head);
+  }
+}
+
+void DispatchTimerWheel::MigrateOverflow(void) {
+  while(!m_overflow.empty()) {
+    DispatchTimerId id = m_overflow.top().id;
+    if(
+      !IsPending(id) ||
+      m_entries[id.index].level != Overflow ||
+      m_entries[id.index].readyAt != m_overflow.top().readyAt
+    ) {
+      // Timer was cancelled or rescheduled while it was in the heap, just discard the stale record
+      m_overflow.pop();
+      continue;
+    }
+
+    Entry& entry = m_entries[id.index];
+    if(entry.tick > m_now && entry.tick - m_now >= c_wheelSpan)
+      // Earliest overflow timer is still out of range, so all of the others are too
+      break;
+
+    m_overflow.pop();
+    m_overflowCount--;
+    Place(id.index);
+  }
+}
+
+void DispatchTimerWheel::FreeEntry(uint32_t index) {
+  Entry& entry = m_entries[index];
+  entry.thunk = nullptr;
+  entry.generation++;
+  entry.level = Free;
+  entry.next = m_freeHead;
+  m_freeHead = index;
+}
+
+DispatchTimerId DispatchTimerWheel::NewEntry(std::chrono::steady_clock::time_point readyAt, DispatchThunkBase* thunk, std::chrono::steady_clock::duration period, DispatchTimerPolicy policy, uint32_t maxCatchUp) {
+  uint32_t index;
+  if(m_freeHead != c_npos) {
+    index = m_freeHead;
+    m_freeHead = m_entries[index].next;
+  }
+  else {
+    index = (uint32_t)m_entries.size();
+    m_entries.push_back(Entry());
+  }
+
+  Entry& entry = m_entries[index];
+  entry.readyAt = readyAt;
+  entry.tick = TickOf(readyAt);
+  entry.sequence = m_nextSequence++;
+  entry.thunk = thunk;
+  entry.period = period;
+  entry.policy = policy;
+  entry.maxCatchUp = maxCatchUp;
+  Place(index);
+  return DispatchTimerId(index, entry.generation);
+}
+
+DispatchTimerId DispatchTimerWheel::Add(std::chrono::steady_clock::time_point readyAt, DispatchThunkBase* thunk) {
+  return NewEntry(readyAt, thunk, std::chrono::steady_clock::duration::zero(), DispatchTimerPolicy::CatchUp, 1);
+}
+
+DispatchTimerId DispatchTimerWheel::AddPeriodic(std::chrono::steady_clock::time_point readyAt, std::chrono::steady_clock::duration period, DispatchTimerPolicy policy, DispatchThunkPeriodic* thunk, uint32_t maxCatchUp) {
+  if(period <= std::chrono::steady_clock::duration::zero()) {
+    thunk->Release();
+    throw std::runtime_error("A periodic timer must have a positive period");
+  }
+  return NewEntry(readyAt, thunk, period, policy, maxCatchUp ? maxCatchUp : 1);
+}
+
+bool DispatchTimerWheel::Reschedule(DispatchTimerId id, std::chrono::steady_clock::time_point readyAt) {
+  if(!IsPending(id))
+    return false;
+
+  Entry& entry = m_entries[id.index];
+  if(entry.level == Overflow)
+    // Old heap record will be recognized as stale because its ready time no longer matches
+    m_overflowCount--;
+  else
+    Unlink(id.index);
+
+  entry.readyAt = readyAt;
+  entry.tick = TickOf(readyAt);
+  entry.sequence = m_nextSequence++;
+  Place(id.index);
+  return true;
+}
+
+DispatchThunkBase* DispatchTimerWheel::Remove(DispatchTimerId id) {
+  if(!IsPending(id))
+    return nullptr;
+
+  Entry& entry = m_entries[id.index];
+  if(entry.level == Overflow)
+    // Heap record stays where it is, it will be recognized as stale when it reaches the top
+    m_overflowCount--;
+  else
+    Unlink(id.index);
+
+  DispatchThunkBase* retVal = entry.thunk;
+  FreeEntry(id.index);
+  return retVal;
+}
+
+std::chrono::steady_clock::time_point DispatchTimerWheel::GetReadyTime(DispatchTimerId id) const {
+  return
+    IsPending(id) ?
+    m_entries[id.index].readyAt :
+    std::chrono::steady_clock::time_point::max();
+}
+
+void DispatchTimerWheel::Collect(uint32_t& head) {
+  for(uint32_t index = head; index != c_npos; index = m_entries[index].next) {
+    Entry& entry = m_entries[index];
+    if(entry.level == Due)
+      m_dueCount--;
+    else
+      m_levelCount[entry.level]--;
+    m_ready.push_back(index);
+  }
+  head = c_npos;
+}
+
+size_t DispatchTimerWheel::PromoteReady(std::chrono::steady_clock::time_point now, std::deque<DispatchThunkBase*>& ready) {
+  uint64_t target = now <= m_epoch ? 0 : uint64_t((now - m_epoch) / m_resolution);
+
+  m_ready.clear();
+  if(target > m_now) {
+    bool wheelEmpty = true;
+    for(int level = 0; level < c_nLevels; level++)
+      wheelEmpty = wheelEmpty && !m_levelCount[level];
+
+    if(wheelEmpty || target - m_now >= (uint64_t(1) << (c_levelBits[0] + c_levelBits[1])))
+      // Either there's nothing to step through, or we've fallen so far behind that it's cheaper to
+      // redistribute everything than to visit every tick
+      Rebase(target);
+    else
+      while(m_now < target) {
+        m_now++;
+
+        // Whenever a lower level wraps around, the next slot up has to be redistributed downward:
+        int shift = 0;
+        for(int level = 1; level < c_nLevels; level++) {
+          shift += c_levelBits[level - 1];
+          if(m_now & ((uint64_t(1) << shift) - 1))
+            break;
+          Cascade(m_slots[level][(m_now >> shift) & ((uint64_t(1) << c_levelBits[level]) - 1)]);
+        }
+
+        Collect(m_slots[0][m_now & ((uint64_t(1) << c_levelBits[0]) - 1)]);
+      }
+  }
+
+  MigrateOverflow();
+  Collect(m_dueHead);
+  if(m_ready.empty())
+    return 0;
+
+  // Hand thunks over in the order that they became ready:
+  std::sort(
+    m_ready.begin(),
+    m_ready.end(),
+    [this] (uint32_t lhs, uint32_t rhs) {
+      const Entry& l = m_entries[lhs];
+      const Entry& r = m_entries[rhs];
+      return l.readyAt < r.readyAt || (l.readyAt == r.readyAt && l.sequence < r.sequence);
+    }
+  );
+  size_t nInitial = ready.size();
+  for(uint32_t index : m_ready)
+    if(m_entries[index].period.count())
+      Repeat(index, now, ready);
+    else {
+      ready.push_back(m_entries[index].thunk);
+      FreeEntry(index);
+    }
+  return ready.size() - nInitial;
+}
+
+void DispatchTimerWheel::Repeat(uint32_t index, std::chrono::steady_clock::time_point now, std::deque<DispatchThunkBase*>& ready) {
+  Entry& entry = m_entries[index];
+  const auto& target = static_cast<DispatchThunkPeriodic*>(entry.thunk)->m_target;
+  auto dispatch = [&] {
+    ready.push_back(
+      m_pSlab ?
+      m_pSlab->New<DispatchThunkPeriodic>(target) :
+      new DispatchThunkPeriodic(target)
+    );
+  };
+
+  // Deadlines are always advanced from the previous deadline, never from the current time, so that
+  // lateness in one dispatch doesn't push back all of the dispatches that follow it
+  switch(entry.policy) {
+  case DispatchTimerPolicy::CatchUp:
+    for(uint32_t nDispatched = 0; entry.readyAt <= now && nDispatched < entry.maxCatchUp; nDispatched++) {
+      dispatch();
+      entry.readyAt += entry.period;
+    }
+    if(entry.readyAt <= now)
+      // Too far behind, whatever is left over is skipped
+      entry.readyAt += entry.period * ((now - entry.readyAt) / entry.period + 1);
+    break;
+  case DispatchTimerPolicy::Skip:
+    dispatch();
+    entry.readyAt += entry.period * ((now - entry.readyAt) / entry.period + 1);
+    break;
+  }
+
+  entry.tick = TickOf(entry.readyAt);
+  entry.sequence = m_nextSequence++;
+  Place(index);
+}
+
+std::chrono::steady_clock::time_point DispatchTimerWheel::NextWakeup(void) const {
+  if(m_dueCount)
+    // Something is ready already
+    return TimeOf(m_now);
+
+  auto retVal = std::chrono::steady_clock::time_point::max();
+  if(m_levelCount[0]) {
+    // Every entry in the lowest level is due within one rotation, find the first occupied slot
+    const size_t mask = m_slots[0].size() - 1;
+    for(uint64_t tick = m_now + 1; tick <= m_now + m_slots[0].size(); tick++)
+      if(m_slots[0][tick & mask] != c_npos) {
+        retVal = TimeOf(tick);
+        break;
+      }
+  }
+
+  for(int level = 1; level < c_nLevels; level++)
+    if(m_levelCount[level]) {
+      // An upper level is occupied, we have to be back in time for the next cascade
+      uint64_t rotation = uint64_t(1) << c_levelBits[0];
+      retVal = std::min(retVal, TimeOf((m_now / rotation + 1) * rotation));
+      break;
+    }
+
+  if(!m_overflow.empty())
+    // May be stale, but that can only cause an early wakeup
+    retVal = std::min(retVal, m_overflow.top().readyAt);
+  return retVal;
+}
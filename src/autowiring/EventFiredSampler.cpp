@@ -0,0 +1,29 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include "EventFiredSampler.h"
+
+std::atomic<bool> EventFiredSampler::s_enabled{false};
+std::atomic<bool> EventFiredSampler::s_reportFires{true};
+std::atomic<size_t> EventFiredSampler::s_defaultInterval{1};
+std::atomic<EventFiredSampler::Counter*> EventFiredSampler::s_pHead{nullptr};
+
+EventFiredSampler::Counter::Counter(const std::type_info& type) :
+  type(type),
+  nFired(0),
+  nSeen(0),
+  interval(0),
+  pNext(s_pHead.load())
+{
+  // Counters are never removed, so a simple push suffices
+  while(!s_pHead.compare_exchange_weak(pNext, this));
+}
+
+std::vector<EventFiredCount> EventFiredSampler::TakeCounts(void) {
+  std::vector<EventFiredCount> counts;
+  for(Counter* pCur = s_pHead.load(); pCur; pCur = pCur->pNext) {
+    uint64_t nFired = pCur->nFired.exchange(0, std::memory_order_relaxed);
+    if(nFired)
+      counts.push_back(EventFiredCount{&pCur->type, nFired});
+  }
+  return counts;
+}
@@ -2,29 +2,70 @@
 #include "stdafx.h"
 #include "Autowired.h"
 #include "EventOutputStream.h"
-#include <memory>
-#include <cstring>
 
 EventOutputStreamBase::EventOutputStreamBase(void){}
 
 EventOutputStreamBase::~EventOutputStreamBase(void){}
 
 bool EventOutputStreamBase::IsEmpty(void) const {
-  return !m_OutputStream.str().size();
+  return m_buffer.empty();
 }
 
 size_t EventOutputStreamBase::GetSize(void) const {
-  return m_OutputStream.str().size();
+  return m_buffer.size();
 }
 
 const void* EventOutputStreamBase::GetData(void) const {
-  auto intermed = m_OutputStream.str();
-  char * retvalue = new char [ m_OutputStream.str().size()];
-  std::memcpy(retvalue, m_OutputStream.str().c_str(),  m_OutputStream.str().size());
-  return retvalue;
+  return m_buffer.data();
 }
 
 void EventOutputStreamBase::Reset(void) {
-  m_OutputStream.str("");
-  m_OutputStream.clear();
+  m_buffer.clear();
+}
+
+void EventOutputStreamBase::AddIdentity(const std::string& memfnBytes, const std::string& identity) {
+  uint32_t id = autowiring::EventStreamFormat::IdOf(identity);
+
+  std::lock_guard<std::mutex> lk(m_identityLock);
+  auto q = m_owners.emplace(id, identity);
+  if(!q.second && q.first->second != identity)
+    throw autowiring_error("Event identity has the same ID as another identity already enabled");
+  m_identities[memfnBytes] = id;
+}
+
+bool EventOutputStreamBase::QueryIdentity(const std::string& memfnBytes, uint32_t& id) const {
+  std::lock_guard<std::mutex> lk(m_identityLock);
+  auto q = m_identities.find(memfnBytes);
+  if(q == m_identities.end())
+    return false;
+  id = q->second;
+  return true;
+}
+
+void EventOutputStreamBase::AppendU32(uint32_t value) {
+  size_t offset = m_buffer.size();
+  m_buffer.resize(offset + sizeof(uint32_t));
+  autowiring::EventStreamFormat::PutU32(&m_buffer[offset], value);
+}
+
+void EventOutputStreamBase::AppendArgument(const void* pData, size_t nBytes) {
+  AppendU32((uint32_t)nBytes);
+  const unsigned char* pBytes = static_cast<const unsigned char*>(pData);
+  m_buffer.insert(m_buffer.end(), pBytes, pBytes + nBytes);
+}
+
+size_t EventOutputStreamBase::BeginRecord(uint32_t id, uint32_t nArgs) {
+  size_t offset = m_buffer.size();
+  m_buffer.push_back((unsigned char)autowiring::EventStreamFormat::c_version);
+
+  // Body length, patched by EndRecord once the arguments are written
+  AppendU32(0);
+  AppendU32(id);
+  AppendU32(nArgs);
+  return offset;
+}
+
+void EventOutputStreamBase::EndRecord(size_t offset) {
+  size_t bodyLength = m_buffer.size() - offset - autowiring::EventStreamFormat::c_prefixSize;
+  autowiring::EventStreamFormat::PutU32(&m_buffer[offset + 1], (uint32_t)bodyLength);
 }
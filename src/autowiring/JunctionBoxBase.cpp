@@ -1,10 +1,32 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #include "stdafx.h"
 #include "JunctionBoxBase.h"
+#include "JunctionBoxEntry.h"
 #include "CoreContext.h"
+#include "demangle.h"
+#include <algorithm>
 
 JunctionBoxBase::~JunctionBoxBase(void) {}
 
+/// <returns>The name of a listener type, as it was declared by the user</returns>
+static std::string ListenerName(const std::type_info& ti) {
+  std::string name = autowiring::demangle(ti);
+
+  // Listeners which do not inherit Object are injected as a TypeUnifierComplex, which isn't interesting
+  static const char sc_unifier[] = "TypeUnifierComplex<";
+  size_t pos = name.find(sc_unifier);
+  if(pos == std::string::npos || name.empty() || name.back() != '>')
+    return name;
+
+  pos += sizeof(sc_unifier) - 1;
+  name = name.substr(pos, name.size() - pos - 1);
+  if(!name.compare(0, 6, "class "))
+    name.erase(0, 6);
+  else if(!name.compare(0, 7, "struct "))
+    name.erase(0, 7);
+  return name;
+}
+
 void JunctionBoxBase::TerminateAll(const std::vector<std::weak_ptr<CoreContext>>& teardown) {
   for(size_t i = teardown.size(); i--;) {
     auto curContext = teardown[i].lock();
@@ -21,3 +43,74 @@ void JunctionBoxBase::FilterFiringException(const std::shared_ptr<Object>& pReci
 std::weak_ptr<CoreContext> JunctionBoxBase::ContextDumbToWeak(CoreContext* pContext) {
   return pContext->shared_from_this();
 }
+
+std::shared_ptr<CoreContext> JunctionBoxBase::GetCurrentContext(void) {
+  return CoreContext::CurrentContext();
+}
+
+void JunctionBoxBase::SetInstrumented(bool instrumented) {
+  std::lock_guard<std::mutex> lk(m_lock);
+  if(instrumented && !m_statsBlock)
+    m_statsBlock.reset(new StatsBlock);
+  m_stats.store(instrumented ? m_statsBlock.get() : nullptr, std::memory_order_release);
+}
+
+EventStats JunctionBoxBase::GetStats(void) const {
+  EventStats retVal;
+  retVal.name = autowiring::demangle(GetEventType());
+
+  std::lock_guard<std::mutex> lk(m_lock);
+  retVal.instrumented = IsInstrumented();
+  if(!m_statsBlock)
+    // Never instrumented, nothing more to report
+    return retVal;
+
+  retVal.nFired = m_statsBlock->nFired;
+  retVal.nInvocations = m_statsBlock->nInvocations;
+  retVal.nExceptions = m_statsBlock->nExceptions;
+
+  std::lock_guard<std::mutex> statsLk(m_statsBlock->lock);
+  for(const auto& entry : m_statsBlock->listeners) {
+    retVal.listeners.push_back(EventListenerStats());
+    EventListenerStats& listener = retVal.listeners.back();
+    listener.name = ListenerName(entry.second->type);
+    listener.nCalls = entry.second->nCalls;
+    listener.nExceptions = entry.second->nExceptions;
+    entry.second->execTime.CopyTo(listener.execTime);
+  }
+  std::sort(
+    retVal.listeners.begin(),
+    retVal.listeners.end(),
+    [] (const EventListenerStats& lhs, const EventListenerStats& rhs) { return lhs.name < rhs.name; }
+  );
+  return retVal;
+}
+
+JunctionBoxBase::ListenerStatsBlock& JunctionBoxBase::GetListenerStats(StatsBlock& stats, const std::type_info& listenerType) {
+  std::lock_guard<std::mutex> lk(stats.lock);
+  auto& listener = stats.listeners[listenerType];
+  if(!listener)
+    listener.reset(new ListenerStatsBlock(listenerType));
+  return *listener;
+}
+
+JunctionBoxBase::ListenerStatsBlock& JunctionBoxBase::GetListenerStats(StatsBlock& stats, const JunctionBoxEntryBase& entry, const std::type_info& listenerType) {
+  // Blocks are never removed from the stats block, which lives as long as the junction box, so the entry
+  // can safely hold on to its block.  Concurrent first calls both resolve the same block.
+  ListenerStatsBlock* listener = entry.m_stats.load(std::memory_order_acquire);
+  if(!listener) {
+    listener = &GetListenerStats(stats, listenerType);
+    entry.m_stats.store(listener, std::memory_order_release);
+  }
+  return *listener;
+}
+
+void JunctionBoxBase::RecordInvocation(StatsBlock& stats, ListenerStatsBlock& listener, std::chrono::steady_clock::time_point start, bool threw) {
+  listener.execTime.Record(std::chrono::steady_clock::now() - start);
+  listener.nCalls.fetch_add(1, std::memory_order_relaxed);
+  stats.nInvocations.fetch_add(1, std::memory_order_relaxed);
+  if(threw) {
+    listener.nExceptions.fetch_add(1, std::memory_order_relaxed);
+    stats.nExceptions.fetch_add(1, std::memory_order_relaxed);
+  }
+}
@@ -4,6 +4,7 @@
 #include "AutoPacketFactory.h"
 #include "AutowiringEvents.h"
 #include "JunctionBox.h"
+#include <algorithm>
 
 JunctionBoxManager::JunctionBoxManager(void) {
   // Enumerate all event types to initialize a new JunctionBox for each
@@ -21,6 +22,30 @@ void JunctionBoxManager::Initiate(void) {
     q.second->Initiate();
 }
 
+void JunctionBoxManager::SetInstrumented(bool instrumented) {
+  for(auto& q : m_junctionBoxes)
+    q.second->SetInstrumented(instrumented);
+}
+
+void JunctionBoxManager::GetStats(std::vector<EventStats>& stats) const {
+  for(const auto& q : m_junctionBoxes) {
+    EventStats box = q.second->GetStats();
+    if(!box.instrumented && !box.nFired)
+      continue;
+
+    auto r = std::lower_bound(
+      stats.begin(),
+      stats.end(),
+      box,
+      [] (const EventStats& lhs, const EventStats& rhs) { return lhs.name < rhs.name; }
+    );
+    if(r != stats.end() && r->name == box.name)
+      r->Merge(box);
+    else
+      stats.insert(r, std::move(box));
+  }
+}
+
 void JunctionBoxManager::AddEventReceiver(JunctionBoxEntry<Object> receiver) {
   // Notify all junctionboxes that there is a new event
   for(auto q : m_junctionBoxes)
@@ -0,0 +1,63 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include <autowiring/CoreThread.h>
+#include <iostream>
+
+class DispatchQueueBenchmarkTest:
+  public testing::Test
+{};
+
+/// <summary>
+/// A CoreThread which will accept the entire benchmark workload without hitting its dispatch cap
+/// </summary>
+class UncappedThread:
+  public CoreThread
+{
+public:
+  UncappedThread(void) {
+    SetDispatcherCap(~size_t(0));
+  }
+};
+
+// Under the legacy scheme, every pend signalled the queue's condition variable, and every one of
+// those signals was a potential futex wake.  The wakeup count is the number of signals we still send.
+
+TEST_F(DispatchQueueBenchmarkTest, IdleQueueDoesNotSignal) {
+  const size_t n = 100000;
+
+  // Nobody is parked on this thread's queue, because its context is never started
+  AutoRequired<UncappedThread> t;
+
+  auto start = std::chrono::steady_clock::now();
+  for(size_t i = n; i--;)
+    *t += [] {};
+  auto duration = std::chrono::steady_clock::now() - start;
+
+  std::cout << "Pended " << n << " events with no parked consumer in "
+            << std::chrono::duration_cast<std::chrono::microseconds>(duration).count() << "us, "
+            << t->GetWakeupCount() << " signals (legacy: " << n << ")" << std::endl;
+
+  ASSERT_EQ(n, t->GetDispatchQueueLength()) << "Not all pends were accepted by the queue";
+  ASSERT_EQ(0UL, t->GetWakeupCount()) << "Producers signalled a dispatch queue that had no parked consumer";
+}
+
+TEST_F(DispatchQueueBenchmarkTest, BusyConsumerIsNotSignalled) {
+  const size_t n = 100000;
+
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<UncappedThread> t;
+
+  auto start = std::chrono::steady_clock::now();
+  for(size_t i = n; i--;)
+    *t += [] {};
+
+  t->Stop(true);
+  ASSERT_TRUE(t->WaitFor(std::chrono::seconds(10))) << "Consumer did not drain its queue in a timely fashion";
+  auto duration = std::chrono::steady_clock::now() - start;
+
+  std::cout << "Dispatched " << n << " events to a running consumer in "
+            << std::chrono::duration_cast<std::chrono::microseconds>(duration).count() << "us, "
+            << t->GetWakeupCount() << " signals (legacy: " << n << ")" << std::endl;
+  ASSERT_GT(n, t->GetWakeupCount()) << "Every pend signalled the consumer, even while it was busy";
+}
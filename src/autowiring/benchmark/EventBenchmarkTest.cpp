@@ -0,0 +1,61 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include <iostream>
+
+class EventBenchmarkTest:
+  public testing::Test
+{
+public:
+  EventBenchmarkTest(void) {
+    AutoCurrentContext()->Initiate();
+  }
+};
+
+class HotEvent {
+public:
+  virtual void OnFrame(int frame) = 0;
+};
+
+template<int N>
+class HotEventListener:
+  public HotEvent
+{
+public:
+  HotEventListener(void) : m_sum(0) {}
+  int64_t m_sum;
+
+  void OnFrame(int frame) override { m_sum += frame; }
+};
+
+TEST_F(EventBenchmarkTest, FireStaticVersusFire) {
+  const int n = 1000000;
+
+  AutoRequired<HotEventListener<1>> l1;
+  AutoRequired<HotEventListener<2>> l2;
+  AutoRequired<HotEventListener<3>> l3;
+  AutoRequired<HotEventListener<4>> l4;
+  AutoFired<HotEvent> sender;
+
+  auto start = std::chrono::steady_clock::now();
+  for(int i = 0; i < n; i++)
+    sender(&HotEvent::OnFrame)(i);
+  auto dynamicDuration = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for(int i = 0; i < n; i++)
+    sender.FireStatic<decltype(&HotEvent::OnFrame), &HotEvent::OnFrame>()(i);
+  auto staticDuration = std::chrono::steady_clock::now() - start;
+
+  std::cout << "Fired " << n << " events to four listeners in "
+            << std::chrono::duration_cast<std::chrono::microseconds>(dynamicDuration).count() << "us, "
+            << std::chrono::duration_cast<std::chrono::microseconds>(staticDuration).count() << "us with FireStatic"
+            << std::endl;
+
+  // Timings are only reported, a single run on a loaded machine is too noisy to compare.  Each listener
+  // should have seen every frame once from each kind of fire.
+  const int64_t expected = (int64_t)n * (n - 1);
+  ASSERT_EQ(expected, l1->m_sum) << "Listener did not receive every event";
+  ASSERT_EQ(expected, l2->m_sum) << "Listener did not receive every event";
+  ASSERT_EQ(expected, l3->m_sum) << "Listener did not receive every event";
+  ASSERT_EQ(expected, l4->m_sum) << "Listener did not receive every event";
+}
@@ -1855,3 +1855,83 @@ TEST_F(AutoFilterTest, ExtractMergedData) {
     ASSERT_EQ(2, data->size()) << "Merge failed to gather all data";
   }
 }
+
+#if AUTOWIRING_USE_COROUTINES
+class AwaitsSecondDecoration {
+public:
+  AwaitsSecondDecoration(void) :
+    m_sum(0),
+    m_finished(false)
+  {}
+
+  int m_sum;
+  bool m_finished;
+
+  DispatchCoroutine AutoFilter(AutoPacket& packet, const Decoration<0>& zero) {
+    // Straight-line code in place of a second filter and the state shared between the two:
+    int first = zero.i;
+    const Decoration<1>& one = co_await packet.Await<Decoration<1>>();
+    m_sum = first + one.i;
+    m_finished = true;
+  }
+};
+
+TEST_F(AutoFilterTest, CoroutineAutoFilterAwaitsDecoration) {
+  AutoRequired<AutoPacketFactory> factory;
+  AutoRequired<AwaitsSecondDecoration> filter;
+
+  std::weak_ptr<AutoPacket> weak;
+  {
+    auto packet = factory->NewPacket();
+    weak = packet;
+    packet->Decorate(Decoration<0>(2));
+    ASSERT_FALSE(filter->m_finished) << "Coroutine filter did not suspend waiting for its second decoration";
+
+    packet->Decorate(Decoration<1>(3));
+    ASSERT_TRUE(filter->m_finished);
+    ASSERT_EQ(5, filter->m_sum);
+  }
+  ASSERT_TRUE(weak.expired()) << "Coroutine filter did not release its packet when it finished";
+}
+
+TEST_F(AutoFilterTest, CoroutineAwaitOfMissingDecorationThrows) {
+  AutoRequired<AutoPacketFactory> factory;
+  bool threw = false;
+
+  auto packet = factory->NewPacket();
+  [] (AutoPacket& packet, bool& threw) -> DispatchCoroutine {
+    try {
+      co_await packet.Await<Decoration<3>>();
+    }
+    catch(autowiring_error&) {
+      threw = true;
+    }
+  }(*packet, threw);
+
+  ASSERT_FALSE(threw);
+  packet.reset();
+  ASSERT_TRUE(threw) << "Awaiting a decoration that was never produced did not throw when the packet was finalized";
+}
+
+class ThrowsBeforeAwaiting {
+public:
+  DispatchCoroutine AutoFilter(AutoPacket& packet, const Decoration<0>& zero) {
+    if(zero.i)
+      throw std::runtime_error("Filter failed before suspending");
+    co_await packet.Await<Decoration<1>>();
+  }
+};
+
+TEST_F(AutoFilterTest, CoroutineThrowingBeforeSuspendReleasesPacket) {
+  AutoRequired<AutoPacketFactory> factory;
+  AutoRequired<ThrowsBeforeAwaiting> filter;
+
+  std::weak_ptr<AutoPacket> weak;
+  {
+    auto packet = factory->NewPacket();
+    weak = packet;
+    ASSERT_ANY_THROW(packet->DecorateImmediate(Decoration<0>(1))) << "Exception thrown by a coroutine filter was not propagated";
+  }
+  ASSERT_TRUE(weak.expired()) << "Coroutine filter which threw before suspending kept its packet alive";
+}
+#endif
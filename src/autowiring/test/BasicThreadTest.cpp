@@ -1,6 +1,7 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #include "stdafx.h"
 #include <autowiring/BasicThread.h>
+#include THREAD_HEADER
 
 class BasicThreadTest:
   public testing::Test
@@ -64,4 +65,128 @@ TEST_F(BasicThreadTest, ValidateThreadTimes) {
   // Thread should not have been able to complete in less time than we completed, by a factor of ten or so at least
   ASSERT_LE(benchmark, spinsThenQuits->m_userTime * 10) <<
     "Reported execution time could not possibly be correct, spin operation took less time to execute than should have been possible with the CPU";
-}
\ No newline at end of file
+}
+class ReportsScheduling:
+  public BasicThread
+{
+public:
+  ReportsScheduling(void) :
+    BasicThread("ReportsScheduling")
+  {}
+
+  ThreadScheduling m_observed;
+  bool m_observedRunning;
+
+  void Run(void) override {
+    m_observedRunning = GetThreadScheduling(m_observed);
+  }
+};
+
+TEST_F(BasicThreadTest, AffinityIsAppliedBeforeRun) {
+  AutoCurrentContext ctxt;
+  auto thread = ctxt->Construct<ReportsScheduling>();
+
+  ThreadScheduling scheduling;
+  scheduling.cpus.push_back(0);
+  ASSERT_TRUE(thread->SetThreadScheduling(scheduling)) << "Assigning scheduling to a thread that has not started failed";
+
+  ctxt->Initiate();
+  ASSERT_TRUE(thread->WaitFor(std::chrono::seconds(5)));
+  ASSERT_TRUE(thread->m_observedRunning);
+  ASSERT_EQ(std::vector<int>{0}, thread->m_observed.cpus) << "Thread was not pinned to the requested processor";
+  ASSERT_EQ(ThreadSchedulingPolicy::Default, thread->m_observed.policy);
+}
+
+TEST_F(BasicThreadTest, SchedulingFailureAtStartIsReported) {
+  AutoCurrentContext ctxt;
+  auto thread = ctxt->Construct<ReportsScheduling>();
+
+  // No such processor exists, so no affinity can be applied when the thread starts
+  ThreadScheduling scheduling;
+  scheduling.cpus.push_back(-1);
+  ASSERT_TRUE(thread->SetThreadScheduling(scheduling)) << "Assigning scheduling to a thread that has not started failed";
+  ASSERT_FALSE(thread->DidThreadSchedulingFail()) << "A thread which has not started reported a scheduling failure";
+
+  ctxt->Initiate();
+  ASSERT_TRUE(thread->WaitFor(std::chrono::seconds(5)));
+  ASSERT_TRUE(thread->DidThreadSchedulingFail()) << "Unsatisfiable scheduling applied at start was not reported";
+}
+
+TEST_F(BasicThreadTest, ContextSchedulingIsInherited) {
+  AutoCurrentContext ctxt;
+  ThreadScheduling scheduling;
+  scheduling.cpus.push_back(0);
+  ctxt->SetThreadScheduling(scheduling);
+
+  AutoCreateContext child;
+  ASSERT_EQ(std::vector<int>{0}, child->GetThreadScheduling().cpus) << "Child context did not inherit scheduling defaults";
+
+  auto thread = child->Construct<ReportsScheduling>();
+  ThreadScheduling pending;
+  ASSERT_FALSE(thread->GetThreadScheduling(pending)) << "A thread which has not started reported itself as running";
+  ASSERT_EQ(std::vector<int>{0}, pending.cpus);
+
+  ctxt->Initiate();
+  child->Initiate();
+  ASSERT_TRUE(thread->WaitFor(std::chrono::seconds(5)));
+  ASSERT_EQ(std::vector<int>{0}, thread->m_observed.cpus) << "Context scheduling defaults were not applied to a thread";
+}
+
+class IdlesAndThenQuits:
+  public SpinsAndThenQuits
+{
+public:
+  IdlesAndThenQuits(void) :
+    SpinsAndThenQuits(0)
+  {}
+};
+
+TEST_F(BasicThreadTest, ThreadTimesArePerThread) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+
+  auto spinner = ctxt->Construct<SpinsAndThenQuits>(100000000);
+  auto sleeper = ctxt->Construct<IdlesAndThenQuits>();
+
+  spinner->Continue();
+  sleeper->Continue();
+  ASSERT_TRUE(spinner->WaitFor(std::chrono::seconds(30)));
+  ASSERT_TRUE(sleeper->WaitFor(std::chrono::seconds(5)));
+  ASSERT_NE(std::chrono::steady_clock::time_point::min(), spinner->GetCreationTime()) << "Thread did not record its creation time";
+
+  ASSERT_LT(sleeper->m_userTime + std::chrono::milliseconds(10), spinner->m_userTime) <<
+    "A thread that did no work was charged with the processor time of another thread";
+}
+
+class BlocksUntilReleased:
+  public BasicThread
+{
+public:
+  std::atomic<bool> m_release;
+
+  BlocksUntilReleased(void) :
+    m_release(false)
+  {}
+
+  void Run(void) override {
+    while(!m_release)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+};
+
+TEST_F(BasicThreadTest, ThreadStatistics) {
+  AutoCurrentContext ctxt;
+  auto thread = ctxt->Construct<BlocksUntilReleased>();
+
+  BasicThreadStatistics stats;
+  ASSERT_FALSE(thread->GetThreadStatistics(stats)) << "A thread that has not started reported statistics";
+
+  ctxt->Initiate();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_TRUE(thread->GetThreadStatistics(stats));
+  thread->m_release = true;
+  ASSERT_TRUE(thread->WaitFor(std::chrono::seconds(5)));
+
+  ASSERT_NE(std::chrono::steady_clock::time_point::min(), stats.startTime);
+  ASSERT_LT(0UL, stats.voluntaryContextSwitches) << "A thread that repeatedly slept reported no voluntary context switches";
+}
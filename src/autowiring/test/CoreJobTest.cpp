@@ -1,8 +1,11 @@
 // Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
 #include "stdafx.h"
 #include <autowiring/CoreJob.h>
+#include <autowiring/CoreJobExecutor.h>
 #include THREAD_HEADER
 #include FUTURE_HEADER
+#include <set>
+#include ATOMIC_HEADER
 
 class CoreJobTest:
   public testing::Test
@@ -192,3 +195,116 @@ TEST_F(CoreJobTest, RecursiveDeadlock) {
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
   };
 }
+
+template<int N>
+class NumberedJob:
+  public CoreJob
+{};
+
+TEST_F(CoreJobTest, ContextScopedExecutorIsBounded) {
+  AutoCurrentContext ctxt;
+  AutoRequired<CoreJobExecutor> executor(ctxt, 2);
+
+  AutoRequired<NumberedJob<0>> job0;
+  AutoRequired<NumberedJob<1>> job1;
+  AutoRequired<NumberedJob<2>> job2;
+  AutoRequired<NumberedJob<3>> job3;
+  CoreJob* jobs[] = {job0.get(), job1.get(), job2.get(), job3.get()};
+
+  auto nConcurrent = std::make_shared<std::atomic<int>>(0);
+  auto maxConcurrent = std::make_shared<std::atomic<int>>(0);
+  for(CoreJob* job : jobs)
+    for(int i = 0; i < 5; i++)
+      *job += [nConcurrent, maxConcurrent] {
+        int cur = ++*nConcurrent;
+        for(int prior = *maxConcurrent; prior < cur && !maxConcurrent->compare_exchange_weak(prior, cur););
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        --*nConcurrent;
+      };
+
+  ctxt->Initiate();
+  ctxt->SignalShutdown(true);
+
+  ASSERT_LE(*maxConcurrent, 2) << "More jobs ran concurrently than the executor allows";
+  ASSERT_LE(executor->GetThreadCount(), 2UL) << "Executor created more threads than its bound";
+}
+
+TEST_F(CoreJobTest, BurstsReuseThreads) {
+  AutoCurrentContext ctxt;
+  AutoRequired<CoreJobExecutor> executor(ctxt, 1);
+  AutoRequired<CoreJob> job;
+  ctxt->Initiate();
+
+  // Each of these is a separate burst, because we wait for the job to go idle in between
+  std::set<std::thread::id> threads;
+  for(int i = 0; i < 20; i++) {
+    auto done = std::make_shared<std::promise<std::thread::id>>();
+    *job += [done] { done->set_value(std::this_thread::get_id()); };
+    threads.insert(done->get_future().get());
+  }
+  ASSERT_EQ(1UL, threads.size()) << "Each burst of a job ran on a new thread";
+
+  job->Stop(true);
+  ASSERT_TRUE(job->WaitFor(std::chrono::seconds(5)));
+}
+
+/// <summary>
+/// Pends count events to busy, each of which runs fn, and has the first of them pend one event to other
+/// </summary>
+/// <returns>The number of busy events that had run when other's event ran, or -1 if it never did</returns>
+template<class Fn>
+static int RunAlongside(CoreJob& busy, CoreJob& other, int count, Fn fn) {
+  auto nBusy = std::make_shared<std::atomic<int>>(0);
+  auto nBusyAtOther = std::make_shared<std::atomic<int>>(-1);
+  CoreJob* pOther = &other;
+  for(int i = 0; i < count; i++)
+    busy += [nBusy, nBusyAtOther, pOther, i, fn] {
+      if(!i)
+        // Other's burst is only submitted once busy holds the executor's thread
+        *pOther += [nBusy, nBusyAtOther] { *nBusyAtOther = nBusy->load(); };
+      ++*nBusy;
+      fn(i);
+    };
+
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+
+  // Other's event is pended late, so let everything run before shutting down, which would abort it
+  auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while((*nBusy < count || *nBusyAtOther < 0) && std::chrono::steady_clock::now() < giveUp)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  ctxt->SignalShutdown(true);
+  EXPECT_EQ(count, *nBusy) << "Not every event of the busy job was dispatched";
+  return *nBusyAtOther;
+}
+
+TEST_F(CoreJobTest, LongBurstYieldsToOtherJobs) {
+  AutoCurrentContext ctxt;
+  AutoRequired<CoreJobExecutor> executor(ctxt, 1);
+  AutoRequired<NumberedJob<0>> busy;
+  AutoRequired<NumberedJob<1>> other;
+
+  // Both jobs share the executor's only thread, so the second job can only run if the first one yields
+  int nBusyAtOther = RunAlongside(*busy, *other, 1000, [] (int) {});
+  ASSERT_LE(0, nBusyAtOther) << "The other job never ran";
+  ASSERT_GT(1000, nBusyAtOther) << "A job held the executor's only thread until its queue was empty";
+}
+
+TEST_F(CoreJobTest, ThrowingBurstYieldsToOtherJobs) {
+  AutoCurrentContext ctxt;
+  AutoRequired<CoreJobExecutor> executor(ctxt, 1);
+  AutoRequired<NumberedJob<0>> busy;
+  AutoRequired<NumberedJob<1>> other;
+
+  // Every tenth event throws, after several others have run in the same batch.  None of this may let the
+  // busy job hold on to the thread for longer than a single burst.
+  int nBusyAtOther = RunAlongside(
+    *busy, *other, 1000,
+    [] (int i) {
+      if(i % 10 == 9)
+        throw std::runtime_error("Event failed");
+    }
+  );
+  ASSERT_LE(0, nBusyAtOther) << "The other job never ran";
+  ASSERT_GT(100, nBusyAtOther) << "A burst of throwing events ran far past its bound";
+}
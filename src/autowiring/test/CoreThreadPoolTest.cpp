@@ -0,0 +1,128 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include <autowiring/CoreThreadPool.h>
+#include <set>
+#include ATOMIC_HEADER
+#include THREAD_HEADER
+
+class CoreThreadPoolTest:
+  public testing::Test
+{};
+
+class FourWorkerPool:
+  public CoreThreadPool
+{
+public:
+  FourWorkerPool(void) :
+    CoreThreadPool(4)
+  {}
+};
+
+TEST_F(CoreThreadPoolTest, RunsPendedWork) {
+  AutoCurrentContext ctxt;
+  AutoRequired<FourWorkerPool> pool;
+  ASSERT_EQ(4UL, pool->GetWorkerCount());
+
+  // Work pended before the context is initiated should be held until it is
+  auto count = std::make_shared<std::atomic<int>>(0);
+  for(int i = 0; i < 100; i++)
+    *pool += [count] { ++*count; };
+  ctxt->Initiate();
+  for(int i = 0; i < 900; i++)
+    *pool += [count] { ++*count; };
+
+  ctxt->SignalShutdown(true);
+  ASSERT_EQ(1000, *count) << "Pool did not run all pended work during graceful shutdown";
+  ASSERT_FALSE(pool->IsRunning());
+  ASSERT_EQ(0UL, pool->GetPendingCount());
+}
+
+TEST_F(CoreThreadPoolTest, AffinityIsSerialized) {
+  AutoCurrentContext ctxt;
+  AutoRequired<FourWorkerPool> pool;
+  ctxt->Initiate();
+
+  // Per-key state is deliberately unsynchronized, affinity is what protects it
+  std::vector<int> values[8];
+  std::set<std::thread::id> threads[8];
+  for(int i = 0; i < 1000; i++)
+    for(size_t key = 0; key < 8; key++)
+      pool->Pend(key, [&values, &threads, key, i] {
+        values[key].push_back(i);
+        threads[key].insert(std::this_thread::get_id());
+      });
+
+  ctxt->SignalShutdown(true);
+  for(size_t key = 0; key < 8; key++) {
+    ASSERT_EQ(1000UL, values[key].size()) << "Keyed work was lost";
+    ASSERT_TRUE(std::is_sorted(values[key].begin(), values[key].end())) << "Keyed work was run out of order";
+    ASSERT_EQ(1UL, threads[key].size()) << "Keyed work was run by more than one worker";
+  }
+}
+
+TEST_F(CoreThreadPoolTest, IdleWorkersSteal) {
+  AutoCurrentContext ctxt;
+  AutoRequired<FourWorkerPool> pool;
+  ctxt->Initiate();
+
+  // Generate a burst of slow work from inside of one worker, so all of it lands in that worker's queue
+  auto threads = std::make_shared<std::set<std::thread::id>>();
+  auto lock = std::make_shared<std::mutex>();
+  *pool += [pool, threads, lock] {
+    for(int i = 0; i < 40; i++)
+      *pool += [threads, lock] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::lock_guard<std::mutex> lk(*lock);
+        threads->insert(std::this_thread::get_id());
+      };
+  };
+
+  ctxt->SignalShutdown(true);
+  ASSERT_LT(0UL, pool->GetStealCount()) << "Idle workers did not steal from a busy worker";
+  ASSERT_LT(1UL, threads->size()) << "Work pended from a single worker was not spread across the pool";
+}
+
+TEST_F(CoreThreadPoolTest, WorkPendedDuringRundown) {
+  AutoCurrentContext ctxt;
+  AutoRequired<FourWorkerPool> pool;
+  ctxt->Initiate();
+
+  // A chain of lambdas, each pended by its predecessor, must all run during a graceful stop
+  auto count = std::make_shared<std::atomic<int>>(0);
+  std::function<void()> link;
+  link = [pool, count, &link] {
+    if(++*count < 50)
+      *pool += link;
+  };
+  *pool += link;
+
+  pool->Stop(true);
+  ASSERT_TRUE(pool->WaitFor(std::chrono::seconds(5))) << "Pool did not stop in a timely fashion";
+  ASSERT_EQ(50, *count) << "Work pended during rundown was dropped";
+}
+
+TEST_F(CoreThreadPoolTest, AbortDropsWork) {
+  AutoCurrentContext ctxt;
+  AutoRequired<FourWorkerPool> pool;
+  ctxt->Initiate();
+
+  auto blocker = std::make_shared<std::atomic<bool>>(true);
+  auto ran = std::make_shared<std::atomic<int>>(0);
+  for(size_t key = 0; key < 4; key++) {
+    pool->Pend(key, [blocker] {
+      while(*blocker)
+        std::this_thread::yield();
+    });
+    for(int i = 0; i < 10; i++)
+      pool->Pend(key, [ran] { ++*ran; });
+  }
+
+  pool->Stop(false);
+  *blocker = false;
+  ASSERT_TRUE(pool->WaitFor(std::chrono::seconds(5))) << "Pool did not stop in a timely fashion";
+  ASSERT_EQ(0, *ran) << "Work was run after the pool was aborted";
+  ASSERT_TRUE(ran.unique()) << "Work dropped on abort was leaked";
+
+  *pool += [ran] { ++*ran; };
+  ASSERT_TRUE(ran.unique()) << "Work pended after abort was accepted";
+}
@@ -5,6 +5,10 @@
 #include <autowiring/Autowired.h>
 #include THREAD_HEADER
 
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
 class CoreThreadTest:
   public testing::Test
 {};
@@ -437,3 +441,239 @@ TEST_F(CoreThreadTest, PendAfterShutdown) {
   // Verify that the lambda was destroyed more or less right away
   ASSERT_TRUE(v.unique()) << "Shared pointer in a lambda closure appears to have been leaked";
 }
+
+class BatchingThread:
+  public CoreThread
+{
+public:
+  BatchingThread(void):
+    nBatches(0)
+  {
+    SetDispatchBatchSize(16);
+  }
+
+  std::atomic<int> nBatches;
+
+protected:
+  void OnBatchEnd(size_t nDispatched) override {
+    nBatches++;
+  }
+};
+
+TEST_F(CoreThreadTest, BatchedDispatch) {
+  AutoRequired<BatchingThread> bt;
+
+  // Pend everything before the thread starts so the whole backlog is available at once:
+  int count = 0;
+  for(size_t i = 0; i < 64; i++)
+    *bt += [&count] { count++; };
+
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  bt->Stop(true);
+  ASSERT_TRUE(bt->WaitFor(std::chrono::seconds(5))) << "Batching thread did not exit in a timely fashion";
+
+  ASSERT_EQ(64, count) << "Not all events pended to a batching thread were dispatched";
+  ASSERT_GE(5, bt->nBatches) << "Batching thread took more lock acquisitions than its batch size allows";
+}
+
+TEST_F(CoreThreadTest, CancelDelayedDispatch) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<CoreThread> t;
+
+  auto x = std::make_shared<bool>(false);
+  auto y = std::make_shared<bool>(false);
+  DispatchTimerHandle cancelled = (*t += std::chrono::milliseconds(5), [x] { *x = true; });
+  DispatchTimerHandle kept = (*t += std::chrono::milliseconds(5), [y] { *y = true; });
+  ASSERT_TRUE(cancelled.IsPending());
+
+  ASSERT_TRUE(cancelled.Cancel()) << "Failed to cancel a pending delayed dispatch";
+  ASSERT_FALSE(cancelled.IsPending()) << "A cancelled timer was still reported as pending";
+  ASSERT_TRUE(x.unique()) << "A cancelled delayed dispatch was not destroyed at cancellation time";
+  ASSERT_FALSE(cancelled.Cancel()) << "A timer was cancelled twice";
+
+  *t += std::chrono::milliseconds(20), [t] { t->Stop(true); };
+  ASSERT_TRUE(t->WaitFor(std::chrono::seconds(5)));
+  ASSERT_FALSE(*x) << "A cancelled delayed dispatch was run";
+  ASSERT_TRUE(*y) << "Cancelling one delayed dispatch prevented another from running";
+  ASSERT_FALSE(kept.Cancel()) << "Cancelled a delayed dispatch that had already been promoted";
+}
+
+TEST_F(CoreThreadTest, RescheduleDelayedDispatch) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<CoreThread> t;
+
+  auto x = std::make_shared<bool>(false);
+  DispatchTimerHandle handle = (*t += std::chrono::hours(1), [x] { *x = true; });
+  ASSERT_TRUE(handle.Reschedule(std::chrono::milliseconds(1))) << "Failed to reschedule a pending delayed dispatch";
+
+  *t += std::chrono::milliseconds(20), [t] { t->Stop(true); };
+  ASSERT_TRUE(t->WaitFor(std::chrono::seconds(5)));
+  ASSERT_TRUE(*x) << "A delayed dispatch rescheduled to an earlier time was not run";
+}
+
+TEST_F(CoreThreadTest, PeriodicDispatch) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<CoreThread> t;
+
+  auto count = std::make_shared<std::atomic<int>>(0);
+  auto start = std::chrono::steady_clock::now();
+  DispatchTimerHandle handle = t->PendPeriodic(start, std::chrono::milliseconds(2), [count] { ++*count; });
+
+  // Wait for a few periods to elapse:
+  for(int i = 0; i < 500 && *count < 5; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  ASSERT_LE(5, *count) << "A periodic dispatch was not repeated";
+
+  ASSERT_TRUE(handle.Cancel()) << "Failed to cancel a periodic dispatch";
+  int nCalls = *count;
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  ASSERT_GE(nCalls + 1, *count) << "A periodic dispatch kept running after it was cancelled";
+}
+
+TEST_F(CoreThreadTest, DispatchQueueStats) {
+  AutoCurrentContext ctxt;
+  AutoRequired<CoreThread> t;
+  t->SetInstrumented(true);
+
+  // Pend everything before the thread starts, so it all sits in the queue for a while:
+  for(int i = 0; i < 10; i++)
+    *t += [] { std::this_thread::sleep_for(std::chrono::microseconds(100)); };
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  ctxt->Initiate();
+  *t += [t] { t->Stop(true); };
+  ASSERT_TRUE(t->WaitFor(std::chrono::seconds(5)));
+
+  auto stats = ctxt->GetDispatchQueueStats();
+  ASSERT_EQ(1UL, stats.size()) << "Context did not list its dispatch queue";
+  const DispatchQueueStats& s = stats[0];
+  ASSERT_TRUE(s.instrumented);
+  ASSERT_NE(std::string::npos, s.name.find("CoreThread")) << "Queue was not identified by its type";
+  // Stopping the thread may pend work of its own, so there might be more than we pended here
+  ASSERT_LE(11UL, s.nPended);
+  ASSERT_EQ(s.nPended, s.nDispatched) << "Not every pended event was counted as dispatched";
+  ASSERT_LE(10UL, s.maxDepth) << "Maximum queue depth was not tracked";
+  ASSERT_EQ(s.nDispatched, s.queueDelay.count);
+  ASSERT_LE(std::chrono::milliseconds(2), s.queueDelay.max) << "Queueing delay did not include time spent waiting for the thread to start";
+  ASSERT_LE(std::chrono::microseconds(100), s.execTime.Percentile(0.5)) << "Execution time was not recorded";
+  ASSERT_LT(0.0, s.Throughput());
+}
+
+TEST_F(CoreThreadTest, UninstrumentedQueueHasNoStats) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<CoreThread> t;
+  *t += [t] { t->Stop(true); };
+  ASSERT_TRUE(t->WaitFor(std::chrono::seconds(5)));
+
+  DispatchQueueStats s = t->GetStats();
+  ASSERT_FALSE(s.instrumented);
+  ASSERT_EQ(0UL, s.nDispatched);
+  ASSERT_EQ(0UL, s.execTime.count);
+}
+
+TEST_F(CoreThreadTest, SpinningThreadNeedsNoWakeup) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<CoreThread> t;
+  t->SetWaitStrategy(CoreThreadWaitStrategy(std::chrono::seconds(10), std::chrono::nanoseconds::zero(), false));
+
+  // Let the thread find its queue empty and start spinning:
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+  std::atomic<int> count(0);
+  for(int i = 0; i < 10; i++) {
+    *t += [&count] { count++; };
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  *t += [t] { t->Stop(true); };
+  ASSERT_TRUE(t->WaitFor(std::chrono::seconds(5)));
+  ASSERT_EQ(10, count);
+  ASSERT_EQ(0UL, t->GetWakeupCount()) << "A spinning thread had to be woken up to receive work";
+}
+
+TEST_F(CoreThreadTest, InfrequentWorkParksSpinningThread) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<CoreThread> t;
+  t->SetWaitStrategy(CoreThreadWaitStrategy(std::chrono::microseconds(50), std::chrono::microseconds(50)));
+  ASSERT_TRUE(t->GetWaitStrategy().adaptive);
+
+  // Work arriving far apart should teach the thread to park right away rather than spin:
+  std::atomic<int> count(0);
+  for(int i = 0; i < 20; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    *t += [&count] { count++; };
+  }
+  *t += [t] { t->Stop(true); };
+  ASSERT_TRUE(t->WaitFor(std::chrono::seconds(5)));
+  ASSERT_EQ(20, count);
+  ASSERT_LT(0UL, t->GetWakeupCount()) << "Thread never parked even though work arrived infrequently";
+}
+
+#ifdef __linux__
+TEST_F(CoreThreadTest, WatchedDescriptorRunsOnDispatchLoop) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<CoreThread> t;
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+
+  std::atomic<int> nRead(0);
+  std::atomic<bool> onThread(true);
+  std::thread::id threadId;
+  *t += [&threadId] { threadId = std::this_thread::get_id(); };
+  ASSERT_TRUE(t->Watch(fds[0], DispatchPollReadable, [&](uint32_t events) {
+    char c;
+    if((events & DispatchPollReadable) && read(fds[0], &c, 1) == 1)
+      nRead++;
+    if(std::this_thread::get_id() != threadId)
+      onThread = false;
+  }));
+
+  // Readiness and ordinary events must both wake the thread from its single blocking point:
+  for(int i = 0; i < 5; i++) {
+    ASSERT_EQ(1, write(fds[1], "x", 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto called = std::make_shared<std::atomic<bool>>(false);
+  *t += [called] { *called = true; };
+  *t += std::chrono::milliseconds(5), [t] { t->Stop(true); };
+  ASSERT_TRUE(t->WaitFor(std::chrono::seconds(5)));
+
+  ASSERT_EQ(5, nRead) << "Not every write was delivered to the watch callback";
+  ASSERT_TRUE(onThread) << "Watch callback was not run on the watching thread";
+  ASSERT_TRUE(*called) << "A pended event did not wake a thread blocked in its poller";
+
+  ASSERT_TRUE(t->Unwatch(fds[0]));
+  ASSERT_FALSE(t->Unwatch(fds[0]));
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_F(CoreThreadTest, UnwatchedDescriptorIsIgnored) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<CoreThread> t;
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+
+  std::atomic<int> nCalls(0);
+  ASSERT_TRUE(t->Watch(fds[0], DispatchPollReadable, [&nCalls](uint32_t) { nCalls++; }));
+  ASSERT_TRUE(t->Unwatch(fds[0]));
+
+  // Left unread, this would call back continuously if the descriptor were still watched
+  ASSERT_EQ(1, write(fds[1], "x", 1));
+  *t += std::chrono::milliseconds(10), [t] { t->Stop(true); };
+  ASSERT_TRUE(t->WaitFor(std::chrono::seconds(5)));
+  ASSERT_EQ(0, nCalls);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+#endif
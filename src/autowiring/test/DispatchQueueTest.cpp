@@ -2,6 +2,9 @@
 #include "stdafx.h"
 #include <autowiring/CoreThread.h>
 #include <autowiring/DispatchQueue.h>
+#include ARRAY_HEADER
+#include FUTURE_HEADER
+#include THREAD_HEADER
 
 using namespace std;
 
@@ -68,3 +71,367 @@ TEST_F(DispatchQueueTest, PathologicalStartAndStop){
 }
 
 
+TEST_F(DispatchQueueTest, SlabIsRecycled) {
+  int count = 0;
+
+  // Pend and dispatch far more small thunks than a single slab chunk can hold:
+  for(size_t i = 0; i < 10 * DispatchThunkSlab::c_blocksPerChunk; i++) {
+    *this += [&count] { ++count; };
+    *this += [&count] { ++count; };
+    DispatchAllEvents();
+  }
+
+  ASSERT_EQ(20 * DispatchThunkSlab::c_blocksPerChunk, (size_t)count) << "Not all pended thunks were dispatched";
+  ASSERT_EQ(DispatchThunkSlab::c_blocksPerChunk, m_slab.GetCapacity()) << "Dispatch slab grew even though thunks were being released";
+}
+
+TEST_F(DispatchQueueTest, LargeCaptureFallsBackToHeap) {
+  std::array<char, 4 * AUTOWIRING_DISPATCH_INLINE_SIZE> big;
+  big.fill(0);
+  big.back() = 42;
+
+  char observed = 0;
+  *this += [big, &observed] { observed = big.back(); };
+  ASSERT_EQ(0UL, m_slab.GetCapacity()) << "An oversized capture was placed on the dispatch slab";
+
+  ASSERT_EQ(1, DispatchAllEvents());
+  ASSERT_EQ(42, observed) << "Oversized capture was not correctly preserved";
+}
+
+TEST_F(DispatchQueueTest, LvalueCallableIsCopied) {
+  auto counter = std::make_shared<int>(0);
+  {
+    auto fn = [counter] { ++*counter; };
+    *this += fn;
+  }
+
+  // The lambda passed above has gone out of scope, the queue must have taken a copy
+  ASSERT_EQ(2L, counter.use_count()) << "Dispatch queue did not take ownership of a copy of an lvalue callable";
+  ASSERT_EQ(1, DispatchAllEvents());
+  ASSERT_EQ(1, *counter);
+}
+
+class BatchObservingQueue:
+  public DispatchQueue
+{
+public:
+  BatchObservingQueue(void):
+    nBegin(0),
+    nEnd(0),
+    lastBatchSize(0),
+    lastDispatched(0)
+  {}
+
+  int nBegin;
+  int nEnd;
+  size_t lastBatchSize;
+  size_t lastDispatched;
+
+  using DispatchQueue::DispatchBatch;
+  using DispatchQueue::DispatchAllEvents;
+
+protected:
+  void OnBatchBegin(size_t nEvents) override {
+    nBegin++;
+    lastBatchSize = nEvents;
+  }
+
+  void OnBatchEnd(size_t nDispatched) override {
+    nEnd++;
+    lastDispatched = nDispatched;
+  }
+};
+
+TEST_F(DispatchQueueTest, BatchBoundaries) {
+  BatchObservingQueue dq;
+  std::vector<int> order;
+  for(int i = 0; i < 10; i++)
+    dq += [&order, i] { order.push_back(i); };
+
+  ASSERT_EQ(4UL, dq.DispatchBatch(4)) << "Bounded batch dispatched an unexpected number of events";
+  ASSERT_EQ(1, dq.nBegin);
+  ASSERT_EQ(4UL, dq.lastBatchSize);
+  ASSERT_EQ(4UL, dq.lastDispatched);
+
+  // Remainder should be picked up in one batch:
+  ASSERT_EQ(6, dq.DispatchAllEvents());
+  ASSERT_EQ(2, dq.nBegin) << "Remaining events were not dispatched as a single batch";
+  ASSERT_EQ(2, dq.nEnd);
+
+  for(int i = 0; i < 10; i++)
+    ASSERT_EQ(i, order[i]) << "Batched dispatch did not preserve queue order";
+}
+
+TEST_F(DispatchQueueTest, BatchExceptionRequeuesRemainder) {
+  BatchObservingQueue dq;
+  int count = 0;
+  dq += [&count] { count++; };
+  dq += [] { throw std::runtime_error("Batch interrupted"); };
+  dq += [&count] { count++; };
+  dq += [&count] { count++; };
+
+  ASSERT_THROW(dq.DispatchBatch(), std::runtime_error);
+  ASSERT_EQ(1, count) << "Events after a throwing event were run in the same batch";
+  ASSERT_EQ(2UL, dq.lastDispatched) << "Batch end hook reported the wrong number of dispatched events";
+  ASSERT_EQ(2UL, dq.GetDispatchQueueLength()) << "Undispatched events were not returned to the queue";
+
+  ASSERT_EQ(2, dq.DispatchAllEvents());
+  ASSERT_EQ(3, count);
+}
+
+class ThrowingBatchEndQueue:
+  public DispatchQueue
+{
+public:
+  using DispatchQueue::DispatchBatch;
+
+protected:
+  void OnBatchEnd(size_t nDispatched) override {
+    throw std::runtime_error("Batch end failed");
+  }
+};
+
+TEST_F(DispatchQueueTest, BatchEndMayThrow) {
+  ThrowingBatchEndQueue dq;
+  int count = 0;
+  dq += [&count] { count++; };
+  dq += [] { throw std::logic_error("Batch interrupted"); };
+  dq += [&count] { count++; };
+
+  // The hook's exception replaces the thunk's, rather than terminating the process
+  ASSERT_THROW(dq.DispatchBatch(), std::runtime_error);
+  ASSERT_EQ(1, count);
+  ASSERT_EQ(1UL, dq.GetDispatchQueueLength()) << "Undispatched events were not returned to the queue";
+
+  ASSERT_THROW(dq.DispatchBatch(), std::runtime_error);
+  ASSERT_EQ(2, count) << "The batch end hook ran before the batch was finished";
+}
+
+TEST_F(DispatchQueueTest, BatchAbortDropsRemainder) {
+  BatchObservingQueue dq;
+  auto sentinel = std::make_shared<bool>(false);
+  dq += [&dq] { dq.Abort(); };
+  dq += [sentinel] { *sentinel = true; };
+
+  ASSERT_EQ(1UL, dq.DispatchBatch()) << "Batch continued running after the queue was aborted";
+  ASSERT_FALSE(*sentinel) << "An event was run after its queue was aborted";
+  ASSERT_TRUE(sentinel.unique()) << "Events remaining in an aborted batch were leaked";
+  ASSERT_EQ(0UL, dq.GetDispatchQueueLength());
+}
+
+TEST_F(DispatchQueueTest, RejectNewestReleasesThunk) {
+  SetDispatcherCap(1);
+  *this += [] {};
+
+  auto x = std::make_shared<bool>(false);
+  *this += [x] { *x = true; };
+  auto fn = [x] { *x = true; };
+  AddExisting(new DispatchThunk<decltype(fn)>(fn));
+
+  ASSERT_EQ(2UL, GetDroppedCount()) << "Dropped events were not counted";
+  ASSERT_EQ(2L, x.use_count()) << "A thunk passed to AddExisting was leaked when the queue was full";
+  ASSERT_EQ(1, DispatchAllEvents());
+  ASSERT_FALSE(*x);
+}
+
+TEST_F(DispatchQueueTest, EvictOldest) {
+  SetDispatcherCap(2);
+  SetOverflowPolicy(DispatchOverflowPolicy::EvictOldest);
+
+  std::vector<int> order;
+  for(int i = 0; i < 5; i++)
+    *this += [&order, i] { order.push_back(i); };
+
+  ASSERT_EQ(3UL, GetEvictedCount()) << "Evicted events were not counted";
+  ASSERT_EQ(0UL, GetDroppedCount()) << "Evicting policy reported a drop";
+  ASSERT_EQ(2, DispatchAllEvents());
+  ASSERT_EQ((std::vector<int>{3, 4}), order) << "Queue did not retain the newest events";
+}
+
+TEST_F(DispatchQueueTest, BlockWaitsForRoom) {
+  SetDispatcherCap(1);
+  SetOverflowPolicy(DispatchOverflowPolicy::Block, std::chrono::seconds(5));
+  *this += [] {};
+
+  bool ran = false;
+  auto producer = std::async(std::launch::async, [this, &ran] {
+    *this += [&ran] { ran = true; };
+  });
+  ASSERT_EQ(std::future_status::timeout, producer.wait_for(std::chrono::milliseconds(20))) << "Producer did not block on a full queue";
+
+  // Making room should let the producer through:
+  ASSERT_TRUE(DispatchEvent());
+  ASSERT_EQ(std::future_status::ready, producer.wait_for(std::chrono::seconds(5))) << "Blocked producer was not released when room was made";
+  ASSERT_EQ(1, DispatchAllEvents());
+  ASSERT_TRUE(ran);
+  ASSERT_EQ(0UL, GetDroppedCount());
+
+  // And a producer that runs out of patience should drop its event:
+  SetOverflowPolicy(DispatchOverflowPolicy::Block, std::chrono::milliseconds(1));
+  *this += [] {};
+  *this += [] {};
+  ASSERT_EQ(1UL, GetDroppedCount()) << "Timed out producer did not count its event as dropped";
+}
+
+TEST_F(DispatchQueueTest, KeyedPendReplacesInPlace) {
+  std::vector<int> order;
+  ASSERT_FALSE(PendKeyed(1, [&order] { order.push_back(1); }));
+  *this += [&order] { order.push_back(2); };
+
+  auto x = std::make_shared<bool>(false);
+  ASSERT_TRUE(PendKeyed(1, [&order, x] { order.push_back(3); })) << "A pend with an outstanding key was not coalesced";
+  ASSERT_TRUE(PendKeyed(1, [&order] { order.push_back(4); }));
+  ASSERT_TRUE(x.unique()) << "A replaced thunk was not destroyed";
+  ASSERT_EQ(2UL, GetDispatchQueueLength()) << "Replacing a keyed thunk grew the queue";
+  ASSERT_EQ(2UL, GetCoalescedCount());
+
+  ASSERT_EQ(2, DispatchAllEvents());
+  ASSERT_EQ((std::vector<int>{4, 2}), order) << "Replacement did not keep the queue position of the thunk it replaced";
+
+  // Once run, the key is free again:
+  ASSERT_FALSE(PendKeyed(1, [] {}));
+  ASSERT_EQ(1, DispatchAllEvents());
+}
+
+TEST_F(DispatchQueueTest, CoalescePolicyAdmitsKeyed) {
+  SetDispatcherCap(1);
+  SetOverflowPolicy(DispatchOverflowPolicy::Coalesce);
+  *this += [] {};
+
+  *this += [] {};
+  ASSERT_EQ(1UL, GetDroppedCount()) << "An unkeyed event was admitted past the cap";
+
+  for(size_t i = 0; i < 10; i++)
+    PendKeyed(i % 2, [] {});
+  ASSERT_EQ(1UL, GetDroppedCount()) << "A keyed event was dropped under the coalescing policy";
+  ASSERT_EQ(3UL, GetDispatchQueueLength()) << "Keyed events were not bounded by the number of keys";
+
+  // Evicting a keyed thunk must free its key:
+  SetOverflowPolicy(DispatchOverflowPolicy::EvictOldest);
+  for(size_t i = 0; i < 3; i++)
+    *this += [] {};
+  ASSERT_FALSE(PendKeyed(0, [] {})) << "A key held by an evicted thunk was not released";
+  ASSERT_EQ(3, DispatchAllEvents());
+}
+
+TEST_F(DispatchQueueTest, AsyncThenChainsWithoutBlocking) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<Thread<10>> worker;
+
+  // The continuation comes back to this queue, so nothing runs it until we dispatch:
+  std::thread::id workerId, continuationId;
+  auto result = worker->Async([&workerId] {
+    workerId = std::this_thread::get_id();
+    return 21;
+  }).Then(*this, [&continuationId] (int value) {
+    continuationId = std::this_thread::get_id();
+    return std::to_string(value * 2);
+  });
+
+  for(int i = 0; i < 500 && !AreAnyDispatchersReady(); i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  ASSERT_FALSE(result.IsReady()) << "Continuation ran before being dispatched on its target queue";
+  ASSERT_EQ(1, DispatchAllEvents());
+  ASSERT_TRUE(result.IsReady());
+  ASSERT_EQ("42", result.Get());
+  ASSERT_NE(workerId, continuationId);
+  ASSERT_EQ(std::this_thread::get_id(), continuationId);
+
+  worker->Stop(true);
+  worker->Wait();
+}
+
+TEST_F(DispatchQueueTest, AsyncExceptionSkipsContinuations) {
+  bool called = false;
+  auto result = Async([] () -> int { throw std::runtime_error("failed"); })
+    .Then(*this, [&called] (int) { called = true; })
+    .Then(*this, [&called] { called = true; });
+
+  ASSERT_EQ(1, DispatchAllEvents()) << "Continuations were pended even though their antecedent threw";
+  ASSERT_TRUE(result.IsReady());
+  ASSERT_FALSE(called);
+  ASSERT_THROW(result.Get(), std::runtime_error);
+}
+
+struct RefusesEverything {
+  template<class Fn>
+  void operator+=(Fn&&) {
+    throw std::runtime_error("Queue refused a thunk");
+  }
+};
+
+TEST_F(DispatchQueueTest, ThrowingContinuationDoesNotStrandOthers) {
+  RefusesEverything refuses;
+  auto antecedent = Async([] { return 1; });
+  auto refused = antecedent.Then(refuses, [] (int value) { return value; });
+  auto accepted = antecedent.Then(*this, [] (int value) { return value + 1; });
+
+  // The antecedent, and then the one continuation that could be pended:
+  ASSERT_EQ(2, DispatchAllEvents()) << "A continuation registered after one that threw was never pended";
+  ASSERT_TRUE(refused.IsReady()) << "A continuation which could not be pended never completed its future";
+  ASSERT_THROW(refused.Get(), std::runtime_error);
+  ASSERT_EQ(2, accepted.Get());
+}
+
+TEST_F(DispatchQueueTest, DroppedAsyncIsBroken) {
+  SetDispatcherCap(0);
+  auto result = Async([] { return 1; });
+  ASSERT_TRUE(result.IsReady()) << "Future for a dropped thunk was never completed";
+  ASSERT_THROW(result.Get(), dispatch_aborted_exception);
+}
+
+#if AUTOWIRING_USE_COROUTINES
+#include <autowiring/DispatchCoroutine.h>
+
+static DispatchCoroutine HopBetweenQueues(DispatchQueue& worker, DispatchQueue& home, std::vector<std::thread::id>& ids) {
+  co_await worker;
+  ids.push_back(std::this_thread::get_id());
+
+  co_await autowiring::after(std::chrono::milliseconds(1));
+  ids.push_back(std::this_thread::get_id());
+
+  co_await home;
+  ids.push_back(std::this_thread::get_id());
+}
+
+TEST_F(DispatchQueueTest, CoroutineHopsBetweenQueues) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+  AutoRequired<Thread<11>> worker;
+
+  std::vector<std::thread::id> ids;
+  HopBetweenQueues(*worker, *this, ids);
+  for(int i = 0; i < 500 && !AreAnyDispatchersReady(); i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  ASSERT_EQ(1, DispatchAllEvents()) << "Coroutine did not come back to its home queue";
+
+  ASSERT_EQ(3UL, ids.size());
+  ASSERT_NE(std::this_thread::get_id(), ids[0]);
+  ASSERT_EQ(ids[0], ids[1]) << "Coroutine did not resume from a delay on the queue it was running on";
+  ASSERT_EQ(std::this_thread::get_id(), ids[2]);
+
+  worker->Stop(true);
+  worker->Wait();
+}
+
+TEST_F(DispatchQueueTest, DroppedCoroutineIsDestroyed) {
+  struct Sentry {
+    Sentry(bool& destroyed) : destroyed(destroyed) {}
+    ~Sentry(void) { destroyed = true; }
+    bool& destroyed;
+  };
+
+  bool resumed = false;
+  bool destroyed = false;
+  SetDispatcherCap(0);
+  [] (DispatchQueue& queue, bool& resumed, bool& destroyed) -> DispatchCoroutine {
+    Sentry sentry(destroyed);
+    co_await queue;
+    resumed = true;
+  }(*this, resumed, destroyed);
+
+  ASSERT_FALSE(resumed);
+  ASSERT_TRUE(destroyed) << "Frame of a coroutine whose resumption was dropped was leaked";
+}
+#endif
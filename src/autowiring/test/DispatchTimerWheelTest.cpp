@@ -0,0 +1,204 @@
+// Copyright (C) 2012-2014 Leap Motion, Inc. All rights reserved.
+#include "stdafx.h"
+#include <autowiring/DispatchTimerWheel.h>
+
+using namespace std;
+using std::chrono::milliseconds;
+using std::chrono::hours;
+
+class DispatchTimerWheelTest:
+  public testing::Test
+{
+public:
+  DispatchTimerWheelTest(void) :
+    start(std::chrono::steady_clock::now())
+  {}
+
+  const std::chrono::steady_clock::time_point start;
+
+  // Timers may be reported up to one tick after their deadline
+  const milliseconds tick = milliseconds(1);
+
+  // Allocates a heap thunk which appends the specified value to the order vector when called
+  DispatchThunkBase* MakeThunk(int value) {
+    auto fn = [this, value] { order.push_back(value); };
+    return new DispatchThunk<decltype(fn)>(fn);
+  }
+
+  // Allocates a periodic prototype thunk which increments the specified counter when called
+  DispatchThunkPeriodic* MakePeriodic(const std::shared_ptr<int>& count) {
+    auto fn = [count] { ++*count; };
+    return new DispatchThunkPeriodic(
+      std::shared_ptr<DispatchThunkBase>(new DispatchThunk<decltype(fn)>(fn), DispatchThunkReleaser())
+    );
+  }
+
+  // Promotes everything ready as of the specified offset from the start time and calls it
+  size_t RunUntil(DispatchTimerWheel& wheel, std::chrono::steady_clock::duration offset) {
+    std::deque<DispatchThunkBase*> ready;
+    size_t retVal = wheel.PromoteReady(start + offset, ready);
+    for(DispatchThunkBase* thunk : ready) {
+      (*thunk)();
+      thunk->Release();
+    }
+    return retVal;
+  }
+
+  std::vector<int> order;
+};
+
+TEST_F(DispatchTimerWheelTest, ReadyInDeadlineOrder) {
+  DispatchTimerWheel wheel;
+
+  // Spread across the first two levels, inserted out of order
+  wheel.Add(start + milliseconds(900), MakeThunk(4));
+  wheel.Add(start + milliseconds(3), MakeThunk(1));
+  wheel.Add(start + milliseconds(300), MakeThunk(3));
+  wheel.Add(start + milliseconds(3), MakeThunk(2));
+  ASSERT_EQ(4UL, wheel.Size());
+
+  ASSERT_EQ(0UL, RunUntil(wheel, milliseconds(1))) << "A timer was reported ready early";
+  ASSERT_EQ(2UL, RunUntil(wheel, milliseconds(10)));
+  ASSERT_EQ(2UL, RunUntil(wheel, milliseconds(1000)));
+  ASSERT_TRUE(wheel.Empty());
+
+  std::vector<int> expected{1, 2, 3, 4};
+  ASSERT_EQ(expected, order) << "Timers were not promoted in deadline order, or equal deadlines were reordered";
+}
+
+TEST_F(DispatchTimerWheelTest, NeverEarly) {
+  DispatchTimerWheel wheel;
+
+  // Cascading from the upper levels must not release a timer before its deadline
+  wheel.Add(start + milliseconds(20000), MakeThunk(1));
+  for(int i = 0; i < 20000; i += 7)
+    ASSERT_EQ(0UL, RunUntil(wheel, milliseconds(i))) << "Timer fired at " << i << "ms, before its deadline";
+  ASSERT_EQ(1UL, RunUntil(wheel, milliseconds(20001)));
+}
+
+TEST_F(DispatchTimerWheelTest, CancelIsImmediate) {
+  DispatchTimerWheel wheel;
+  auto a = wheel.Add(start + milliseconds(5), MakeThunk(1));
+  auto b = wheel.Add(start + milliseconds(5000), MakeThunk(2));
+  auto c = wheel.Add(start + hours(48), MakeThunk(3));
+  ASSERT_EQ(3UL, wheel.Size());
+
+  DispatchThunkBase* thunk = wheel.Remove(b);
+  ASSERT_NE(nullptr, thunk) << "A pending timer could not be cancelled";
+  thunk->Release();
+  ASSERT_EQ(nullptr, wheel.Remove(b)) << "A timer was cancelled twice";
+
+  thunk = wheel.Remove(c);
+  ASSERT_NE(nullptr, thunk) << "An overflow timer could not be cancelled";
+  thunk->Release();
+  ASSERT_EQ(1UL, wheel.Size());
+
+  ASSERT_EQ(1UL, RunUntil(wheel, hours(72)));
+  ASSERT_EQ(std::vector<int>{1}, order) << "A cancelled timer was promoted";
+
+  // Identifier of a timer that has already fired must now be stale, even if its storage is reused
+  wheel.Add(start + milliseconds(5), MakeThunk(4));
+  ASSERT_EQ(nullptr, wheel.Remove(a)) << "A stale timer identifier cancelled an unrelated timer";
+  ASSERT_EQ(1UL, wheel.Size());
+}
+
+TEST_F(DispatchTimerWheelTest, LongTimersOverflow) {
+  DispatchTimerWheel wheel;
+  wheel.Add(start + hours(30), MakeThunk(2));
+  wheel.Add(start + hours(20), MakeThunk(1));
+  wheel.Add(start + milliseconds(1), MakeThunk(0));
+
+  ASSERT_EQ(1UL, RunUntil(wheel, milliseconds(2)));
+  ASSERT_EQ(0UL, RunUntil(wheel, hours(19)));
+  ASSERT_EQ(1UL, RunUntil(wheel, hours(20) + tick));
+  ASSERT_EQ(0UL, RunUntil(wheel, hours(29)));
+  ASSERT_EQ(1UL, RunUntil(wheel, hours(30) + tick));
+
+  std::vector<int> expected{0, 1, 2};
+  ASSERT_EQ(expected, order);
+}
+
+TEST_F(DispatchTimerWheelTest, NextWakeupBoundsDeadline) {
+  DispatchTimerWheel wheel;
+  ASSERT_EQ(std::chrono::steady_clock::time_point::max(), wheel.NextWakeup());
+
+  wheel.Add(start + milliseconds(40), MakeThunk(0));
+  wheel.Add(start + milliseconds(30000), MakeThunk(1));
+
+  // Sleeping until the suggested wakeup repeatedly must not skip past either deadline
+  for(size_t fired = 0; fired < 2;) {
+    auto wakeup = wheel.NextWakeup();
+    ASSERT_NE(std::chrono::steady_clock::time_point::max(), wakeup);
+    ASSERT_LE(wakeup, start + milliseconds(fired ? 30000 : 40) + tick) << "Suggested wakeup was after the next deadline";
+    fired += RunUntil(wheel, wakeup - start);
+  }
+}
+
+TEST_F(DispatchTimerWheelTest, ResolutionIsConfigurable) {
+  DispatchTimerWheel wheel;
+  ASSERT_TRUE(wheel.SetResolution(std::chrono::microseconds(100)));
+  ASSERT_EQ(std::chrono::microseconds(100), wheel.GetResolution());
+
+  wheel.Add(std::chrono::steady_clock::now() + std::chrono::microseconds(250), MakeThunk(0));
+  ASSERT_FALSE(wheel.SetResolution(milliseconds(10))) << "Resolution was changed with timers pending";
+}
+
+TEST_F(DispatchTimerWheelTest, Reschedule) {
+  DispatchTimerWheel wheel;
+  auto near = wheel.Add(start + milliseconds(5), MakeThunk(1));
+  auto far = wheel.Add(start + hours(48), MakeThunk(2));
+
+  // Push one timer out past the other, and pull the overflow timer in
+  ASSERT_TRUE(wheel.Reschedule(near, start + milliseconds(500)));
+  ASSERT_TRUE(wheel.Reschedule(far, start + milliseconds(50)));
+  ASSERT_EQ(0UL, RunUntil(wheel, milliseconds(10))) << "A timer fired at its original deadline after being rescheduled";
+  ASSERT_EQ(1UL, RunUntil(wheel, milliseconds(50) + tick));
+  ASSERT_EQ(1UL, RunUntil(wheel, milliseconds(500) + tick));
+  ASSERT_EQ(0UL, RunUntil(wheel, hours(49))) << "A rescheduled overflow timer also fired at its original deadline";
+
+  std::vector<int> expected{2, 1};
+  ASSERT_EQ(expected, order);
+  ASSERT_FALSE(wheel.Reschedule(near, start + hours(1))) << "Rescheduled a timer which had already fired";
+}
+
+TEST_F(DispatchTimerWheelTest, PeriodicCatchUp) {
+  DispatchTimerWheel wheel;
+  auto count = std::make_shared<int>(0);
+  auto id = wheel.AddPeriodic(start + milliseconds(10), milliseconds(10), DispatchTimerPolicy::CatchUp, MakePeriodic(count));
+
+  ASSERT_EQ(1UL, RunUntil(wheel, milliseconds(10) + tick));
+  ASSERT_EQ(1, *count);
+
+  // Falling behind by three and a half periods yields all three missed calls at once
+  ASSERT_EQ(3UL, RunUntil(wheel, milliseconds(45)));
+  ASSERT_EQ(4, *count);
+  ASSERT_EQ(start + milliseconds(50), wheel.GetReadyTime(id)) << "Periodic deadline drifted";
+  ASSERT_EQ(1UL, wheel.Size()) << "A periodic timer did not remain pending after firing";
+
+  DispatchThunkBase* thunk = wheel.Remove(id);
+  ASSERT_NE(nullptr, thunk);
+  thunk->Release();
+  ASSERT_TRUE(count.unique()) << "Cancelling a periodic timer leaked its callable";
+}
+
+TEST_F(DispatchTimerWheelTest, PeriodicSkip) {
+  DispatchTimerWheel wheel;
+  auto count = std::make_shared<int>(0);
+  auto id = wheel.AddPeriodic(start + milliseconds(10), milliseconds(10), DispatchTimerPolicy::Skip, MakePeriodic(count));
+
+  // Missed deadlines are folded into a single call, and the schedule stays on the original grid
+  ASSERT_EQ(1UL, RunUntil(wheel, milliseconds(45)));
+  ASSERT_EQ(1, *count);
+  ASSERT_EQ(start + milliseconds(50), wheel.GetReadyTime(id)) << "Periodic deadline drifted";
+}
+
+TEST_F(DispatchTimerWheelTest, PeriodicCatchUpIsBounded) {
+  DispatchTimerWheel wheel;
+  auto count = std::make_shared<int>(0);
+  auto id = wheel.AddPeriodic(start + milliseconds(10), milliseconds(10), DispatchTimerPolicy::CatchUp, MakePeriodic(count), 4);
+
+  // Ten missed deadlines, but only four of them may be dispatched, the rest are skipped
+  ASSERT_EQ(4UL, RunUntil(wheel, milliseconds(105)));
+  ASSERT_EQ(4, *count);
+  ASSERT_EQ(start + milliseconds(110), wheel.GetReadyTime(id)) << "Timer did not resume on the next deadline after falling too far behind";
+}
@@ -4,8 +4,12 @@
 #include "TestFixtures/SimpleReceiver.hpp"
 #include <autowiring/Autowired.h>
 #include <autowiring/CoreThread.h>
+#include <autowiring/CoreThreadPool.h>
+#include <autowiring/demangle.h>
 #include <stdexcept>
 #include <vector>
+#include ATOMIC_HEADER
+#include THREAD_HEADER
 
 using namespace std;
 
@@ -92,6 +96,24 @@ TEST_F(EventReceiverTest, DeferredInvoke) {
   EXPECT_EQ(101, receiver->m_oneArg) << "Argument was not correctly propagated through a deferred call";
 }
 
+TEST_F(EventReceiverTest, CoalescedDeferredInvoke) {
+  AutoRequired<SimpleReceiver> receiver;
+  AutoFired<CallableInterfaceDeferred> sender;
+
+  // The receiver is blocked, so these will all still be pending when the later ones are fired:
+  for(int i = 0; i < 100; i++)
+    sender.Defer(&CallableInterfaceDeferred::OneArgDeferred).Coalesce(i);
+  sender.Defer(&CallableInterfaceDeferred::ZeroArgsDeferred).Coalesce();
+  ASSERT_EQ(2UL, receiver->GetDispatchQueueLength()) << "Coalesced deferred calls were not replaced in place";
+
+  sender.Defer(&CallableInterfaceDeferred::AllDoneDeferred)();
+  receiver->Proceed();
+  receiver->Wait();
+
+  EXPECT_TRUE(receiver->m_zero);
+  EXPECT_EQ(99, receiver->m_oneArg) << "The most recent coalesced call was not the one delivered";
+}
+
 TEST_F(EventReceiverTest, NontrivialCopy) {
   AutoRequired<SimpleReceiver> receiver;
   AutoFired<CallableInterfaceDeferred> sender;
@@ -126,6 +148,57 @@ TEST_F(EventReceiverTest, NontrivialCopy) {
     EXPECT_EQ(i, ascending[i]) << "Element at offset " << i << " was incorrectly copied";
 }
 
+class SharedArgumentInterface {
+public:
+  virtual Deferred ReceiveVector(const std::vector<int>& vec) = 0;
+};
+
+template<int N>
+class SharedArgumentReceiver:
+  public CoreThread,
+  public SharedArgumentInterface
+{
+public:
+  SharedArgumentReceiver(void) :
+    CoreThread("SharedArgumentReceiver"),
+    m_pVec(nullptr)
+  {}
+
+  const std::vector<int>* m_pVec;
+  std::vector<int> m_vec;
+
+  Deferred ReceiveVector(const std::vector<int>& vec) override {
+    m_pVec = &vec;
+    m_vec = vec;
+    return Deferred(this);
+  }
+};
+
+TEST_F(EventReceiverTest, DeferredArgumentsAreSharedByListeners) {
+  AutoRequired<SharedArgumentReceiver<1>> r1;
+  AutoRequired<SharedArgumentReceiver<2>> r2;
+  AutoRequired<SharedArgumentReceiver<3>> r3;
+  AutoFired<SharedArgumentInterface> sender;
+
+  std::vector<int> ascending;
+  for(int i = 0; i < 10; i++)
+    ascending.push_back(i);
+  sender.Defer(&SharedArgumentInterface::ReceiveVector)(ascending);
+
+  // Wait for every listener to get to the event
+  ASSERT_TRUE(r1->Async([] {}).WaitFor(std::chrono::seconds(5))) << "Listener did not process the deferred event";
+  ASSERT_TRUE(r2->Async([] {}).WaitFor(std::chrono::seconds(5))) << "Listener did not process the deferred event";
+  ASSERT_TRUE(r3->Async([] {}).WaitFor(std::chrono::seconds(5))) << "Listener did not process the deferred event";
+
+  // The argument block lives until the last listener is done with it, so all of them saw the same copy
+  EXPECT_EQ(ascending, r1->m_vec);
+  EXPECT_EQ(ascending, r2->m_vec);
+  EXPECT_EQ(ascending, r3->m_vec);
+  EXPECT_NE(&ascending, r1->m_pVec) << "Deferred argument was not copied";
+  EXPECT_EQ(r1->m_pVec, r2->m_pVec) << "Listeners received separate copies of a deferred argument";
+  EXPECT_EQ(r1->m_pVec, r3->m_pVec) << "Listeners received separate copies of a deferred argument";
+}
+
 TEST_F(EventReceiverTest, VerifyNoUnnecessaryCopies) {
   // Verify the counter correctly tracks the number of times it was copied:
   {
@@ -485,3 +558,474 @@ TEST_F(EventReceiverTest, EventChain){
   AutoCurrentContext ctxt;
   ctxt->Invoke(&MyReceiver::MyEvent)();
 }
+
+class CountsEvents {
+public:
+  virtual void Tick(void) = 0;
+};
+
+class LateCounter:
+  public CountsEvents
+{
+public:
+  LateCounter(void) : m_count(0) {}
+  void Tick(void) override { m_count++; }
+  int m_count;
+};
+
+class AddsCounterOnTick:
+  public CountsEvents
+{
+public:
+  void Tick(void) override {
+    AutoRequired<LateCounter>();
+  }
+};
+
+TEST_F(EventReceiverTest, ListenerAddedDuringFireWaitsForNextEvent) {
+  AutoRequired<AddsCounterOnTick> adder;
+  AutoFired<CountsEvents> tick;
+
+  // The fire in progress works from the listeners it started with:
+  tick(&CountsEvents::Tick)();
+  Autowired<LateCounter> counter;
+  ASSERT_TRUE(counter.IsAutowired()) << "Listener was unable to add a listener while an event was being fired";
+  ASSERT_EQ(0, counter->m_count) << "A listener added during a fire received the event being fired";
+
+  tick(&CountsEvents::Tick)();
+  ASSERT_EQ(1, counter->m_count);
+}
+
+class HeavyEvent {
+public:
+  virtual void Process(std::atomic<int>& nArrived) = 0;
+};
+
+template<int N>
+class RendezvousListener:
+  public HeavyEvent
+{
+public:
+  RendezvousListener(void) : m_sawEveryone(false) {}
+  bool m_sawEveryone;
+
+  void Process(std::atomic<int>& nArrived) override {
+    // Returns once all four listeners are running at the same time, which they cannot do if called in turn
+    ++nArrived;
+    auto giveUp = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(nArrived < 4 && std::chrono::steady_clock::now() < giveUp)
+      std::this_thread::yield();
+    m_sawEveryone = nArrived >= 4;
+  }
+};
+
+class FourWorkerEventPool:
+  public CoreThreadPool
+{
+public:
+  FourWorkerEventPool(void) :
+    CoreThreadPool(4)
+  {}
+};
+
+TEST_F(EventReceiverTest, FireParallelCallsListenersConcurrently) {
+  AutoRequired<FourWorkerEventPool> pool;
+  AutoRequired<RendezvousListener<1>> l1;
+  AutoRequired<RendezvousListener<2>> l2;
+  AutoRequired<RendezvousListener<3>> l3;
+  AutoRequired<RendezvousListener<4>> l4;
+  AutoFired<HeavyEvent> sender;
+
+  std::atomic<int> nArrived(0);
+  ASSERT_TRUE(sender.FireParallel(&HeavyEvent::Process)(nArrived));
+  ASSERT_EQ(4, nArrived) << "Not every listener was called";
+  ASSERT_TRUE(l1->m_sawEveryone && l2->m_sawEveryone && l3->m_sawEveryone && l4->m_sawEveryone) << "Listeners were not called concurrently";
+}
+
+class ThrowsOnProcess:
+  public HeavyEvent
+{
+public:
+  void Process(std::atomic<int>& nArrived) override {
+    ++nArrived;
+    throw std::runtime_error("Listener failed");
+  }
+};
+
+template<int N>
+class CountsProcess:
+  public HeavyEvent
+{
+public:
+  void Process(std::atomic<int>& nArrived) override {
+    ++nArrived;
+  }
+};
+
+TEST_F(EventReceiverTest, FireParallelTearsDownThrowingContexts) {
+  AutoRequired<FourWorkerEventPool> pool;
+  AutoRequired<CountsProcess<1>> c1;
+  AutoRequired<CountsProcess<2>> c2;
+  AutoFired<HeavyEvent> sender;
+
+  AutoCreateContext subCtxt;
+  subCtxt->Initiate();
+  subCtxt->Inject<ThrowsOnProcess>();
+
+  std::atomic<int> nArrived(0);
+  ASSERT_FALSE(sender.FireParallel(&HeavyEvent::Process)(nArrived)) << "An exception thrown by a listener was not reported";
+  ASSERT_EQ(3, nArrived) << "Listeners were skipped after another listener threw";
+  ASSERT_TRUE(subCtxt->IsShutdown()) << "The context of a listener which threw was not torn down";
+  ASSERT_FALSE(AutoCurrentContext()->IsShutdown()) << "A context whose listeners did not throw was torn down";
+}
+
+template<int N>
+class RecordsProcessContext:
+  public RendezvousListener<N>
+{
+public:
+  std::shared_ptr<CoreContext> m_context;
+
+  void Process(std::atomic<int>& nArrived) override {
+    m_context = CoreContext::CurrentContext();
+    RendezvousListener<N>::Process(nArrived);
+  }
+};
+
+TEST_F(EventReceiverTest, FireParallelKeepsFiringContextCurrent) {
+  AutoRequired<FourWorkerEventPool> pool;
+
+  // The pool belongs to this context, but the event is fired from a child context
+  AutoCreateContext child;
+  CurrentContextPusher pshr(child);
+  AutoRequired<RecordsProcessContext<1>> r1;
+  AutoRequired<RecordsProcessContext<2>> r2;
+  AutoRequired<RecordsProcessContext<3>> r3;
+  AutoRequired<RecordsProcessContext<4>> r4;
+  child->Initiate();
+  AutoFired<HeavyEvent> sender;
+
+  std::atomic<int> nArrived(0);
+  ASSERT_TRUE(sender.FireParallel(pool, &HeavyEvent::Process)(nArrived));
+  ASSERT_TRUE(r1->m_sawEveryone && r2->m_sawEveryone && r3->m_sawEveryone && r4->m_sawEveryone) << "Listeners were not called on the pool";
+  ASSERT_EQ(child, r1->m_context) << "A listener called on the pool saw the pool's context as current";
+  ASSERT_EQ(child, r2->m_context) << "A listener called on the pool saw the pool's context as current";
+  ASSERT_EQ(child, r3->m_context) << "A listener called on the pool saw the pool's context as current";
+  ASSERT_EQ(child, r4->m_context) << "A listener called on the pool saw the pool's context as current";
+}
+
+class SampleEvents {
+public:
+  virtual void OnSample(int sample) = 0;
+
+  virtual void OnSamples(const std::vector<int>& samples) {
+    for(int sample : samples)
+      OnSample(sample);
+  }
+};
+
+class RecordsSamples:
+  public SampleEvents
+{
+public:
+  std::vector<int> m_samples;
+
+  void OnSample(int sample) override {
+    m_samples.push_back(sample);
+  }
+};
+
+class RecordsSampleBatches:
+  public SampleEvents
+{
+public:
+  RecordsSampleBatches(void) : m_nSingle(0) {}
+
+  int m_nSingle;
+  std::vector<std::vector<int>> m_batches;
+
+  void OnSample(int sample) override {
+    m_nSingle++;
+  }
+
+  void OnSamples(const std::vector<int>& samples) override {
+    m_batches.push_back(samples);
+  }
+};
+
+TEST_F(EventReceiverTest, FireBatchDeliversEveryElementInOrder) {
+  AutoRequired<RecordsSamples> single;
+  AutoRequired<RecordsSampleBatches> batched;
+  AutoFired<SampleEvents> sender;
+
+  std::vector<int> samples;
+  for(int i = 0; i < 100; i++)
+    samples.push_back(i);
+
+  ASSERT_TRUE(sender.FireBatch(&SampleEvents::OnSample, samples));
+  ASSERT_EQ(samples, single->m_samples) << "Batch was not delivered element by element, in order";
+  ASSERT_EQ(100, batched->m_nSingle);
+  ASSERT_TRUE(batched->m_batches.empty()) << "Batch overload was called when only the per-element event was fired";
+}
+
+TEST_F(EventReceiverTest, FireBatchUsesBatchOverload) {
+  AutoRequired<RecordsSamples> single;
+  AutoRequired<RecordsSampleBatches> batched;
+  AutoFired<SampleEvents> sender;
+
+  std::vector<int> samples;
+  for(int i = 0; i < 100; i++)
+    samples.push_back(i);
+
+  ASSERT_TRUE(sender.FireBatch(&SampleEvents::OnSample, &SampleEvents::OnSamples, samples));
+  ASSERT_EQ(samples, single->m_samples) << "Listener without a batch overload did not receive each element";
+  ASSERT_EQ(0, batched->m_nSingle) << "Listener with a batch overload was called per element";
+  ASSERT_EQ(1UL, batched->m_batches.size()) << "Listener with a batch overload was not called once for the batch";
+  ASSERT_EQ(samples, batched->m_batches[0]);
+}
+
+class ScalesSamples {
+public:
+  virtual void Scale(int& sample) = 0;
+};
+
+class DoublesSamples:
+  public ScalesSamples
+{
+public:
+  void Scale(int& sample) override {
+    sample *= 2;
+  }
+};
+
+TEST_F(EventReceiverTest, FireBatchPassesMutableElements) {
+  AutoRequired<DoublesSamples> doubles;
+  AutoFired<ScalesSamples> sender;
+
+  std::vector<int> samples;
+  for(int i = 0; i < 10; i++)
+    samples.push_back(i);
+
+  ASSERT_TRUE(sender.FireBatch(&ScalesSamples::Scale, samples));
+  for(int i = 0; i < 10; i++)
+    ASSERT_EQ(2 * i, samples[i]) << "Listener could not modify the elements of the batch";
+}
+
+class SampledEvent {
+public:
+  virtual void Sampled(void) = 0;
+};
+
+class ReceivesSampledEvent:
+  public SampledEvent
+{
+public:
+  void Sampled(void) override {}
+};
+
+static uint64_t CountOf(const std::vector<EventFiredCount>& counts, const std::type_info& type) {
+  for(const auto& count : counts)
+    if(*count.type == type)
+      return count.nFired;
+  return 0;
+}
+
+TEST_F(EventReceiverTest, EventFiredIsSampledAndCounted) {
+  AutoRequired<ReceivesSampledEvent> receiver;
+  AutoFired<SampledEvent> sender;
+  EventFiredSampler::TakeCounts();
+
+  // Nothing is counted or reported until instrumentation is turned on
+  ASSERT_FALSE(EventFiredSampler::IsEnabled()) << "EventFired reporting should be opt-in";
+  sender(&SampledEvent::Sampled)();
+  ASSERT_EQ(0UL, CountOf(EventFiredSampler::TakeCounts(), typeid(SampledEvent)));
+
+  EventFiredSampler::SetEnabled(true);
+  EventFiredSampler::SetSampleInterval<SampledEvent>(10);
+
+  size_t nReported = 0;
+  for(size_t i = 0; i < 100; i++)
+    if(EventFiredSampler::ShouldReport<SampledEvent>())
+      nReported++;
+  for(size_t i = 0; i < 5; i++)
+    sender(&SampledEvent::Sampled)();
+
+  EventFiredSampler::SetEnabled(false);
+  EventFiredSampler::SetSampleInterval<SampledEvent>(0);
+
+  ASSERT_EQ(10UL, nReported) << "Sample interval was not respected";
+  ASSERT_EQ(105UL, CountOf(EventFiredSampler::TakeCounts(), typeid(SampledEvent))) << "Every fire should be counted, not only sampled fires";
+  ASSERT_EQ(0UL, CountOf(EventFiredSampler::TakeCounts(), typeid(SampledEvent))) << "Counts were not reset when taken";
+}
+
+TEST_F(EventReceiverTest, EventFiredCanBeCountedWithoutReports) {
+  EventFiredSampler::TakeCounts();
+  EventFiredSampler::SetReportFires(false);
+  EventFiredSampler::SetEnabled(true);
+
+  size_t nReported = 0;
+  for(size_t i = 0; i < 50; i++)
+    if(EventFiredSampler::ShouldReport<SampledEvent>())
+      nReported++;
+
+  EventFiredSampler::SetEnabled(false);
+  EventFiredSampler::SetReportFires(true);
+
+  ASSERT_EQ(0UL, nReported) << "A fire was reported individually while reports were turned off";
+  ASSERT_EQ(50UL, CountOf(EventFiredSampler::TakeCounts(), typeid(SampledEvent))) << "Fires were not counted while reports were turned off";
+}
+
+class MeasuredEvent {
+public:
+  virtual void Measured(void) = 0;
+};
+
+class SlowMeasuredListener:
+  public MeasuredEvent
+{
+public:
+  void Measured(void) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+};
+
+class ThrowingMeasuredListener:
+  public MeasuredEvent
+{
+public:
+  void Measured(void) override {
+    throw std::runtime_error("Measured listener failed");
+  }
+};
+
+TEST_F(EventReceiverTest, EventStatsIdentifyListeners) {
+  AutoCurrentContext ctxt;
+  AutoRequired<SlowMeasuredListener> slow;
+  AutoFired<MeasuredEvent> sender;
+
+  // Nothing is collected until instrumentation is enabled
+  sender(&MeasuredEvent::Measured)();
+
+  AutoCreateContext subCtxt;
+  subCtxt->Initiate();
+  subCtxt->Inject<ThrowingMeasuredListener>();
+
+  ctxt->SetEventsInstrumented(true);
+  sender(&MeasuredEvent::Measured)();
+  sender(&MeasuredEvent::Measured)();
+  ctxt->SetEventsInstrumented(false);
+
+  const EventStats* pStats = nullptr;
+  auto stats = ctxt->GetEventStats();
+  for(const auto& entry : stats)
+    if(entry.name == autowiring::demangle(typeid(MeasuredEvent)))
+      pStats = &entry;
+  ASSERT_NE(nullptr, pStats) << "No statistics were reported for an instrumented event";
+
+  ASSERT_EQ(2UL, pStats->nFired);
+  ASSERT_EQ(3UL, pStats->nInvocations) << "The throwing listener should only have been called once before its context was torn down";
+  ASSERT_EQ(1UL, pStats->nExceptions);
+  ASSERT_EQ(2UL, pStats->listeners.size());
+
+  const EventListenerStats& slowStats = pStats->listeners[0];
+  const EventListenerStats& throwingStats = pStats->listeners[1];
+  ASSERT_EQ(autowiring::demangle(typeid(SlowMeasuredListener)), slowStats.name);
+  ASSERT_EQ(autowiring::demangle(typeid(ThrowingMeasuredListener)), throwingStats.name);
+  ASSERT_EQ(2UL, slowStats.nCalls);
+  ASSERT_EQ(0UL, slowStats.nExceptions);
+  ASSERT_EQ(1UL, throwingStats.nExceptions);
+  ASSERT_LE(std::chrono::milliseconds(2), slowStats.execTime.max) << "Listener execution time was not measured";
+}
+
+TEST_F(EventReceiverTest, FireStaticMatchesFire) {
+  AutoRequired<CountsProcess<1>> c1;
+  AutoRequired<CountsProcess<2>> c2;
+  AutoFired<HeavyEvent> sender;
+
+  std::atomic<int> nArrived(0);
+  ASSERT_TRUE((sender.FireStatic<decltype(&HeavyEvent::Process), &HeavyEvent::Process>()(nArrived)));
+  ASSERT_EQ(2, nArrived) << "Not every listener received a statically dispatched event";
+
+  AutoCreateContext subCtxt;
+  subCtxt->Initiate();
+  subCtxt->Inject<ThrowsOnProcess>();
+  ASSERT_FALSE((sender.FireStatic<decltype(&HeavyEvent::Process), &HeavyEvent::Process>()(nArrived))) << "An exception thrown by a listener was not reported";
+  ASSERT_EQ(5, nArrived);
+  ASSERT_TRUE(subCtxt->IsShutdown()) << "The context of a listener which threw was not torn down";
+}
+
+class RoutedEvent {
+public:
+  virtual void Deliver(int value) = 0;
+};
+
+template<int N>
+class RoutedListener:
+  public RoutedEvent
+{
+public:
+  std::vector<int> m_received;
+
+  void Deliver(int value) override {
+    m_received.push_back(value);
+  }
+};
+
+TEST_F(EventReceiverTest, KeyedFireReachesOnlySubscribers) {
+  AutoRequired<RoutedListener<1>> l1;
+  AutoRequired<RoutedListener<2>> l2;
+  AutoRequired<RoutedListener<3>> l3;
+  AutoFired<RoutedEvent> sender;
+
+  ASSERT_TRUE(sender.Subscribe(100, l1));
+  ASSERT_TRUE(sender.Subscribe(100, l2));
+  ASSERT_TRUE(sender.Subscribe(200, l3));
+
+  sender.ToKey(100)(&RoutedEvent::Deliver)(1);
+  sender.ToKey(200)(&RoutedEvent::Deliver)(2);
+  sender.ToKey(300)(&RoutedEvent::Deliver)(3);
+  sender(&RoutedEvent::Deliver)(4);
+
+  ASSERT_EQ((std::vector<int>{1, 4}), l1->m_received);
+  ASSERT_EQ((std::vector<int>{1, 4}), l2->m_received);
+  ASSERT_EQ((std::vector<int>{2, 4}), l3->m_received) << "A keyed fire reached a listener subscribed to a different key";
+
+  ASSERT_TRUE(sender.Unsubscribe(100, l1));
+  ASSERT_FALSE(sender.Unsubscribe(100, l1)) << "A listener was unsubscribed from the same key twice";
+  sender.ToKey(100)(&RoutedEvent::Deliver)(5);
+  ASSERT_EQ((std::vector<int>{1, 4}), l1->m_received) << "An unsubscribed listener still received keyed events";
+  ASSERT_EQ((std::vector<int>{1, 4, 5}), l2->m_received);
+}
+
+TEST_F(EventReceiverTest, KeyedDeferReachesOnlySubscribers) {
+  AutoRequired<SharedArgumentReceiver<4>> r1;
+  AutoRequired<SharedArgumentReceiver<5>> r2;
+  AutoFired<SharedArgumentInterface> sender;
+  ASSERT_TRUE(sender.Subscribe(1, r1));
+
+  std::vector<int> vec(1, 99);
+  sender.ToKey(1).Defer(&SharedArgumentInterface::ReceiveVector)(vec);
+  ASSERT_TRUE(r1->Async([] {}).WaitFor(std::chrono::seconds(5))) << "Listener did not process the deferred event";
+  ASSERT_TRUE(r2->Async([] {}).WaitFor(std::chrono::seconds(5))) << "Listener did not process the deferred event";
+
+  ASSERT_EQ(vec, r1->m_vec) << "A subscriber did not receive a keyed deferred event";
+  ASSERT_TRUE(r2->m_vec.empty()) << "A keyed deferred event reached a listener which did not subscribe";
+}
+
+TEST_F(EventReceiverTest, SubscriptionsEndWithTheListener) {
+  AutoFired<RoutedEvent> sender;
+  std::shared_ptr<RoutedListener<4>> listener;
+  {
+    AutoCreateContext subCtxt;
+    subCtxt->Initiate();
+    listener = subCtxt->Inject<RoutedListener<4>>();
+    ASSERT_TRUE(sender.Subscribe(7, listener));
+    sender.ToKey(7)(&RoutedEvent::Deliver)(1);
+    ASSERT_EQ(1UL, listener->m_received.size());
+
+    subCtxt->SignalShutdown(true);
+  }
+
+  sender.ToKey(7)(&RoutedEvent::Deliver)(2);
+  ASSERT_EQ(1UL, listener->m_received.size()) << "A listener received keyed events after its context was torn down";
+}
@@ -227,6 +227,8 @@ TEST_F(MarshalingTest, VerifySimpleDeserialization) {
   AutoFired<EventWithUuid> ewuuid;
   std::shared_ptr<EventOutputStream<EventWithUuid>> os = ctxt->CreateEventOutputStream<EventWithUuid>();
   ASSERT_NE(static_cast<void*>(nullptr), os.get());
+  os->EnableIdentity(&EventWithUuid::SampleEventFiring);
+  os->EnableIdentity(&EventWithUuid::SampleEventFiring3);
 
   std::string helloWorld = "Hello, world!";
   std::string helloWorldAgain = "Hello, world, again!";
@@ -303,6 +305,7 @@ TEST_F(MarshalingTest, VerifyComplexDeserialization) {
   AutoFired<EventWithUuid> ewuuid;
   std::shared_ptr<EventOutputStream<EventWithUuid>> os = ctxt->CreateEventOutputStream<EventWithUuid>();
   ASSERT_NE(static_cast<void*>(nullptr), os.get());
+  os->EnableIdentity(&EventWithUuid::SampleEventFiring3);
 
   std::string helloWorld = "Hello, world!";
   std::string helloWorldAgain = "Hello, world, again!";
@@ -391,3 +394,90 @@ TEST_F(MarshalingTest, VerifyAutoSerAndDeser) {
   // Ensure that we processed EXACTLY the number of bytes that were in the output stream:
   EXPECT_EQ(advanceBy, nRemaining) << "Output stream wrote extraneous bytes to its buffer which were not used during deserialization";
 }
+
+TEST_F(MarshalingTest, VerifyBinaryPayloadRoundTrip) {
+  AutoCurrentContext ctxt;
+  ctxt->Initiate();
+
+  AutoFired<EventWithUuid> ewuuid;
+  std::shared_ptr<EventOutputStream<EventWithUuid>> os = ctxt->CreateEventOutputStream<EventWithUuid>();
+  os->EnableIdentity(&EventWithUuid::SampleEventFiring);
+  os->EnableIdentity(&EventWithUuid::SampleEventFiring3);
+
+  // Embedded NULs and bytes which were once used as delimiters must survive the trip
+  std::string binary("\x00\xD8\xDE\xFF payload \x00", 15);
+  std::string empty;
+  std::string text = "After a binary argument";
+  ewuuid(&EventWithUuid::SampleEventFiring3)(&binary, &empty, &text);
+  ewuuid(&EventWithUuid::SampleEventFiring)(&binary);
+  ASSERT_LE(2 * binary.size() + text.size(), os->GetSize());
+
+  AutoRequired<ListenerForUuid> listener;
+  std::shared_ptr<EventInputStream<EventWithUuid>> is = ctxt->CreateEventInputStream<EventWithUuid>();
+
+  // The first event is not enabled on the input stream, and must be skipped in its entirety
+  is->EnableIdentity(&EventWithUuid::SampleEventFiring);
+
+  const char* ptr = static_cast<const char*>(os->GetData());
+  size_t nRemaining = os->GetSize();
+  size_t advanceBy = is->FireSingle(ptr, nRemaining);
+  ASSERT_NE(0UL, advanceBy) << "An event which was not enabled on the input stream was not skipped";
+  ASSERT_FALSE(listener->m_called) << "An event which was not enabled on the input stream was fired";
+
+  ptr += advanceBy;
+  nRemaining -= advanceBy;
+  ASSERT_EQ(0UL, is->FireSingle(ptr, nRemaining - 1)) << "A truncated record was processed";
+  ASSERT_FALSE(listener->m_called);
+
+  advanceBy = is->FireSingle(ptr, nRemaining);
+  ASSERT_EQ(nRemaining, advanceBy) << "Input stream did not consume exactly one record";
+  ASSERT_TRUE(listener->m_called) << "Event was not received from the event input stream";
+  ASSERT_EQ(binary, listener->m_str) << "A binary argument was corrupted in transit";
+}
+
+DECLARE_UUID(CollidingEvents, "0B0F6C39-6B4A-4C5B-9E0A-2F6A1C8D4E71")
+{
+public:
+  virtual void First(void) = 0;
+  virtual void Second(void) = 0;
+};
+
+TEST_F(MarshalingTest, CollidingIdentitiesAreRejected) {
+  AutoCurrentContext ctxt;
+
+  // These two identities have the same 32-bit FNV-1a hash, and so would be given the same event ID
+  ASSERT_EQ(autowiring::EventStreamFormat::IdOf("costarring"), autowiring::EventStreamFormat::IdOf("liquid"));
+
+  std::shared_ptr<EventOutputStream<CollidingEvents>> os = ctxt->CreateEventOutputStream<CollidingEvents>();
+  os->SpecialAssign<decltype(&CollidingEvents::First), &CollidingEvents::First>("costarring");
+  ASSERT_THROW(
+    (os->SpecialAssign<decltype(&CollidingEvents::Second), &CollidingEvents::Second>("liquid")),
+    autowiring_error
+  ) << "An output stream accepted an identity whose ID collides with one already enabled";
+
+  std::shared_ptr<EventInputStream<CollidingEvents>> is = ctxt->CreateEventInputStream<CollidingEvents>();
+  is->SpecialAssign<decltype(&CollidingEvents::First), &CollidingEvents::First>("costarring");
+  ASSERT_TRUE(is->IsEnabled("costarring"));
+  ASSERT_FALSE(is->IsEnabled("liquid")) << "An identity was reported enabled because its ID collides with one that is";
+  ASSERT_THROW(
+    (is->SpecialAssign<decltype(&CollidingEvents::Second), &CollidingEvents::Second>("liquid")),
+    autowiring_error
+  ) << "An input stream accepted an identity whose ID collides with one already enabled";
+
+  // Enabling the same identity again is not a collision
+  is->SpecialAssign<decltype(&CollidingEvents::First), &CollidingEvents::First>("costarring");
+}
+
+TEST_F(MarshalingTest, IdentitiesArePerStream) {
+  AutoCurrentContext ctxt;
+  std::shared_ptr<EventOutputStream<CollidingEvents>> enabled = ctxt->CreateEventOutputStream<CollidingEvents>();
+  std::shared_ptr<EventOutputStream<CollidingEvents>> other = ctxt->CreateEventOutputStream<CollidingEvents>();
+
+  enabled->SpecialAssign<decltype(&CollidingEvents::Second), &CollidingEvents::Second>("declinate");
+  ASSERT_TRUE(enabled->IsEnabled(&CollidingEvents::Second));
+  ASSERT_FALSE(other->IsEnabled(&CollidingEvents::Second)) << "Enabling an identity on one stream enabled it on another";
+
+  // A collision on one stream says nothing about another
+  other->SpecialAssign<decltype(&CollidingEvents::First), &CollidingEvents::First>("macallums");
+  ASSERT_TRUE(other->IsEnabled(&CollidingEvents::First));
+}